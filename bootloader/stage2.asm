@@ -25,6 +25,11 @@ PD              equ 0x00202000
 
 BOOT_INFO       equ 0x00005000
 
+; BIOS E820 memory map (24-byte entries) handed to the kernel via BootInfo
+E820_MAP        equ 0x00005100
+E820_MAX        equ 128
+E820_SMAP       equ 0x534D4150
+
 ; VESA VBE Structures
 VBE_INFO_ADDR   equ 0x00006000
 MODE_INFO_ADDR  equ 0x00006200
@@ -37,6 +42,8 @@ stage2_start:
     mov ss, ax
     mov sp, 0x7E00
 
+    call detect_memory
+
     ; --- VESA VBE SETUP ---
     mov di, VBE_INFO_ADDR
     mov ax, 0x4F00
@@ -113,6 +120,48 @@ stage2_start:
     mov cr0, eax
     jmp CODE32_SEG:protected_mode_entry
 
+; Collects the E820 map at E820_MAP and records the entry count and the
+; table address in BootInfo (+24 count, +32 map pointer). A count of zero
+; tells the kernel to fall back to probing.
+detect_memory:
+    mov dword [BOOT_INFO + 24], 0
+    mov dword [BOOT_INFO + 28], 0
+    mov dword [BOOT_INFO + 32], E820_MAP
+    mov dword [BOOT_INFO + 36], 0
+
+    xor ebx, ebx
+    xor si, si
+    mov di, E820_MAP
+.e820_next:
+    mov eax, 0xE820
+    mov edx, E820_SMAP
+    mov ecx, 24
+    mov dword [di + 20], 1      ; Default to "valid" for 20-byte BIOS replies
+    int 0x15
+    jc .e820_done               ; Unsupported, or past the last entry
+    cmp eax, E820_SMAP
+    jne .e820_done
+    jcxz .e820_skip
+    cmp cl, 20
+    jbe .e820_keep
+    test byte [di + 20], 1      ; ACPI 3.x "ignore this entry" bit
+    jz .e820_skip
+.e820_keep:
+    mov ecx, [di + 8]
+    or ecx, [di + 12]
+    jz .e820_skip               ; Zero-length region
+    inc si
+    add di, 24
+    cmp si, E820_MAX
+    jae .e820_done
+.e820_skip:
+    test ebx, ebx
+    jnz .e820_next
+.e820_done:
+    movzx eax, si
+    mov [BOOT_INFO + 24], eax
+    ret
+
 enable_a20:
     in al, 0x92
     or al, 0x02
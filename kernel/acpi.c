@@ -0,0 +1,225 @@
+#include "acpi.h"
+
+#include <stddef.h>
+#include "kstring.h"
+#include "syslog.h"
+
+/*
+ * Minimal ACPI table walker. The firmware tables live below 4GB on every
+ * machine we boot on, so they are read through the identity map.
+ */
+
+struct acpi_rsdp {
+    char signature[8];      // "RSD PTR "
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;       // 0 = ACPI 1.0 (RSDT only), 2+ = XSDT available
+    uint32_t rsdt_address;
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed));
+
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+struct acpi_madt {
+    struct acpi_sdt_header header;
+    uint32_t lapic_address;
+    uint32_t flags;
+    uint8_t entries[];
+} __attribute__((packed));
+
+struct madt_entry_header {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed));
+
+struct madt_lapic {
+    struct madt_entry_header header;
+    uint8_t processor_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed));
+
+struct madt_ioapic {
+    struct madt_entry_header header;
+    uint8_t ioapic_id;
+    uint8_t reserved;
+    uint32_t address;
+    uint32_t gsi_base;
+} __attribute__((packed));
+
+struct madt_override {
+    struct madt_entry_header header;
+    uint8_t bus;
+    uint8_t source;
+    uint32_t gsi;
+    uint16_t flags;
+} __attribute__((packed));
+
+struct acpi_hpet {
+    struct acpi_sdt_header header;
+    uint32_t event_timer_block_id;
+    uint8_t address_space;  // Generic address structure: 0 = memory
+    uint8_t register_width;
+    uint8_t register_offset;
+    uint8_t access_size;
+    uint64_t address;
+    uint8_t hpet_number;
+    uint16_t min_tick;
+    uint8_t page_protection;
+} __attribute__((packed));
+
+// XSDT entries are 8 bytes but only 4-byte aligned
+struct xsdt_entry {
+    uint64_t address;
+} __attribute__((packed));
+
+#define MADT_TYPE_LAPIC         0
+#define MADT_TYPE_IOAPIC        1
+#define MADT_TYPE_OVERRIDE      2
+#define MADT_LAPIC_ENABLED      0x1
+
+#define BDA_EBDA_SEGMENT        0x40E
+#define BIOS_ROM_START          0xE0000
+#define BIOS_ROM_END            0x100000
+
+#define ACPI_ADDRESS_SPACE_MEMORY 0
+
+static struct acpi_madt_info g_madt;
+static bool g_madt_valid = false;
+static uint64_t g_hpet_address = 0;
+static bool g_acpi_done = false;
+
+static bool checksum_ok(const void* data, size_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < length; i++) sum = (uint8_t)(sum + bytes[i]);
+    return sum == 0;
+}
+
+// The RSDP sits on a 16-byte boundary in the EBDA or the BIOS ROM area
+static const struct acpi_rsdp* rsdp_scan(uint64_t start, uint64_t end) {
+    for (uint64_t addr = start; addr + sizeof(struct acpi_rsdp) <= end; addr += 16) {
+        const struct acpi_rsdp* rsdp = (const struct acpi_rsdp*)(uintptr_t)addr;
+        if (kstrncmp(rsdp->signature, "RSD PTR ", 8) == 0 && checksum_ok(rsdp, 20)) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+static const struct acpi_rsdp* rsdp_find(void) {
+    const volatile uint16_t* bda = (const volatile uint16_t*)BDA_EBDA_SEGMENT;
+    // Hide the address from GCC, which assumes nothing lives in page 0
+    __asm__("" : "+r"(bda));
+    uint64_t ebda = (uint64_t)*bda << 4;
+    const struct acpi_rsdp* rsdp = NULL;
+    if (ebda >= 0x80000 && ebda < 0xA0000) rsdp = rsdp_scan(ebda, ebda + 1024);
+    if (!rsdp) rsdp = rsdp_scan(BIOS_ROM_START, BIOS_ROM_END);
+    return rsdp;
+}
+
+static const struct acpi_sdt_header* table_find(const struct acpi_rsdp* rsdp, const char* signature) {
+    bool use_xsdt = rsdp->revision >= 2 && rsdp->xsdt_address != 0;
+    const struct acpi_sdt_header* root = use_xsdt
+        ? (const struct acpi_sdt_header*)(uintptr_t)rsdp->xsdt_address
+        : (const struct acpi_sdt_header*)(uintptr_t)rsdp->rsdt_address;
+    if (!checksum_ok(root, root->length)) return NULL;
+
+    size_t entry_size = use_xsdt ? sizeof(struct xsdt_entry) : sizeof(uint32_t);
+    size_t count = (root->length - sizeof(*root)) / entry_size;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t addr = use_xsdt
+            ? ((const struct xsdt_entry*)(root + 1))[i].address
+            : ((const uint32_t*)(root + 1))[i];
+        const struct acpi_sdt_header* table = (const struct acpi_sdt_header*)(uintptr_t)addr;
+        if (kstrncmp(table->signature, signature, 4) == 0 && checksum_ok(table, table->length)) {
+            return table;
+        }
+    }
+    return NULL;
+}
+
+static void madt_parse(const struct acpi_madt* madt) {
+    g_madt = (struct acpi_madt_info){0};
+    g_madt.lapic_address = madt->lapic_address;
+
+    const uint8_t* cursor = madt->entries;
+    const uint8_t* end = (const uint8_t*)madt + madt->header.length;
+    while (cursor + sizeof(struct madt_entry_header) <= end) {
+        const struct madt_entry_header* entry = (const struct madt_entry_header*)cursor;
+        if (entry->length < sizeof(*entry) || cursor + entry->length > end) break;
+
+        if (entry->type == MADT_TYPE_LAPIC && entry->length >= sizeof(struct madt_lapic)) {
+            const struct madt_lapic* lapic = (const struct madt_lapic*)entry;
+            if ((lapic->flags & MADT_LAPIC_ENABLED) && g_madt.cpu_count < ACPI_MAX_CPUS) {
+                g_madt.cpu_apic_ids[g_madt.cpu_count++] = lapic->apic_id;
+            }
+        } else if (entry->type == MADT_TYPE_IOAPIC && entry->length >= sizeof(struct madt_ioapic)) {
+            const struct madt_ioapic* ioapic = (const struct madt_ioapic*)entry;
+            if (g_madt.ioapic_count < ACPI_MAX_IOAPICS) {
+                struct acpi_ioapic* io = &g_madt.ioapics[g_madt.ioapic_count++];
+                io->id = ioapic->ioapic_id;
+                io->address = ioapic->address;
+                io->gsi_base = ioapic->gsi_base;
+            }
+        } else if (entry->type == MADT_TYPE_OVERRIDE && entry->length >= sizeof(struct madt_override)) {
+            const struct madt_override* override = (const struct madt_override*)entry;
+            if (g_madt.override_count < ACPI_MAX_OVERRIDES) {
+                struct acpi_irq_override* ov = &g_madt.overrides[g_madt.override_count++];
+                ov->source = override->source;
+                ov->gsi = override->gsi;
+                ov->flags = override->flags;
+            }
+        }
+        cursor += entry->length;
+    }
+}
+
+bool acpi_init(void) {
+    if (g_acpi_done) return g_madt_valid;
+    g_acpi_done = true;
+
+    const struct acpi_rsdp* rsdp = rsdp_find();
+    if (!rsdp) {
+        syslog_write("ACPI: No RSDP found");
+        return false;
+    }
+
+    const struct acpi_hpet* hpet = (const struct acpi_hpet*)table_find(rsdp, "HPET");
+    if (hpet && hpet->header.length >= sizeof(*hpet) && hpet->address_space == ACPI_ADDRESS_SPACE_MEMORY) {
+        g_hpet_address = hpet->address;
+    }
+
+    const struct acpi_madt* madt = (const struct acpi_madt*)table_find(rsdp, "APIC");
+    if (!madt) {
+        syslog_write("ACPI: No MADT");
+        return false;
+    }
+
+    madt_parse(madt);
+    g_madt_valid = true;
+    syslog_write("ACPI: MADT parsed");
+    return true;
+}
+
+const struct acpi_madt_info* acpi_madt(void) {
+    return g_madt_valid ? &g_madt : NULL;
+}
+
+uint64_t acpi_hpet_address(void) {
+    return g_hpet_address;
+}
@@ -0,0 +1,170 @@
+#include "arena.h"
+#include "heap.h"
+#include "syslog.h"
+
+#define ARENA_CHUNK_SIZE    (64 * 1024)
+#define ARENA_MIN_CLASS     16
+#define ARENA_MAX_CLASS     2048
+#define ARENA_DEDICATED_MIN (ARENA_CHUNK_SIZE / 4) // Larger requests get their own chunk
+#define ARENA_MAGIC         0x414E5241u // "ARNA"
+#define ARENA_MAGIC_FREE    0x45455246u // "FREE", parked on a free list
+#define ARENA_ALIGN         16
+
+struct arena_chunk {
+    struct arena_chunk* next;
+    size_t size;                // Whole chunk, header included
+} __attribute__((aligned(16)));
+
+// Precedes every object, keeps payloads 16-byte aligned
+struct arena_object {
+    size_t size;                // Usable bytes (class size for small objects)
+    uint32_t magic;
+    uint32_t dedicated;         // Object owns its chunk
+} __attribute__((aligned(16)));
+
+struct arena_free_large {
+    struct arena_free_large* next;
+};
+
+_Static_assert(sizeof(struct arena_object) == 16, "Arena header must keep payloads 16-byte aligned");
+
+static inline struct arena_object* object_of(void* ptr) {
+    return (struct arena_object*)((uint8_t*)ptr - sizeof(struct arena_object));
+}
+
+static inline void* object_payload(struct arena_object* obj) {
+    return (uint8_t*)obj + sizeof(struct arena_object);
+}
+
+static size_t size_to_class(size_t size, size_t* class_size) {
+    size_t index = 0;
+    size_t current = ARENA_MIN_CLASS;
+    while (current < size) {
+        current <<= 1;
+        index++;
+    }
+    *class_size = current;
+    return index;
+}
+
+static struct arena_chunk* chunk_new(struct task_arena* arena, size_t size) {
+    struct arena_chunk* chunk = (struct arena_chunk*)kmalloc_tagged(size, HEAP_TAG_USER);
+    if (!chunk) return NULL;
+    chunk->size = size;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->bytes_reserved += size;
+    return chunk;
+}
+
+// Carves an object of 'size' usable bytes from the bump region.
+static struct arena_object* bump_alloc(struct task_arena* arena, size_t size) {
+    size_t needed = sizeof(struct arena_object) + size;
+    if (arena->bump == NULL || (size_t)(arena->bump_end - arena->bump) < needed) {
+        // The remainder of the old chunk is abandoned until the arena is released
+        struct arena_chunk* chunk = chunk_new(arena, ARENA_CHUNK_SIZE);
+        if (!chunk) return NULL;
+        arena->bump = (uint8_t*)chunk + sizeof(struct arena_chunk);
+        arena->bump_end = (uint8_t*)chunk + ARENA_CHUNK_SIZE;
+    }
+    struct arena_object* obj = (struct arena_object*)arena->bump;
+    arena->bump += needed;
+    obj->size = size;
+    obj->magic = ARENA_MAGIC;
+    obj->dedicated = 0;
+    return obj;
+}
+
+void* arena_alloc(struct task_arena* arena, size_t size) {
+    if (arena == NULL || size == 0) return NULL;
+
+    struct arena_object* obj = NULL;
+
+    if (size <= ARENA_MAX_CLASS) {
+        size_t class_size;
+        size_t index = size_to_class(size, &class_size);
+        void* head = arena->free_lists[index];
+        if (head) {
+            arena->free_lists[index] = *(void**)head;
+            obj = object_of(head);
+        } else {
+            obj = bump_alloc(arena, class_size);
+        }
+    } else if (size < ARENA_DEDICATED_MIN) {
+        size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+        struct arena_free_large** link = (struct arena_free_large**)&arena->large_free;
+        while (*link && object_of(*link)->size < size) link = &(*link)->next;
+        if (*link) {
+            obj = object_of(*link);
+            *link = (*link)->next;
+        } else {
+            obj = bump_alloc(arena, size);
+        }
+    } else {
+        size_t chunk_size = sizeof(struct arena_chunk) + sizeof(struct arena_object) + size;
+        if (chunk_size < size) return NULL; // Overflow
+        struct arena_chunk* chunk = chunk_new(arena, chunk_size);
+        if (!chunk) return NULL;
+        obj = (struct arena_object*)((uint8_t*)chunk + sizeof(struct arena_chunk));
+        obj->size = size;
+        obj->magic = ARENA_MAGIC;
+        obj->dedicated = 1;
+    }
+
+    if (!obj) return NULL;
+    obj->magic = ARENA_MAGIC;
+    arena->bytes_in_use += obj->size;
+    return object_payload(obj);
+}
+
+void arena_free(struct task_arena* arena, void* ptr) {
+    if (arena == NULL || ptr == NULL) return;
+
+    struct arena_object* obj = object_of(ptr);
+    if (obj->magic != ARENA_MAGIC) {
+        syslog_write("Arena: Invalid or double free");
+        return;
+    }
+
+    if (obj->dedicated) {
+        // Unlink and return the chunk right away
+        struct arena_chunk* chunk = (struct arena_chunk*)((uint8_t*)obj - sizeof(struct arena_chunk));
+        struct arena_chunk** link = &arena->chunks;
+        while (*link && *link != chunk) link = &(*link)->next;
+        if (*link == NULL) {
+            syslog_write("Arena: Free of foreign chunk");
+            return;
+        }
+        *link = chunk->next;
+        obj->magic = 0;
+        arena->bytes_in_use -= obj->size;
+        arena->bytes_reserved -= chunk->size;
+        kfree(chunk);
+        return;
+    }
+
+    arena->bytes_in_use -= obj->size;
+    obj->magic = ARENA_MAGIC_FREE;
+    if (obj->size <= ARENA_MAX_CLASS) {
+        size_t class_size;
+        size_t index = size_to_class(obj->size, &class_size);
+        *(void**)ptr = arena->free_lists[index];
+        arena->free_lists[index] = ptr;
+    } else {
+        struct arena_free_large* node = (struct arena_free_large*)ptr;
+        node->next = (struct arena_free_large*)arena->large_free;
+        arena->large_free = node;
+    }
+}
+
+void arena_release(struct task_arena* arena) {
+    if (arena == NULL) return;
+
+    struct arena_chunk* chunk = arena->chunks;
+    while (chunk) {
+        struct arena_chunk* next = chunk->next;
+        kfree(chunk);
+        chunk = next;
+    }
+    *arena = (struct task_arena){0};
+}
@@ -0,0 +1,121 @@
+#include "clocksource.h"
+
+#include <stddef.h>
+#include "acpi.h"
+#include "cpu.h"
+#include "paging.h"
+#include "syslog.h"
+#include "timer.h"
+
+#define TSC_CALIBRATE_MS        50      // Longest window PIT channel 2 can time
+
+#define CPUID_EXT_MAX           0x80000000
+#define CPUID_EXT_POWER         0x80000007
+#define CPUID_INVARIANT_TSC     (1u << 8)
+
+#define HPET_REG_CAPABILITIES   0x000
+#define HPET_REG_CONFIG         0x010
+#define HPET_REG_COUNTER        0x0F0
+#define HPET_CAP_64BIT          (1ull << 13)
+#define HPET_CONFIG_ENABLE      0x1
+#define HPET_MAX_PERIOD_FS      100000000ull    // 100 ns, per the spec
+#define FEMTOS_PER_NSEC         1000000ull
+
+#define NSEC_PER_SEC            1000000000ull
+#define CLOCK_SHIFT             32
+
+/*
+ * A counter ticking at 'freq' Hz converts to nanoseconds as
+ * (delta * mult) >> CLOCK_SHIFT, with mult = 10^9 * 2^32 / freq. The
+ * product is 128 bits wide, so a delta never overflows.
+ */
+struct clocksource {
+    const char* name;
+    uint64_t (*read)(void);
+    uint64_t mult;
+};
+
+static const struct clocksource* g_source = NULL;
+static uint64_t g_base = 0;
+static volatile uint64_t* g_hpet = NULL;
+
+static uint64_t tsc_read(void) {
+    return rdtsc();
+}
+
+static uint64_t hpet_read(void) {
+    return g_hpet[HPET_REG_COUNTER / 8];
+}
+
+static struct clocksource g_tsc_source = { "tsc", tsc_read, 0 };
+static struct clocksource g_hpet_source = { "hpet", hpet_read, 0 };
+
+static uint64_t mult_for(uint64_t freq_hz) {
+    return (NSEC_PER_SEC << CLOCK_SHIFT) / freq_hz;
+}
+
+static bool tsc_invariant(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(CPUID_EXT_MAX, &eax, &ebx, &ecx, &edx);
+    if (eax < CPUID_EXT_POWER) return false;
+    cpuid(CPUID_EXT_POWER, &eax, &ebx, &ecx, &edx);
+    return (edx & CPUID_INVARIANT_TSC) != 0;
+}
+
+// Counts TSC cycles over TSC_CALIBRATE_MS, timed by PIT channel 2
+static uint64_t tsc_calibrate_hz(void) {
+    uint64_t start = rdtsc();
+    pit_oneshot_wait(TSC_CALIBRATE_MS);
+    uint64_t end = rdtsc();
+    return (end - start) * (1000 / TSC_CALIBRATE_MS);
+}
+
+// Enables the main counter; only 64-bit counters qualify, a 32-bit one wraps in minutes
+static bool hpet_setup(void) {
+    uint64_t phys = acpi_hpet_address();
+    if (phys == 0 || !paging_set_uncached(phys)) return false;
+
+    volatile uint64_t* regs = (volatile uint64_t*)(uintptr_t)phys;
+    uint64_t caps = regs[HPET_REG_CAPABILITIES / 8];
+    uint64_t period_fs = caps >> 32;
+    if (!(caps & HPET_CAP_64BIT) || period_fs == 0 || period_fs > HPET_MAX_PERIOD_FS) return false;
+
+    regs[HPET_REG_CONFIG / 8] |= HPET_CONFIG_ENABLE;
+    g_hpet = regs;
+    // The period is exact, so derive mult from it rather than a rounded rate
+    g_hpet_source.mult = (period_fs << CLOCK_SHIFT) / FEMTOS_PER_NSEC;
+    return true;
+}
+
+void clocksource_init(void) {
+    acpi_init();
+
+    if (tsc_invariant()) {
+        uint64_t hz = tsc_calibrate_hz();
+        if (hz != 0) {
+            g_tsc_source.mult = mult_for(hz);
+            g_source = &g_tsc_source;
+        }
+    }
+    if (!g_source && hpet_setup()) g_source = &g_hpet_source;
+
+    if (g_source) g_base = g_source->read();
+    syslog_write(g_source == &g_tsc_source ? "Clock: Invariant TSC, calibrated against the PIT"
+                 : g_source ? "Clock: HPET main counter"
+                 : "Clock: No TSC or HPET, tick resolution only");
+}
+
+uint64_t clock_monotonic_ns(void) {
+    const struct clocksource* source = g_source;
+    if (!source) return timer_get_us() * 1000;
+    uint64_t delta = source->read() - g_base;
+    return (uint64_t)(((unsigned __int128)delta * source->mult) >> CLOCK_SHIFT);
+}
+
+const char* clocksource_name(void) {
+    return g_source ? g_source->name : "tick";
+}
+
+bool clocksource_is_continuous(void) {
+    return g_source != NULL;
+}
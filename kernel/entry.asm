@@ -4,7 +4,12 @@ section .text
     global _start
     global context_switch
     global _iret_stub
+    global task_start_stub
     global isr_syscall
+    global syscall_entry
+    global ap_trampoline_start
+    global ap_trampoline_end
+    global ap_trampoline_params
     
     extern kmain
     extern gdt_init
@@ -15,6 +20,8 @@ section .text
     extern __bss_end
     extern g_kernel_stack_top
     extern syscall_dispatcher
+    extern exit_current_task
+    extern schedule_tail
 
 _start:
     cli
@@ -73,12 +80,34 @@ context_switch:
 
 ; Used by spawn_user_task to exit kernel mode
 _iret_stub:
+    sub rsp, 8              ; Keep the call 16-byte aligned
+    call schedule_tail
+    add rsp, 8
+    cli                     ; No interrupt between swapgs and iretq
+    swapgs                  ; Leave the per-CPU block in KERNEL_GS_BASE
     iretq
 
+; First return target of a new kernel thread (see spawn_task).
+; The switch may have happened inside an interrupt handler, so interrupts
+; are re-enabled here. R12 holds the entry point.
+task_start_stub:
+    call schedule_tail
+    sti
+    call r12
+    call exit_current_task
+.never:
+    hlt
+    jmp .never
+
 ; ---------------------------------------------
 ; System Call Entry Point (INT 0x80)
 ; ---------------------------------------------
 isr_syscall:
+    ; GS is user-loadable: swap in the per-CPU block if we came from Ring 3
+    test qword [rsp + 8], 3
+    jz .from_kernel
+    swapgs
+.from_kernel:
     ; 1. Save User State
     push rbp
     push r15
@@ -120,6 +149,146 @@ isr_syscall:
     
     ; RAX contains return value from syscall_dispatcher
     
+    test qword [rsp + 8], 3
+    jz .to_kernel
+    swapgs
+.to_kernel:
     iretq
 
+; ---------------------------------------------
+; System Call Entry Point (SYSCALL)
+; ---------------------------------------------
+; The CPU left the user RIP in rcx and RFLAGS in r11 and did not switch
+; stacks. After swapgs, GS points at this CPU's struct syscall_cpu
+; (syscall.c); the stub builds the same frame int 0x80 would and shares
+; its dispatcher. SYSCALL only comes from Ring 3, so the swap is unconditional.
+syscall_entry:
+    swapgs
+    mov [gs:8], rsp                 ; user_rsp
+    mov rsp, [gs:0]                 ; kernel_rsp
+
+    push qword 0x1B                 ; SS
+    push qword [gs:8]               ; RSP
+    push r11                        ; RFLAGS
+    push qword 0x23                 ; CS
+    push rcx                        ; RIP
+
+    push rbp
+    push r15
+    push r14
+    push r13
+    push r12
+    push r11
+    push r10
+    push r9
+    push r8
+    push rdi
+    push rsi
+    push rdx
+    push rcx
+    push rbx
+
+    mov rdi, rsp
+    call syscall_dispatcher
+
+    pop rbx
+    pop rcx
+    pop rdx
+    pop rsi
+    pop rdi
+    pop r8
+    pop r9
+    pop r10
+    pop r11
+    pop r12
+    pop r13
+    pop r14
+    pop r15
+    pop rbp
+    swapgs                          ; Interrupts stay masked until sysret/iretq
+
+    ; SYSRET to a non-canonical RIP faults in Ring 0; let iretq take it
+    mov rcx, [rsp]
+    mov r11, rcx
+    shr r11, 47
+    jnz .slow
+
+    mov r11, [rsp + 16]             ; RFLAGS
+    mov rsp, [rsp + 24]             ; User RSP
+    o64 sysret
+
+.slow:
+    iretq
+
+; ---------------------------------------------
+; AP Startup Trampoline
+; ---------------------------------------------
+; smp_init copies ap_trampoline_start..ap_trampoline_end to
+; AP_TRAMPOLINE_BASE and fills in the parameter block. A STARTUP IPI
+; starts the AP here in real mode with CS:IP = base:0.
+AP_TRAMPOLINE_BASE equ 0x1000       ; Must match smp.c
+%define TRAMPOLINE_ADDR(label) (AP_TRAMPOLINE_BASE + (label) - ap_trampoline_start)
+
+BITS 16
+ap_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [TRAMPOLINE_ADDR(ap_gdt_descriptor)]
+
+    ; Same paging setup as the boot CPU
+    mov eax, [TRAMPOLINE_ADDR(ap_param_cr4)]
+    mov cr4, eax
+    mov eax, [TRAMPOLINE_ADDR(ap_param_cr3)]
+    mov cr3, eax
+    mov ecx, 0xC0000080     ; EFER
+    mov eax, [TRAMPOLINE_ADDR(ap_param_efer)]
+    xor edx, edx
+    wrmsr
+
+    ; PE and PG together take us from real mode straight to long mode
+    mov eax, cr0
+    or eax, 0x80000001
+    mov cr0, eax
+    jmp dword 0x08:TRAMPOLINE_ADDR(ap_trampoline_long)
+
+BITS 64
+ap_trampoline_long:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+    xor ax, ax
+    mov fs, ax
+    mov gs, ax
+
+    mov rsp, [TRAMPOLINE_ADDR(ap_param_stack)]
+    mov rdi, [TRAMPOLINE_ADDR(ap_param_cpu)]
+    mov rax, [TRAMPOLINE_ADDR(ap_param_entry)]
+    call rax
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+align 8
+ap_gdt:
+    dq 0
+    dq 0x00AF9A000000FFFF   ; 0x08: 64-bit code
+    dq 0x00CF92000000FFFF   ; 0x10: data
+ap_gdt_descriptor:
+    dw ap_gdt_descriptor - ap_gdt - 1
+    dd TRAMPOLINE_ADDR(ap_gdt)
+
+align 8
+ap_trampoline_params:       ; struct ap_boot_params in smp.c
+ap_param_cr3:   dq 0
+ap_param_cr4:   dq 0
+ap_param_efer:  dq 0
+ap_param_stack: dq 0
+ap_param_entry: dq 0
+ap_param_cpu:   dq 0
+ap_trampoline_end:
+
 section .note.GNU-stack noalloc noexec nowrite progbits
@@ -0,0 +1,201 @@
+#include "fpu.h"
+
+#include <stddef.h>
+#include "cpu.h"
+#include "heap.h"
+#include "interrupts.h"
+#include "scheduler.h"
+#include "syslog.h"
+
+#define CR0_MP          (1ull << 1)
+#define CR0_EM          (1ull << 2)
+#define CR0_TS          (1ull << 3)
+#define CR0_NE          (1ull << 5)
+#define CR4_OSFXSR      (1ull << 9)
+#define CR4_OSXMMEXCPT  (1ull << 10)
+#define CR4_OSXSAVE     (1ull << 18)
+
+#define CPUID1_ECX_XSAVE  (1u << 26)
+#define CPUID1_ECX_AVX    (1u << 28)
+#define CPUID_XSAVE_LEAF  0x0D
+#define XSAVEOPT_BIT      (1u << 0)   // Leaf 0xD, subleaf 1, EAX
+
+#define XCR0_X87  (1ull << 0)
+#define XCR0_SSE  (1ull << 1)
+#define XCR0_AVX  (1ull << 2)
+
+#define FXSAVE_SIZE  512
+#define FPU_ALIGN    64               // XSAVE needs 64, FXSAVE 16
+#define MXCSR_DEFAULT 0x1F80          // All SIMD exceptions masked
+
+// kernel_fpu_begin token: user registers were saved and interrupts are off
+#define KFPU_SAVED (1ull << 63)
+
+static bool g_fpu_ready = false;
+static bool g_use_xsave = false;
+static bool g_use_xsaveopt = false;
+static uint64_t g_xcr0 = 0;
+static uint32_t g_state_size = FXSAVE_SIZE;
+static void* g_init_state = NULL;     // Clean state every new area starts from
+
+static void fpu_save(void* area) {
+    if (g_use_xsaveopt) {
+        __asm__ volatile("xsaveopt64 (%0)" : : "r"(area), "a"(0xFFFFFFFFu), "d"(0xFFFFFFFFu) : "memory");
+    } else if (g_use_xsave) {
+        __asm__ volatile("xsave64 (%0)" : : "r"(area), "a"(0xFFFFFFFFu), "d"(0xFFFFFFFFu) : "memory");
+    } else {
+        __asm__ volatile("fxsave64 (%0)" : : "r"(area) : "memory");
+    }
+}
+
+static void fpu_restore(const void* area) {
+    if (g_use_xsave) {
+        __asm__ volatile("xrstor64 (%0)" : : "r"(area), "a"(0xFFFFFFFFu), "d"(0xFFFFFFFFu) : "memory");
+    } else {
+        __asm__ volatile("fxrstor64 (%0)" : : "r"(area) : "memory");
+    }
+}
+
+static void set_ts(bool on) {
+    uint64_t cr0 = read_cr0();
+    if (on && !(cr0 & CR0_TS)) write_cr0(cr0 | CR0_TS);
+    else if (!on && (cr0 & CR0_TS)) __asm__ volatile("clts" ::: "memory");
+}
+
+static void copy_bytes(void* dest, const void* src, size_t n) {
+    __asm__ volatile("rep movsb" : "+D"(dest), "+S"(src), "+c"(n) : : "memory");
+}
+
+void fpu_init_cpu(void) {
+    // Native x87 error reporting, no emulation, and TS until a task claims it
+    uint64_t cr0 = read_cr0();
+    cr0 &= ~CR0_EM;
+    cr0 |= CR0_MP | CR0_NE;
+    write_cr0(cr0);
+
+    uint64_t cr4 = read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT;
+    if (g_use_xsave) cr4 |= CR4_OSXSAVE;
+    write_cr4(cr4);
+    if (g_use_xsave) xsetbv(0, g_xcr0);
+
+    set_ts(true);
+}
+
+void fpu_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    g_use_xsave = (ecx & CPUID1_ECX_XSAVE) != 0;
+    g_xcr0 = XCR0_X87 | XCR0_SSE;
+    if (g_use_xsave && (ecx & CPUID1_ECX_AVX)) g_xcr0 |= XCR0_AVX;
+
+    fpu_init_cpu();
+
+    if (g_use_xsave) {
+        // EBX: area size for the features now enabled in XCR0
+        cpuid_count(CPUID_XSAVE_LEAF, 0, &eax, &ebx, &ecx, &edx);
+        g_state_size = ebx;
+        cpuid_count(CPUID_XSAVE_LEAF, 1, &eax, &ebx, &ecx, &edx);
+        g_use_xsaveopt = (eax & XSAVEOPT_BIT) != 0;
+    }
+
+    // XRSTOR requires a zeroed header, so start from a cleared area
+    g_init_state = kmalloc_aligned_tagged(g_state_size, FPU_ALIGN, HEAP_TAG_TASK);
+    if (!g_init_state) {
+        syslog_write("FPU: No memory for the initial state; SIMD disabled");
+        return;
+    }
+    uint8_t* bytes = (uint8_t*)g_init_state;
+    for (uint32_t i = 0; i < g_state_size; i++) bytes[i] = 0;
+
+    uint32_t mxcsr = MXCSR_DEFAULT;
+    set_ts(false);
+    __asm__ volatile("fninit; ldmxcsr %0" : : "m"(mxcsr));
+    if (g_use_xsave) {
+        __asm__ volatile("xsave64 (%0)" : : "r"(g_init_state), "a"(0xFFFFFFFFu), "d"(0xFFFFFFFFu) : "memory");
+    } else {
+        __asm__ volatile("fxsave64 (%0)" : : "r"(g_init_state) : "memory");
+    }
+    set_ts(true);
+    g_fpu_ready = true;
+
+    if (g_xcr0 & XCR0_AVX) syslog_write("FPU: SSE and AVX enabled (XSAVE)");
+    else if (g_use_xsave) syslog_write("FPU: SSE enabled (XSAVE)");
+    else syslog_write("FPU: SSE enabled (FXSAVE)");
+}
+
+bool fpu_available(void) {
+    return g_fpu_ready;
+}
+
+bool fpu_handle_trap(void) {
+    if (!g_fpu_ready) return false;
+
+    set_ts(false);
+    Task* task = scheduler_current_task();
+    if (!task) {
+        // Boot code before the scheduler: nothing to preserve yet
+        fpu_restore(g_init_state);
+        return true;
+    }
+
+    if (!task->fpu_state) {
+        void* area = kmalloc_aligned_tagged(g_state_size, FPU_ALIGN, HEAP_TAG_TASK);
+        if (!area) {
+            syslog_write("FPU: No memory for a task's SIMD state");
+            return false;
+        }
+        copy_bytes(area, g_init_state, g_state_size);
+        task->fpu_state = area;
+    }
+    fpu_restore(task->fpu_state);
+    return true;
+}
+
+void fpu_switch(Task* prev, Task* next) {
+    if (!g_fpu_ready) return;
+
+    // Only tasks that have used the FPU pay for saving it
+    if (prev->fpu_state && prev->state != TASK_DEAD) fpu_save(prev->fpu_state);
+    if (next->fpu_state) {
+        set_ts(false);
+        fpu_restore(next->fpu_state);
+    } else {
+        set_ts(true);
+    }
+}
+
+void fpu_free(Task* task) {
+    kfree(task->fpu_state);
+    task->fpu_state = NULL;
+}
+
+uint64_t kernel_fpu_begin(void) {
+    uint16_t cs;
+    __asm__ volatile("mov %%cs, %0" : "=r"(cs));
+    // Ring 3 code and kernel threads use their own, switched state
+    if ((cs & 3) != 0 || !g_fpu_ready) return 0;
+
+    uint64_t flags = irq_save();
+    Task* task = scheduler_current_task();
+    if (!task || !task->is_user) {
+        irq_restore(flags);
+        return 0;
+    }
+
+    // A user task in a syscall: park its registers until kernel_fpu_end
+    if (task->fpu_state) fpu_save(task->fpu_state);
+    set_ts(false);
+    return flags | KFPU_SAVED;
+}
+
+void kernel_fpu_end(uint64_t token) {
+    if (!(token & KFPU_SAVED)) return;
+
+    Task* task = scheduler_current_task();
+    if (task->fpu_state) {
+        fpu_restore(task->fpu_state);
+    } else {
+        set_ts(true);
+    }
+    irq_restore(token);
+}
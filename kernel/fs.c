@@ -4,12 +4,17 @@
 #include "os_info.h"
 #include "syslog.h"
 #include "ata.h"
+#include "mutex.h"
 
 #define FS_STORAGE_LBA 2048
 #define FS_MAGIC_VAL   0xBA5EBA11
 
 static struct fs_file FILES[FS_MAX_FILES];
 
+// Serializes changes and the disk sync that follows each one. Lookups stay
+// lockless because the GUI calls them from Ring 3, where we cannot sleep.
+static struct mutex g_fs_lock = MUTEX_INIT("fs");
+
 // Helper to persist data to the disk
 static void fs_sync_to_disk(void) {
     if (!ata_init()) return; 
@@ -135,8 +140,12 @@ static bool fs_seed_file(const char* name, const char* contents) {
 }
 
 void fs_init(void) {
+    mutex_register(&g_fs_lock);
+    mutex_lock(&g_fs_lock);
+
     // Try to load existing FS
     if (fs_load_from_disk()) {
+        mutex_unlock(&g_fs_lock);
         syslog_write("FS: loaded from persistent storage");
         return;
     }
@@ -168,6 +177,7 @@ void fs_init(void) {
     syslog_write("FS: mounted fresh volume (unsaved)");
     
     fs_sync_to_disk();
+    mutex_unlock(&g_fs_lock);
     syslog_write("FS: filesystem formatted and saved");
     
     fs_self_test();
@@ -195,88 +205,101 @@ const struct fs_file* fs_find(const char* name) {
     return fs_find_mutable(name);
 }
 
-bool fs_touch(const char* name) {
-    if (!fs_is_valid_name(name)) return false;
+// Returns the file, creating it if needed; *created says which
+static struct fs_file* touch_locked(const char* name, bool* created) {
+    *created = false;
+    if (!fs_is_valid_name(name)) return NULL;
 
     struct fs_file* existing = fs_find_mutable(name);
-    if (existing != NULL) return true;
+    if (existing != NULL) return existing;
 
     struct fs_file* slot = fs_allocate_slot();
-    if (slot == NULL) return false;
+    if (slot == NULL) return NULL;
 
     slot->in_use = true;
     fs_copy_name(slot, name);
     slot->size = 0;
     slot->data[0] = '\0';
-    
-    fs_sync_to_disk();
-    return true;
+    *created = true;
+    return slot;
+}
+
+bool fs_touch(const char* name) {
+    mutex_lock(&g_fs_lock);
+    bool created;
+    bool ok = touch_locked(name, &created) != NULL;
+    if (created) fs_sync_to_disk();
+    mutex_unlock(&g_fs_lock);
+    return ok;
 }
 
 bool fs_write(const char* name, const char* contents) {
     if (name == NULL || contents == NULL) return false;
 
-    bool existed = fs_find_mutable(name) != NULL;
-    if (!fs_touch(name)) return false;
-
-    struct fs_file* file = fs_find_mutable(name);
-    if (file == NULL) return false;
+    mutex_lock(&g_fs_lock);
+    bool created;
+    struct fs_file* file = touch_locked(name, &created);
+    bool ok = file != NULL;
 
     size_t length = kstrlen(contents);
-    if (length >= FS_MAX_FILE_SIZE) {
-        if (!existed) fs_clear(file);
-        return false;
+    if (ok && length >= FS_MAX_FILE_SIZE) {
+        if (created) fs_clear(file);
+        ok = false;
     }
 
-    for (size_t i = 0; i < length; i++) {
-        file->data[i] = contents[i];
+    if (ok) {
+        for (size_t i = 0; i < length; i++) {
+            file->data[i] = contents[i];
+        }
+        file->data[length] = '\0';
+        file->size = length;
+        fs_sync_to_disk();
     }
-    file->data[length] = '\0';
-    file->size = length;
-    
-    fs_sync_to_disk();
-    return true;
+    mutex_unlock(&g_fs_lock);
+    return ok;
 }
 
 bool fs_append(const char* name, const char* contents) {
     if (name == NULL || contents == NULL) return false;
 
-    bool existed = fs_find_mutable(name) != NULL;
-    if (!fs_touch(name)) return false;
-
-    struct fs_file* file = fs_find_mutable(name);
-    if (file == NULL) return false;
+    mutex_lock(&g_fs_lock);
+    bool created;
+    struct fs_file* file = touch_locked(name, &created);
+    bool ok = file != NULL;
 
     size_t length = kstrlen(contents);
-    if (file->size + length >= FS_MAX_FILE_SIZE) {
-        if (!existed) fs_clear(file);
-        return false;
+    if (ok && file->size + length >= FS_MAX_FILE_SIZE) {
+        if (created) fs_clear(file);
+        ok = false;
     }
 
-    for (size_t i = 0; i < length; i++) {
-        file->data[file->size + i] = contents[i];
+    if (ok) {
+        for (size_t i = 0; i < length; i++) {
+            file->data[file->size + i] = contents[i];
+        }
+        file->size += length;
+        file->data[file->size] = '\0';
+        fs_sync_to_disk();
     }
-    file->size += length;
-    file->data[file->size] = '\0';
-    
-    fs_sync_to_disk();
-    return true;
+    mutex_unlock(&g_fs_lock);
+    return ok;
 }
 
 bool fs_remove(const char* name) {
+    mutex_lock(&g_fs_lock);
     struct fs_file* file = fs_find_mutable(name);
-    if (file == NULL) return false;
-
-    fs_clear(file);
-    fs_sync_to_disk();
-    return true;
+    if (file != NULL) {
+        fs_clear(file);
+        fs_sync_to_disk();
+    }
+    mutex_unlock(&g_fs_lock);
+    return file != NULL;
 }
 
 static void fs_self_test(void) {
     const char* scratch = "__fs_self_test__";
-    struct fs_file* f = fs_find_mutable(scratch);
-    if (f) fs_clear(f);
-    
+    fs_remove(scratch);
+
     if (!fs_touch(scratch)) {
         syslog_write("FS: self-test (touch) failed");
         return;
@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "smp.h"
 #include "syslog.h"
 
 struct gdt_entry64 {
@@ -59,22 +60,21 @@ _Static_assert(offsetof(struct gdt_layout, tss) == 0x28, "TSS selector must be 0
 enum {
     KERNEL_STACK_SIZE = 16384,
     DOUBLE_FAULT_STACK_SIZE = 4096,
+    NMI_STACK_SIZE = 4096,
 };
 
 uint8_t g_kernel_stack[KERNEL_STACK_SIZE] __attribute__((aligned(16)));
 uint8_t* const g_kernel_stack_top = g_kernel_stack + KERNEL_STACK_SIZE;
-static uint8_t g_double_fault_stack[DOUBLE_FAULT_STACK_SIZE] __attribute__((aligned(16)));
 
-static struct tss g_tss __attribute__((aligned(16))) = {
-    .rsp = {[0] = (uint64_t)(g_kernel_stack + sizeof(g_kernel_stack))},
-    .ist = {[0] = (uint64_t)(g_double_fault_stack + sizeof(g_double_fault_stack))},
-    .io_map_base = sizeof(struct tss),
-};
-
-static struct gdt_layout g_gdt __attribute__((aligned(16)));
+// Each CPU loads its own GDT, since the TSS descriptor's busy bit is per copy
+static uint8_t g_double_fault_stacks[SMP_MAX_CPUS][DOUBLE_FAULT_STACK_SIZE] __attribute__((aligned(16)));
+// An NMI can land right after SYSCALL, before the stub leaves the user stack
+static uint8_t g_nmi_stacks[SMP_MAX_CPUS][NMI_STACK_SIZE] __attribute__((aligned(16)));
+static struct tss g_tss[SMP_MAX_CPUS] __attribute__((aligned(16)));
+static struct gdt_layout g_gdt[SMP_MAX_CPUS] __attribute__((aligned(16)));
 
 void gdt_set_kernel_stack(uint64_t stack_top) {
-    g_tss.rsp[0] = stack_top;
+    g_tss[smp_cpu_id()].rsp[0] = stack_top;
 }
 
 static void gdt_set_entry(struct gdt_entry64* entry, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags) {
@@ -119,7 +119,19 @@ static void tss_load(uint16_t selector) {
 }
 
 void gdt_init(void) {
-    g_gdt = (struct gdt_layout){0};
+    g_tss[0].rsp[0] = (uint64_t)g_kernel_stack_top;
+    gdt_init_cpu(0);
+    syslog_write("GDT: Loaded with User Segments");
+}
+
+void gdt_init_cpu(uint32_t cpu) {
+    struct gdt_layout* gdt = &g_gdt[cpu];
+    struct tss* tss = &g_tss[cpu];
+    *gdt = (struct gdt_layout){0};
+
+    tss->ist[0] = (uint64_t)(g_double_fault_stacks[cpu] + DOUBLE_FAULT_STACK_SIZE);
+    tss->ist[1] = (uint64_t)(g_nmi_stacks[cpu] + NMI_STACK_SIZE);
+    tss->io_map_base = sizeof(struct tss);
     
     // GDT Entries
     // Access: Present(1) | DPL(0 or 3) | S(1) | Ex(1/0) | DC | RW | Ac
@@ -128,22 +140,20 @@ void gdt_init(void) {
     // 0xF2 = P=1, DPL=3, S=1, Type=Data(0010) -> User Data
     // 0xFA = P=1, DPL=3, S=1, Type=Code(1010) -> User Code
 
-    gdt_set_entry(&g_gdt.null, 0, 0, 0, 0);
-    gdt_set_entry(&g_gdt.k_code, 0, 0, 0x9A, 0x20); // Ring 0 Code (L=1)
-    gdt_set_entry(&g_gdt.k_data, 0, 0, 0x92, 0x00); // Ring 0 Data
-    gdt_set_entry(&g_gdt.u_data, 0, 0, 0xF2, 0x00); // Ring 3 Data
-    gdt_set_entry(&g_gdt.u_code, 0, 0, 0xFA, 0x20); // Ring 3 Code (L=1)
+    gdt_set_entry(&gdt->null, 0, 0, 0, 0);
+    gdt_set_entry(&gdt->k_code, 0, 0, 0x9A, 0x20); // Ring 0 Code (L=1)
+    gdt_set_entry(&gdt->k_data, 0, 0, 0x92, 0x00); // Ring 0 Data
+    gdt_set_entry(&gdt->u_data, 0, 0, 0xF2, 0x00); // Ring 3 Data
+    gdt_set_entry(&gdt->u_code, 0, 0, 0xFA, 0x20); // Ring 3 Code (L=1)
     
-    gdt_set_tss_entry(&g_gdt.tss, (uint64_t)&g_tss, (uint32_t)sizeof(g_tss) - 1);
+    gdt_set_tss_entry(&gdt->tss, (uint64_t)tss, (uint32_t)sizeof(*tss) - 1);
 
     const struct gdt_descriptor descriptor = {
-        .limit = (uint16_t)(sizeof(g_gdt) - 1),
-        .base = (uint64_t)&g_gdt,
+        .limit = (uint16_t)(sizeof(*gdt) - 1),
+        .base = (uint64_t)gdt,
     };
 
     gdt_load_descriptor(&descriptor);
     // Load TSS (Index 5 -> 0x28)
     tss_load(0x28);
-    
-    syslog_write("GDT: Loaded with User Segments");
 }
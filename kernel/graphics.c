@@ -3,22 +3,27 @@
 #include <stdbool.h>
 #include "system.h"
 #include "syslog.h"
-
-// Hardcoded location for the backbuffer (4MB mark)
-// This is safe because:
-// 1. Kernel is loaded at 1MB and limited to <2MB by linker script
-// 2. Bootloader stack top is 0x3FF000 (just below 4MB)
-// 3. First 1GB is identity mapped
-#define BACK_BUFFER_ADDR 0x00400000
+#include "pmm.h"
+#include "fpu.h"
+#include "simd.h"
 
 static uint32_t* g_framebuffer = NULL;
 static uint32_t* g_draw_buffer = NULL;
-static uint32_t* g_back_buffer = (uint32_t*)BACK_BUFFER_ADDR;
+static uint32_t* g_back_buffer = NULL; // Physical frames from the PMM, sized pitch * height
 static bool g_double_buffered = false;
 
 static uint32_t g_width = 0;
 static uint32_t g_height = 0;
 static uint32_t g_pitch = 0;
+static bool g_simd_disabled = false;
+
+static bool use_simd(void) {
+    return !g_simd_disabled && fpu_available();
+}
+
+void graphics_disable_simd(void) {
+    g_simd_disabled = true;
+}
 
 // Minimal 8x8 Bitmap Font (CP437-ish subset)
 // 1 = Pixel On, 0 = Pixel Off
@@ -105,9 +110,18 @@ void graphics_init(void) {
     // Default to direct drawing
     g_draw_buffer = g_framebuffer;
     g_double_buffered = false;
+
+    if (g_back_buffer == NULL) {
+        size_t bytes = (size_t)g_pitch * g_height;
+        g_back_buffer = (uint32_t*)pmm_alloc_pages((bytes + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE);
+        if (g_back_buffer == NULL) {
+            syslog_write("Graphics: No memory for back buffer");
+        }
+    }
 }
 
 void graphics_enable_double_buffer(void) {
+    if (g_back_buffer == NULL) return;
     g_draw_buffer = g_back_buffer;
     g_double_buffered = true;
     syslog_write("Graphics: Double buffering enabled");
@@ -135,9 +149,14 @@ void graphics_swap_buffer(void) {
     // Actually, let's treat back buffer as having same stride as front for simplicity,
     // effectively a direct memory copy if continuous.
     
-    // Note: To be safe, we iterate pixels.
     size_t total_pixels = g_height * stride;
-    
+
+    if (use_simd()) {
+        uint64_t fpu = kernel_fpu_begin();
+        simd_copy32(dest, src, total_pixels);
+        kernel_fpu_end(fpu);
+        return;
+    }
     for (size_t i = 0; i < total_pixels; i++) {
         dest[i] = src[i];
     }
@@ -164,7 +183,16 @@ void graphics_fill_rect(int x, int y, int w, int h, uint32_t color) {
     if (end_y > (int)g_height) end_y = g_height;
     
     uint32_t stride = g_pitch / 4;
-    
+    if (end_x <= x) return;
+
+    if (use_simd()) {
+        uint64_t fpu = kernel_fpu_begin();
+        for (int j = y; j < end_y; j++) {
+            simd_fill32(&g_draw_buffer[j * stride + x], color, (size_t)(end_x - x));
+        }
+        kernel_fpu_end(fpu);
+        return;
+    }
     for (int j = y; j < end_y; j++) {
         uint32_t* row = &g_draw_buffer[j * stride];
         for (int i = x; i < end_x; i++) {
@@ -192,7 +220,17 @@ void graphics_fill_rect_alpha(int x, int y, int w, int h, uint32_t color, uint8_
     if (end_y > (int)g_height) end_y = g_height;
     
     uint32_t stride = g_pitch / 4;
-    
+    if (end_x <= x) return;
+
+    if (use_simd()) {
+        uint64_t fpu = kernel_fpu_begin();
+        for (int j = y; j < end_y; j++) {
+            simd_blend32(&g_draw_buffer[j * stride + x], color, alpha, (size_t)(end_x - x));
+        }
+        kernel_fpu_end(fpu);
+        return;
+    }
+
     // Pre-calculate source components
     uint32_t src_r = (color >> 16) & 0xFF;
     uint32_t src_g = (color >> 8) & 0xFF;
@@ -2,58 +2,119 @@
 #include "graphics.h"
 #include "keyboard.h"
 #include "mouse.h"
-#include "timer.h"
 #include "syslog.h"
 #include "kstring.h"
 #include "kstdio.h"
 #include "fs.h"
 #include "system.h"
 #include "heap.h"
+#include "pmm.h"
+#include "scheduler.h"
+#include "interrupts.h"
+#include "ipc.h"
+#include "syscall.h"
+#include "vdso.h"
 #include <stdbool.h>
 
 // --- SYSCALL WRAPPERS ---
 
-static void syscall_yield(void) {
-    __asm__ volatile("int $0x80" : : "D"((uint64_t)0) : "memory");
+// SYSCALL when the CPU has it (it clobbers rcx and r11), int 0x80 otherwise
+static uint64_t syscall3(uint64_t n, uint64_t a1, uint64_t a2, uint64_t a3) {
+    uint64_t ret;
+    register uint64_t r10 __asm__("r10") = a3;
+    if (syscall_fast_available()) {
+        __asm__ volatile("syscall" : "=a"(ret), "+r"(r10) : "D"(n), "S"(a1), "d"(a2) : "rcx", "r11", "memory");
+    } else {
+        __asm__ volatile("int $0x80" : "=a"(ret), "+r"(r10) : "D"(n), "S"(a1), "d"(a2) : "memory");
+    }
+    return ret;
 }
 
 static void syscall_exit(void) {
-    __asm__ volatile("int $0x80" : : "D"((uint64_t)1) : "memory");
+    syscall3(1, 0, 0, 0);
     while(1);
 }
 
-static void syscall_shutdown(void) {
-    __asm__ volatile("int $0x80" : : "D"((uint64_t)4) : "memory");
-}
+static void syscall_shutdown(void) { syscall3(4, 0, 0, 0); }
+
+static void* syscall_malloc(size_t size) { return (void*)syscall3(6, size, 0, 0); }
+
+static void syscall_free(void* ptr) { syscall3(7, (uint64_t)ptr, 0, 0); }
+
+static void syscall_sleep(uint64_t ticks) { syscall3(9, ticks, 0, 0); }
 
-static void syscall_get_mouse(MouseState* out) {
-    __asm__ volatile("int $0x80" : : "D"((uint64_t)5), "S"(out) : "memory");
+static size_t syscall_task_stats(struct task_info* buf, size_t max) {
+    return (size_t)syscall3(10, (uint64_t)buf, max, 0);
 }
 
-static void* syscall_malloc(size_t size) {
-    uint64_t ret;
-    __asm__ volatile("int $0x80" : "=a"(ret) : "D"((uint64_t)6), "S"(size) : "memory");
-    return (void*)ret;
+static void syscall_cpu_times(struct cpu_times* out) { syscall3(11, (uint64_t)out, 0, 0); }
+
+static size_t syscall_irq_stats(struct irq_info* buf, size_t max) {
+    return (size_t)syscall3(17, (uint64_t)buf, max, 0);
 }
 
-static void syscall_free(void* ptr) {
-    __asm__ volatile("int $0x80" : : "D"((uint64_t)7), "S"(ptr) : "memory");
+static int syscall_ipc_recv(int handle, struct ipc_msg* msg, uint64_t timeout) {
+    return (int)syscall3(13, (uint64_t)handle, (uint64_t)msg, timeout);
 }
 
-static void syscall_get_time(char* buf) {
-    __asm__ volatile("int $0x80" : : "D"((uint64_t)8), "S"(buf) : "memory");
+static void syscall_log(const char* msg) { syscall3(2, (uint64_t)msg, 0, 0); }
+
+static struct syscall_ring* syscall_ring_setup(void) { return (struct syscall_ring*)syscall3(15, 0, 0, 0); }
+
+static uint64_t syscall_ring_enter(uint64_t to_submit) { return syscall3(16, to_submit, 0, 0); }
+
+// --- SYSCALL RING ---
+// Calls queued here run with a single kernel entry in ring_run
+
+static struct syscall_ring* g_ring;
+
+static bool ring_queue(uint64_t op, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t user_data) {
+    uint32_t tail = g_ring->sq_tail;
+    if (tail - __atomic_load_n(&g_ring->sq_head, __ATOMIC_ACQUIRE) >= SYSCALL_RING_ENTRIES) return false;
+    struct syscall_sqe* sqe = &g_ring->sq[tail & (SYSCALL_RING_ENTRIES - 1)];
+    sqe->op = op;
+    sqe->args[0] = a1; sqe->args[1] = a2; sqe->args[2] = a3;
+    sqe->user_data = user_data;
+    __atomic_store_n(&g_ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
 }
 
-static void syscall_log(const char* msg) {
-    __asm__ volatile("int $0x80" : : "D"((uint64_t)2), "S"(msg) : "memory");
+// Submits everything queued; results[user_data] receives each call's result
+static void ring_run(int64_t* results, int max) {
+    syscall_ring_enter(g_ring->sq_tail - g_ring->sq_head);
+    uint32_t head = g_ring->cq_head;
+    uint32_t tail = __atomic_load_n(&g_ring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        struct syscall_cqe* cqe = &g_ring->cq[head & (SYSCALL_RING_ENTRIES - 1)];
+        if (cqe->user_data < (uint64_t)max) results[cqe->user_data] = cqe->result;
+    }
+    __atomic_store_n(&g_ring->cq_head, head, __ATOMIC_RELEASE);
 }
 
-// --- Global State & Config ---
-static volatile bool g_gui_running = false;
+// --- vDSO READERS ---
+// Time and mouse state come from the shared page, without a syscall
 
-bool gui_is_running(void) { return g_gui_running; }
-void gui_set_running(bool running) { g_gui_running = running; }
+static const struct vdso_data* g_vdso;
+
+static uint64_t gui_ticks(void) {
+    struct vdso_time t;
+    vdso_read_time(g_vdso, &t);
+    return t.ticks;
+}
 
+// "HH:MM" of the RTC wall clock
+static void gui_clock_string(char* buf) {
+    struct vdso_time t;
+    vdso_read_time(g_vdso, &t);
+    uint32_t h = (uint32_t)(t.unix_time / 3600 % 24);
+    uint32_t m = (uint32_t)(t.unix_time / 60 % 60);
+    buf[0] = '0' + (h / 10); buf[1] = '0' + (h % 10);
+    buf[2] = ':';
+    buf[3] = '0' + (m / 10); buf[4] = '0' + (m % 10);
+    buf[5] = 0;
+}
+
+// --- Global State & Config ---
 #define MAX_WINDOWS 16
 #define WIN_CAPTION_H 28
 #define TASKBAR_H 40
@@ -131,7 +192,16 @@ typedef struct { int selected_index; int scroll_offset; } FileManagerState;
 typedef struct { bool wallpaper_enabled; int theme_id; } SettingsState;
 typedef struct { char prompt[16]; char input[64]; int input_len; char history[6][64]; } TerminalState;
 typedef struct { char url[64]; int url_len; char status[32]; int scroll; } BrowserState;
-typedef struct { int selected_pid; } TaskMgrState;
+// Task Manager: CPU share per task over the last sample, in tenths of a percent
+#define TASKMGR_MAX 24
+typedef struct {
+    int selected_pid;
+    struct task_info tasks[TASKMGR_MAX];
+    int usage[TASKMGR_MAX];
+    int count;
+    uint64_t last_total_us;
+    int update_tick;
+} TaskMgrState;
 typedef struct { uint32_t* canvas_buffer; int width; int height; uint32_t current_color; int brush_size; } PaintState;
 typedef struct { char cmd[32]; int len; } RunState;
 
@@ -161,11 +231,17 @@ typedef struct {
 
 // System Monitor
 #define SYSMON_HIST 60
+#define SYSMON_IRQS 8
 typedef struct {
     int cpu_hist[SYSMON_HIST];
     int mem_hist[SYSMON_HIST];
     int head;
     int update_tick;
+    struct cpu_times last;
+    struct irq_info irqs[SYSMON_IRQS];
+    int irq_rate[SYSMON_IRQS];   // Per second since the previous sample
+    int irq_count;
+    uint64_t irq_sample_ns;
 } SysMonState;
 
 // About Window
@@ -225,6 +301,8 @@ static void draw_wallpaper(void);
 static void on_click(int x, int y);
 static void on_right_click(int x, int y);
 static void update_sysmon(Window* w);
+static void update_taskmgr(Window* w);
+static void sample_tasks(TaskMgrState* s);
 static void create_window(AppType type, const char* title, int w, int h);
 static Window* get_top_window(void);
 
@@ -634,6 +712,16 @@ static void create_window(AppType type, const char* title, int w, int h) {
             win->state.sysmon.mem_hist[i] = 0;
         }
         win->state.sysmon.head = 0;
+        win->state.sysmon.update_tick = 0;
+        win->state.sysmon.irq_count = 0;
+        win->state.sysmon.irq_sample_ns = 0;
+        syscall_cpu_times(&win->state.sysmon.last);
+    } else if (type == APP_TASKMGR) {
+        win->state.taskmgr.selected_pid = -1;
+        win->state.taskmgr.count = 0;
+        win->state.taskmgr.last_total_us = 0;
+        win->state.taskmgr.update_tick = 0;
+        sample_tasks(&win->state.taskmgr);
     } else if (type == APP_MINESWEEPER) {
         MineState* ms = &win->state.mine;
         ms->game_over = false; ms->victory = false; ms->flags_placed = 0;
@@ -785,7 +873,7 @@ static void handle_run_command(Window* w) {
     if (kstrcmp(cmd, "calc") == 0) create_window(APP_CALC, "Calculator", 220, 300);
     else if (kstrcmp(cmd, "term") == 0) create_window(APP_TERMINAL, "Terminal", 400, 300);
     else if (kstrcmp(cmd, "paint") == 0) create_window(APP_PAINT, "Paint", 500, 400);
-    else if (kstrcmp(cmd, "sys") == 0) create_window(APP_SYSMON, "System Monitor", 300, 200);
+    else if (kstrcmp(cmd, "sys") == 0) create_window(APP_SYSMON, "System Monitor", 300, 300);
     else if (kstrcmp(cmd, "mine") == 0) create_window(APP_MINESWEEPER, "Minesweeper", 220, 260);
     else if (kstrcmp(cmd, "browser") == 0) create_window(APP_BROWSER, "Browser", 500, 400);
     else if (kstrcmp(cmd, "ttt") == 0) create_window(APP_TICTACTOE, "Tic-Tac-Toe", 220, 240);
@@ -865,21 +953,12 @@ static void handle_taskmgr_click(Window* w, int x, int y) {
     int cx = w->x + 10;
     int cy = w->y + WIN_CAPTION_H + 10;
     int list_y = cy + 30;
-    for(int i=0; i<MAX_WINDOWS; i++) {
-        if (windows[i] && windows[i]->visible) {
-            if (rect_contains(cx, list_y, w->w - 20, 20, x, y)) {
-                w->state.taskmgr.selected_pid = i;
-            }
-            list_y += 20;
-        }
-    }
-    if (w->state.taskmgr.selected_pid != -1) {
-        if (rect_contains(cx + w->w - 80, cy, 60, 24, x, y)) {
-             if (windows[w->state.taskmgr.selected_pid] != w) {
-                 close_window(w->state.taskmgr.selected_pid);
-                 w->state.taskmgr.selected_pid = -1;
-             }
+    TaskMgrState* s = &w->state.taskmgr;
+    for (int i = 0; i < s->count; i++) {
+        if (rect_contains(cx, list_y - 2, w->w - 20, 16, x, y)) {
+            s->selected_pid = (int)s->tasks[i].id;
         }
+        list_y += 16;
     }
 }
 
@@ -955,18 +1034,92 @@ static void handle_browser_input(Window* w, char c) {
     }
 }
 
+// Interrupt rates from the kernel's per-vector counters
+static void sample_irqs(SysMonState* s) {
+    struct irq_info now[SYSMON_IRQS];
+    int count = (int)syscall_irq_stats(now, SYSMON_IRQS);
+    struct vdso_time t;
+    vdso_read_time(g_vdso, &t);
+    uint64_t elapsed = t.monotonic_ns - s->irq_sample_ns;
+
+    for (int i = 0; i < count; i++) {
+        uint64_t fired = 0;
+        for (int j = 0; j < s->irq_count; j++) {
+            if (s->irqs[j].vector == now[i].vector) {
+                fired = now[i].stats.count - s->irqs[j].stats.count;
+                break;
+            }
+        }
+        s->irq_rate[i] = (s->irq_sample_ns && elapsed) ? (int)((fired * 1000000000ull) / elapsed) : 0;
+    }
+    for (int i = 0; i < count; i++) s->irqs[i] = now[i];
+    s->irq_count = count;
+    s->irq_sample_ns = t.monotonic_ns;
+}
+
+// Busy share of all CPUs since the last sample, from the scheduler's accounting
 static void update_sysmon(Window* w) {
     SysMonState* s = &w->state.sysmon;
     s->update_tick++;
     if (s->update_tick % 5 == 0) {
+        struct cpu_times now;
+        syscall_cpu_times(&now);
+        uint64_t busy = now.busy_us - s->last.busy_us;
+        uint64_t total = busy + (now.idle_us - s->last.idle_us);
+        s->last = now;
+
+        size_t pages = pmm_total_pages();
         s->head = (s->head + 1) % SYSMON_HIST;
-        int cpu = (fast_rand() % 40) + (fast_rand() % 40);
-        int mem = 20 + (fast_rand() % 10);
-        s->cpu_hist[s->head] = cpu;
-        s->mem_hist[s->head] = mem;
+        s->cpu_hist[s->head] = total ? (int)((busy * 100) / total) : 0;
+        s->mem_hist[s->head] = pages ? (int)(((pages - pmm_free_page_count()) * 100) / pages) : 0;
+        sample_irqs(s);
+    }
+}
+
+// Refreshes the task list and each task's share of CPU time since last time
+static void sample_tasks(TaskMgrState* s) {
+    uint64_t prev_id[TASKMGR_MAX];
+    uint64_t prev_runtime[TASKMGR_MAX];
+    int prev_count = s->count;
+    for (int i = 0; i < prev_count; i++) {
+        prev_id[i] = s->tasks[i].id;
+        prev_runtime[i] = s->tasks[i].runtime_us;
+    }
+
+    // Both snapshots in one kernel entry when the ring is available
+    struct cpu_times now;
+    if (g_ring) {
+        int64_t results[2] = {0, 0};
+        ring_queue(11, (uint64_t)&now, 0, 0, 0);
+        ring_queue(10, (uint64_t)s->tasks, TASKMGR_MAX, 0, 1);
+        ring_run(results, 2);
+        s->count = (int)results[1];
+    } else {
+        syscall_cpu_times(&now);
+        s->count = (int)syscall_task_stats(s->tasks, TASKMGR_MAX);
+    }
+    uint64_t total = now.busy_us + now.idle_us;
+    uint64_t elapsed = total - s->last_total_us;
+    s->last_total_us = total;
+
+    for (int i = 0; i < s->count; i++) {
+        uint64_t ran = 0;
+        for (int j = 0; j < prev_count; j++) {
+            if (prev_id[j] == s->tasks[i].id) {
+                ran = s->tasks[i].runtime_us - prev_runtime[j];
+                break;
+            }
+        }
+        s->usage[i] = (prev_count && elapsed) ? (int)((ran * 1000) / elapsed) : 0;
     }
 }
 
+static void update_taskmgr(Window* w) {
+    TaskMgrState* s = &w->state.taskmgr;
+    s->update_tick++;
+    if (s->update_tick % 30 == 0) sample_tasks(s);
+}
+
 // --- Context Menu Functions ---
 static void show_context_menu(int x, int y) {
     g_ctx_menu.active = true;
@@ -1019,7 +1172,7 @@ static void handle_context_menu_click(int x, int y) {
                     create_window(APP_NOTEPAD, "Untitled.txt", 300, 200);
                     break;
                 case CTX_SYS_INFO:
-                    create_window(APP_SYSMON, "System Monitor", 300, 200);
+                    create_window(APP_SYSMON, "System Monitor", 300, 300);
                     break;
                 case CTX_ABOUT:
                     create_window(APP_ABOUT, "About Nostalux", 320, 240);
@@ -1122,7 +1275,7 @@ static void draw_wallpaper(void) {
         graphics_fill_rect(cx, cy, cw, ch, ccol);
     }
     
-    rand_state = (timer_get_ticks() / 10) + 100;
+    rand_state = (gui_ticks() / 10) + 100;
     for (int i = 0; i < 15; i++) {
         int bx = fast_rand() % screen_w;
         int by = fast_rand() % (screen_h - 100);
@@ -1213,7 +1366,7 @@ static void render_window(Window* w) {
         draw_bevel_box(cx+2, cy+2, cw-4, ch-4, true);
         graphics_fill_rect(cx+4, cy+4, cw-8, ch-8, COL_WHITE);
         graphics_draw_string_scaled(cx+6, cy+6, w->state.notepad.buffer, COL_BLACK, COL_WHITE, 1);
-        if ((timer_get_ticks() / 15) % 2) {
+        if ((gui_ticks() / 15) % 2) {
              graphics_fill_rect(cx+6+(w->state.notepad.length*8), cy+6, 2, 10, COL_BLACK);
         }
     } 
@@ -1297,25 +1450,29 @@ static void render_window(Window* w) {
         graphics_draw_string_scaled(cx+10, content_y+70, "Welcome to the future of browsing!", COL_BLACK, COL_WHITE, 1);
     }
     else if (w->type == APP_TASKMGR) {
-        graphics_draw_string_scaled(cx+10, cy+10, "PID  Name        Status", COL_BLACK, COL_WIN_BODY, 1);
+        TaskMgrState* s = &w->state.taskmgr;
+        graphics_draw_string_scaled(cx+10, cy+10, "PID  Name        Status    CPU    Switches", COL_BLACK, COL_WIN_BODY, 1);
         graphics_fill_rect(cx+10, cy+22, cw-20, 1, 0xFF888888);
         int list_y = cy + 30;
-        for(int i=0; i<MAX_WINDOWS; i++) {
-            if (windows[i] && windows[i]->visible) {
-                if (w->state.taskmgr.selected_pid == i) {
-                    graphics_fill_rect(cx+8, list_y-2, cw-16, 14, 0xFFCCCCFF);
-                }
-                // Fixed: Removed unused 'buf'
-                char pid_s[4]; int_to_str(i, pid_s);
-                graphics_draw_string_scaled(cx+10, list_y, pid_s, COL_BLACK, COL_WIN_BODY, 1);
-                graphics_draw_string_scaled(cx+50, list_y, windows[i]->title, COL_BLACK, COL_WIN_BODY, 1);
-                const char* st = windows[i]->minimized ? "Min" : "Vis";
-                graphics_draw_string_scaled(cx+200, list_y, st, COL_BLACK, COL_WIN_BODY, 1);
-                list_y += 20;
+        for (int i = 0; i < s->count && list_y + 14 < cy + ch; i++) {
+            const struct task_info* t = &s->tasks[i];
+            if (s->selected_pid == (int)t->id) {
+                graphics_fill_rect(cx+8, list_y-2, cw-16, 14, 0xFFCCCCFF);
             }
+            char num[16]; int_to_str((int)t->id, num);
+            graphics_draw_string_scaled(cx+10, list_y, num, COL_BLACK, COL_WIN_BODY, 1);
+            graphics_draw_string_scaled(cx+50, list_y, t->name[0] ? t->name : "-", COL_BLACK, COL_WIN_BODY, 1);
+            const char* st = t->state == TASK_READY ? "Running" : t->state == TASK_DEAD ? "Exited" : "Waiting";
+            graphics_draw_string_scaled(cx+146, list_y, st, COL_BLACK, COL_WIN_BODY, 1);
+
+            char pct[16]; int_to_str(s->usage[i] / 10, pct);
+            int l = kstrlen_local(pct);
+            pct[l++] = '.'; pct[l++] = (char)('0' + s->usage[i] % 10); pct[l++] = '%'; pct[l] = 0;
+            graphics_draw_string_scaled(cx+226, list_y, pct, COL_BLACK, COL_WIN_BODY, 1);
+            int_to_str((int)t->switches, num);
+            graphics_draw_string_scaled(cx+282, list_y, num, COL_BLACK, COL_WIN_BODY, 1);
+            list_y += 16;
         }
-        draw_bevel_box(cx + cw - 80, cy + 10, 60, 24, false);
-        graphics_draw_string_scaled(cx+cw-70, cy+16, "End Task", COL_BLACK, COL_BTN_FACE, 1);
     }
     else if (w->type == APP_SYSMON) {
         graphics_draw_string_scaled(cx+10, cy+10, "CPU Usage History", COL_BLACK, COL_WIN_BODY, 1);
@@ -1348,6 +1505,31 @@ static void render_window(Window* w) {
         mem_str[l++] = '%'; mem_str[l] = 0;
         
         graphics_draw_string_scaled(cx+10, cy+100, mem_str, COL_BLACK, COL_WIN_BODY, 1);
+
+        // Interrupts: rate and worst handler time, as many as fit
+        const SysMonState* sm = &w->state.sysmon;
+        int iy = cy + 120;
+        if (iy + 14 <= cy + ch) {
+            graphics_draw_string_scaled(cx+10, iy, "IRQ", COL_BLACK, COL_WIN_BODY, 1);
+            graphics_draw_string_scaled(cx+130, iy, "/s", COL_BLACK, COL_WIN_BODY, 1);
+            graphics_draw_string_scaled(cx+190, iy, "Max cyc", COL_BLACK, COL_WIN_BODY, 1);
+            iy += 14;
+        }
+        for (int i = 0; i < sm->irq_count && iy + 14 <= cy + ch; i++, iy += 14) {
+            const char* name = interrupts_vector_name((uint8_t)sm->irqs[i].vector);
+            char num[16];
+            if (name) {
+                graphics_draw_string_scaled(cx+10, iy, name, COL_BLACK, COL_WIN_BODY, 1);
+            } else {
+                int_to_str((int)sm->irqs[i].vector, num);
+                graphics_draw_string_scaled(cx+10, iy, num, COL_BLACK, COL_WIN_BODY, 1);
+            }
+            int_to_str(sm->irq_rate[i], num);
+            graphics_draw_string_scaled(cx+130, iy, num, COL_BLACK, COL_WIN_BODY, 1);
+            uint64_t max = sm->irqs[i].stats.max_cycles;
+            int_to_str(max > 0x7FFFFFFF ? 0x7FFFFFFF : (int)max, num);
+            graphics_draw_string_scaled(cx+190, iy, num, COL_BLACK, COL_WIN_BODY, 1);
+        }
     }
     else if (w->type == APP_SETTINGS) {
         graphics_draw_string_scaled(cx+10, cy+10, "Desktop Wallpaper:", COL_BLACK, COL_WIN_BODY, 1);
@@ -1366,7 +1548,7 @@ static void render_window(Window* w) {
         graphics_draw_string_scaled(cx+6, input_y, w->state.term.prompt, 0xFF00FF00, COL_BLACK, 1);
         int pw = kstrlen_local(w->state.term.prompt)*8;
         graphics_draw_string_scaled(cx+6+pw, input_y, w->state.term.input, COL_WHITE, COL_BLACK, 1);
-        if ((timer_get_ticks()/15)%2) graphics_fill_rect(cx+6+pw+(w->state.term.input_len*8), input_y, 8, 8, 0xFF00FF00);
+        if ((gui_ticks()/15)%2) graphics_fill_rect(cx+6+pw+(w->state.term.input_len*8), input_y, 8, 8, 0xFF00FF00);
     }
     else if (w->type == APP_CALC) {
         char buf[16]; int_to_str(w->state.calc.current_val, buf);
@@ -1444,7 +1626,7 @@ static void render_taskbar(void) {
     int sd_x = screen_w - 20;
     graphics_fill_rect(sd_x, ty+2, 18, TASKBAR_H-4, 0xFF444444);
     
-    char time[16]; syscall_get_time(time);
+    char time[16]; gui_clock_string(time);
     graphics_draw_string_scaled(screen_w-90, ty+12, time, COL_WHITE, t->taskbar, 1);
 }
 
@@ -1485,8 +1667,6 @@ static void render_desktop(void) {
     // Draw Context Menu on top of everything
     render_context_menu();
 
-    char time_buf[8]; syscall_get_time(time_buf);
-    
     char mouse_pos[16];
     int_to_str(mouse.x, mouse_pos);
     int len = kstrlen_local(mouse_pos);
@@ -1648,7 +1828,8 @@ static void on_click(int x, int y) {
 
 void gui_demo_run(void) {
     syscall_log("GUI: Starting Glass Desktop...");
-    g_gui_running = true;
+    g_vdso = vdso_page();
+    g_ring = syscall_ring_setup();
     graphics_enable_double_buffer();
     screen_w = graphics_get_width(); screen_h = graphics_get_height();
     mouse.x = screen_w / 2; mouse.y = screen_h / 2;
@@ -1658,7 +1839,13 @@ void gui_demo_run(void) {
     g_ctx_menu.active = false;
 
     while(1) {
-        syscall_yield();
+        // Sleep until input arrives, or for one tick so animations keep going.
+        // A burst of notifications is drained and handled as one frame.
+        struct ipc_msg ev;
+        int got = syscall_ipc_recv(GUI_EVENT_HANDLE, &ev, 1);
+        while (got == IPC_OK) got = syscall_ipc_recv(GUI_EVENT_HANDLE, &ev, 0);
+        // Launched without an event channel: pace frames by sleeping instead
+        if (got == IPC_ERR_BADF || got == IPC_ERR_CLOSED) syscall_sleep(1);
         char c = keyboard_poll_char();
         if (c == 27) break; 
         Window* top = get_top_window();
@@ -1679,7 +1866,7 @@ void gui_demo_run(void) {
         }
 
         prev_mouse = mouse; 
-        syscall_get_mouse(&mouse);
+        vdso_read_mouse(g_vdso, &mouse);
         
         if (mouse.left_button && top && !g_ctx_menu.active) {
             if (top->dragging) {
@@ -1719,13 +1906,16 @@ void gui_demo_run(void) {
             if(windows[i] && windows[i]->type == APP_SYSMON) {
                  update_sysmon(windows[i]);
             }
+            if(windows[i] && windows[i]->type == APP_TASKMGR) {
+                 update_taskmgr(windows[i]);
+            }
         }
 
         render_desktop();
         graphics_swap_buffer();
     }
     
-    for(int i=0; i<MAX_WINDOWS; i++) close_window(i);
-    g_gui_running = false;
+    // Windows and canvases live in this task's arena; exiting frees them all
+    for(int i=0; i<MAX_WINDOWS; i++) windows[i] = NULL;
     syscall_exit();
 }
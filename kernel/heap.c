@@ -1,111 +1,620 @@
 #include "heap.h"
+#include "paging.h"
+#include "pmm.h"
+#include "slab.h"
+#include "spinlock.h"
 #include "syslog.h"
 #include <stdbool.h>
 
-// Header for each block
-// We use padding to ensure the structure size is a multiple of 16.
-// This guarantees that if the block starts at 16-aligned address, 
-// the data payload following it is also 16-aligned.
+/*
+ * Boundary-tag heap with a two-level segregated free index.
+ *
+ * Every block starts with a 16-byte header, so payloads stay 16-byte aligned.
+ * A free block additionally stores its free-list links at the start of its
+ * payload and a footer (its size) in the last 8 bytes, which lets kfree find
+ * the previous physical block in O(1) when the PREV_FREE bit is set.
+ *
+ * Free blocks are binned by size: the first level is the power of two, the
+ * second splits every power of two into 8 linear ranges. Two bitmaps record
+ * which bins are non-empty, so finding a fitting block is a couple of
+ * bit scans instead of a walk over the heap.
+ *
+ * The heap owns a reserved virtual range but only maps what it uses: when
+ * no bin fits, frames are mapped past the end sentinel and the new space is
+ * merged into the tail block; a free tail larger than two grow steps is
+ * unmapped again and its frames go back to the PMM.
+ *
+ * One irq-safe lock covers the index, the slab caches and the statistics.
+ */
+
 struct heap_block {
-    size_t size;        // 8 bytes
-    bool is_free;       // 1 byte
-    struct heap_block* next; // 8 bytes
-    // Pad to 32 bytes total size (16-byte aligned)
-    // 8 + 1 + 8 = 17 used. Need 15 bytes padding.
-    uint8_t padding[15];
+    size_t size;        // Payload bytes, low bits carry HEAP_FLAG_*
+    uint32_t magic;     // HEAP_MAGIC while the block is live in this heap
+    uint32_t tag;       // enum heap_tag of the owner while in use
 } __attribute__((aligned(16)));
 
-static struct heap_block* g_head = NULL;
-static size_t g_heap_total_size = 0;
+struct heap_free_links {
+    struct heap_block* next;
+    struct heap_block* prev;
+};
+
+_Static_assert(sizeof(struct heap_block) == 16, "Heap header must keep payloads 16-byte aligned");
+
+#define HEAP_MAGIC          0x4B484550u // "PEHK"
+#define HEAP_FLAG_FREE      0x1ull
+#define HEAP_FLAG_PREV_FREE 0x2ull
+#define HEAP_FLAG_MASK      0xFull
+
+#define HEAP_HDR            sizeof(struct heap_block)
+#define HEAP_ALIGN          16
+// A free block must hold its links plus a footer
+#define HEAP_MIN_PAYLOAD    32
+
+// Segregated index geometry
+#define SL_LOG2             3
+#define SL_COUNT            (1 << SL_LOG2)
+#define SMALL_LOG2          8                  // Sizes below 256 share the first row
+#define SMALL_LIMIT         (1ull << SMALL_LOG2)
+#define FL_COUNT            32
+
+// The start of the reserved range belongs to the slab layer (at most 1/8th).
+#define HEAP_SLAB_RESERVE   (64 * 1024 * 1024)
+#define HEAP_SLAB_DIVISOR   8
+
+#define HEAP_PAGE_SIZE      PAGING_PAGE_SIZE
+#define HEAP_INITIAL_SIZE   (4 * 1024 * 1024)  // Mapped at init, never trimmed
+#define HEAP_GROW_STEP      (2 * 1024 * 1024)  // Minimum growth, also the trim slack
+
+static struct heap_block* g_free_bins[FL_COUNT][SL_COUNT];
+static uint32_t g_fl_bitmap = 0;
+static uint8_t g_sl_bitmap[FL_COUNT];
+
+static uint8_t* g_heap_start = NULL;
+static uint8_t* g_heap_end = NULL;        // Address of the end sentinel header
+static uint8_t* g_heap_mapped_end = NULL; // First unmapped byte, page aligned
+static uint8_t* g_heap_min_end = NULL;    // Trimming never goes below this
+static uint8_t* g_heap_limit = NULL;      // End of the reserved range
+static size_t g_heap_reserved_size = 0;
+static size_t g_free_bytes = 0;
+static spinlock_t g_heap_lock = SPINLOCK_INIT("heap");
+
+// Instrumentation
+static struct heap_stats g_stats;
+static struct heap_tag_stats g_tag_stats[HEAP_TAG_COUNT];
+static const char* const HEAP_TAG_NAMES[HEAP_TAG_COUNT] = {
+    [HEAP_TAG_MISC] = "misc",
+    [HEAP_TAG_TASK] = "task",
+    [HEAP_TAG_USER] = "user",
+    [HEAP_TAG_IPC] = "ipc",
+};
+
+// --- Tracing ---
+
+#ifdef HEAP_TRACE
+// One "heap a <ptr> <size>" or "heap f <ptr>" line per call on the debug
+// console, replayable with tools/heapbench.
+static char* trace_hex(char* out, uint64_t value) {
+    *out++ = '0';
+    *out++ = 'x';
+    for (int shift = 60; shift >= 0; shift -= 4) {
+        *out++ = "0123456789abcdef"[(value >> shift) & 0xF];
+    }
+    return out;
+}
+
+static char* trace_dec(char* out, uint64_t value) {
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    while (count) *out++ = digits[--count];
+    return out;
+}
+
+static void trace_event(char op, const void* ptr, size_t size) {
+    char line[48] = "heap ";
+    char* out = line + 5;
+    *out++ = op;
+    *out++ = ' ';
+    out = trace_hex(out, (uint64_t)(uintptr_t)ptr);
+    if (op == 'a') {
+        *out++ = ' ';
+        out = trace_dec(out, size);
+    }
+    *out = '\0';
+    syslog_trace(line);
+}
+#else
+#define trace_event(op, ptr, size) ((void)0)
+#endif
+
+// --- Block helpers ---
+
+static inline size_t block_size(const struct heap_block* b) {
+    return b->size & ~HEAP_FLAG_MASK;
+}
+
+static inline bool block_is_free(const struct heap_block* b) {
+    return (b->size & HEAP_FLAG_FREE) != 0;
+}
+
+static inline bool block_prev_free(const struct heap_block* b) {
+    return (b->size & HEAP_FLAG_PREV_FREE) != 0;
+}
+
+static inline void block_set_size(struct heap_block* b, size_t size) {
+    b->size = size | (b->size & HEAP_FLAG_MASK);
+}
+
+static inline void* block_payload(struct heap_block* b) {
+    return (uint8_t*)b + HEAP_HDR;
+}
+
+static inline struct heap_block* block_from_payload(void* ptr) {
+    return (struct heap_block*)((uint8_t*)ptr - HEAP_HDR);
+}
+
+static inline struct heap_block* block_next(struct heap_block* b) {
+    return (struct heap_block*)((uint8_t*)b + HEAP_HDR + block_size(b));
+}
+
+static inline struct heap_free_links* block_links(struct heap_block* b) {
+    return (struct heap_free_links*)block_payload(b);
+}
+
+static inline void block_write_footer(struct heap_block* b) {
+    *(size_t*)((uint8_t*)block_next(b) - sizeof(size_t)) = block_size(b);
+}
+
+static inline struct heap_block* block_prev(struct heap_block* b) {
+    size_t prev_size = *(size_t*)((uint8_t*)b - sizeof(size_t));
+    return (struct heap_block*)((uint8_t*)b - prev_size - HEAP_HDR);
+}
+
+// Marks b free and propagates the state to the next block's PREV_FREE bit
+static inline void block_mark_free(struct heap_block* b) {
+    b->size |= HEAP_FLAG_FREE;
+    block_write_footer(b);
+    block_next(b)->size |= HEAP_FLAG_PREV_FREE;
+}
+
+static inline void block_mark_used(struct heap_block* b) {
+    b->size &= ~HEAP_FLAG_FREE;
+    block_next(b)->size &= ~HEAP_FLAG_PREV_FREE;
+}
+
+// --- Segregated index ---
+
+static inline int bit_scan_forward(uint32_t v) { return __builtin_ctz(v); }
+static inline int bit_scan_reverse(uint64_t v) { return 63 - __builtin_clzll(v); }
+
+static void mapping_insert(size_t size, int* fl, int* sl) {
+    if (size < SMALL_LIMIT) {
+        *fl = 0;
+        *sl = (int)(size / (SMALL_LIMIT / SL_COUNT));
+    } else {
+        int msb = bit_scan_reverse(size);
+        *fl = msb - SMALL_LOG2 + 1;
+        *sl = (int)((size >> (msb - SL_LOG2)) & (SL_COUNT - 1));
+        if (*fl >= FL_COUNT) {
+            *fl = FL_COUNT - 1;
+            *sl = SL_COUNT - 1;
+        }
+    }
+}
+
+// Rounds size up to the next bin boundary so any block found there fits.
+static void mapping_search(size_t size, int* fl, int* sl) {
+    if (size < SMALL_LIMIT) {
+        size += (SMALL_LIMIT / SL_COUNT) - 1;
+    } else {
+        size += (1ull << (bit_scan_reverse(size) - SL_LOG2)) - 1;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+static void index_insert(struct heap_block* b) {
+    int fl, sl;
+    mapping_insert(block_size(b), &fl, &sl);
+    struct heap_free_links* links = block_links(b);
+    links->prev = NULL;
+    links->next = g_free_bins[fl][sl];
+    if (links->next) block_links(links->next)->prev = b;
+    g_free_bins[fl][sl] = b;
+    g_fl_bitmap |= 1u << fl;
+    g_sl_bitmap[fl] |= (uint8_t)(1u << sl);
+    g_free_bytes += block_size(b);
+}
+
+static void index_remove(struct heap_block* b) {
+    int fl, sl;
+    mapping_insert(block_size(b), &fl, &sl);
+    struct heap_free_links* links = block_links(b);
+    if (links->prev) block_links(links->prev)->next = links->next;
+    else g_free_bins[fl][sl] = links->next;
+    if (links->next) block_links(links->next)->prev = links->prev;
+    if (g_free_bins[fl][sl] == NULL) {
+        g_sl_bitmap[fl] &= (uint8_t)~(1u << sl);
+        if (g_sl_bitmap[fl] == 0) g_fl_bitmap &= ~(1u << fl);
+    }
+    g_free_bytes -= block_size(b);
+}
+
+static struct heap_block* index_find(size_t size) {
+    int fl, sl;
+    mapping_search(size, &fl, &sl);
+    if (fl >= FL_COUNT) return NULL;
+
+    uint32_t sl_map = g_sl_bitmap[fl] & (~0u << sl);
+    if (sl_map == 0) {
+        uint32_t fl_map = (fl + 1 < FL_COUNT) ? (g_fl_bitmap & (~0u << (fl + 1))) : 0;
+        if (fl_map == 0) return NULL;
+        fl = bit_scan_forward(fl_map);
+        sl_map = g_sl_bitmap[fl];
+    }
+    sl = bit_scan_forward(sl_map);
+    return g_free_bins[fl][sl];
+}
+
+// Splits off the tail of a used block when it is big enough to stand alone.
+static void block_trim(struct heap_block* b, size_t size) {
+    size_t total = block_size(b);
+    if (total < size + HEAP_HDR + HEAP_MIN_PAYLOAD) return;
+
+    block_set_size(b, size);
+    struct heap_block* rest = block_next(b);
+    rest->size = total - size - HEAP_HDR;
+    rest->magic = HEAP_MAGIC;
+    rest->tag = HEAP_TAG_MISC;
+    block_mark_free(rest);
+    index_insert(rest);
+}
+
+// Moves the payload of a free, unindexed block up to the next 'align'
+// boundary. The skipped prefix becomes a free block of its own and is
+// indexed again, so over-aligned requests do not leak the gap.
+static struct heap_block* block_align(struct heap_block* b, size_t align) {
+    uintptr_t payload = (uintptr_t)block_payload(b);
+    if ((payload & (align - 1)) == 0) return b;
+
+    // The prefix needs room for a header and a minimal free payload
+    uintptr_t target = (payload + HEAP_HDR + HEAP_MIN_PAYLOAD + align - 1) & ~(uintptr_t)(align - 1);
+    size_t gap = target - payload;
+    size_t total = block_size(b);
+
+    struct heap_block* aligned = block_from_payload((void*)target);
+    aligned->size = total - gap;
+    aligned->magic = HEAP_MAGIC;
+    aligned->tag = HEAP_TAG_MISC;
+
+    block_set_size(b, gap - HEAP_HDR);
+    block_mark_free(b);
+    index_insert(b);
+    return aligned;
+}
+
+// Merges a free (not yet indexed) block with its free neighbours.
+static struct heap_block* block_coalesce(struct heap_block* b) {
+    struct heap_block* next = block_next(b);
+    if (block_is_free(next)) {
+        index_remove(next);
+        block_set_size(b, block_size(b) + HEAP_HDR + block_size(next));
+        next->magic = 0;
+    }
+    if (block_prev_free(b)) {
+        struct heap_block* prev = block_prev(b);
+        index_remove(prev);
+        block_set_size(prev, block_size(prev) + HEAP_HDR + block_size(b));
+        b->magic = 0;
+        b = prev;
+    }
+    return b;
+}
+
+// --- Growing and trimming ---
+
+static inline uintptr_t page_align_up(uintptr_t value) {
+    return (value + HEAP_PAGE_SIZE - 1) & ~(uintptr_t)(HEAP_PAGE_SIZE - 1);
+}
+
+// Places a zero-sized, permanently used sentinel header at 'end'.
+static void write_sentinel(uint8_t* end) {
+    struct heap_block* sentinel = (struct heap_block*)end;
+    sentinel->size = 0;
+    sentinel->magic = HEAP_MAGIC;
+    sentinel->tag = HEAP_TAG_MISC;
+    g_heap_end = end;
+}
+
+// Maps enough new pages for a payload of 'size' bytes. The old sentinel
+// becomes the header of the new free block, which merges with a free tail.
+// Returns that (indexed) block, which may sit in a bin below the one a
+// search for 'size' would start at.
+static struct heap_block* heap_grow(size_t size) {
+    size_t bytes = page_align_up(size + HEAP_HDR);
+    if (bytes < HEAP_GROW_STEP) bytes = HEAP_GROW_STEP;
+    size_t room = (size_t)(g_heap_limit - g_heap_mapped_end);
+    if (bytes > room) {
+        if (page_align_up(size + HEAP_HDR) > room) return NULL;
+        bytes = room;
+    }
+    if (!paging_commit((uint64_t)(uintptr_t)g_heap_mapped_end, bytes / HEAP_PAGE_SIZE)) return NULL;
+
+    struct heap_block* block = (struct heap_block*)g_heap_end; // Keeps PREV_FREE
+    g_heap_mapped_end += bytes;
+    write_sentinel(g_heap_mapped_end - HEAP_HDR);
+
+    block_set_size(block, bytes - HEAP_HDR);
+    block->magic = HEAP_MAGIC;
+    block->tag = HEAP_TAG_MISC;
+    block->size |= HEAP_FLAG_FREE;
+    block = block_coalesce(block);
+    block_mark_free(block);
+    index_insert(block);
+    g_stats.grow_count++;
+    return block;
+}
+
+// Shrinks a free (not yet indexed) tail block, keeping one grow step of slack.
+static void heap_trim(struct heap_block* tail) {
+    uintptr_t keep = page_align_up((uintptr_t)block_payload(tail) + HEAP_MIN_PAYLOAD + HEAP_HDR) + HEAP_GROW_STEP;
+    if (keep < (uintptr_t)g_heap_min_end) keep = (uintptr_t)g_heap_min_end;
+    if (keep >= (uintptr_t)g_heap_mapped_end || (uintptr_t)g_heap_mapped_end - keep < HEAP_GROW_STEP) return;
+
+    paging_decommit(keep, ((uintptr_t)g_heap_mapped_end - keep) / HEAP_PAGE_SIZE);
+    g_heap_mapped_end = (uint8_t*)keep;
+    write_sentinel(g_heap_mapped_end - HEAP_HDR);
+    block_set_size(tail, (size_t)(g_heap_end - (uint8_t*)block_payload(tail)));
+    g_stats.trim_count++;
+}
+
+// --- Accounting ---
+
+static void account_alloc(size_t requested, size_t granted, enum heap_tag tag) {
+    size_t bucket = 0;
+    while (bucket < HEAP_HIST_BUCKETS - 1 && requested > ((size_t)16 << bucket)) bucket++;
+    g_stats.histogram[bucket]++;
+    g_stats.alloc_count++;
+    g_stats.in_use_bytes += granted;
+    if (g_stats.in_use_bytes > g_stats.peak_bytes) g_stats.peak_bytes = g_stats.in_use_bytes;
+
+    g_tag_stats[tag].bytes += granted;
+    g_tag_stats[tag].blocks++;
+    g_tag_stats[tag].allocs++;
+}
+
+static void account_free(size_t granted, enum heap_tag tag) {
+    if ((unsigned)tag >= HEAP_TAG_COUNT) tag = HEAP_TAG_MISC;
+    g_stats.free_count++;
+    g_stats.in_use_bytes -= granted;
+    g_tag_stats[tag].bytes -= granted;
+    g_tag_stats[tag].blocks--;
+}
+
+// Largest block lives in the highest non-empty bin; only that bin is scanned.
+static size_t largest_free_block(void) {
+    if (g_fl_bitmap == 0) return 0;
+    int fl = bit_scan_reverse(g_fl_bitmap);
+    int sl = bit_scan_reverse(g_sl_bitmap[fl]);
+    size_t largest = 0;
+    for (struct heap_block* b = g_free_bins[fl][sl]; b; b = block_links(b)->next) {
+        if (block_size(b) > largest) largest = block_size(b);
+    }
+    return largest;
+}
 
 void heap_init(void* start_addr, size_t size_bytes) {
-    // 1. Align the start address to 16 bytes
-    uintptr_t addr = (uintptr_t)start_addr;
-    size_t misalignment = addr % 16;
-    if (misalignment != 0) {
-        size_t adjustment = 16 - misalignment;
-        if (size_bytes <= adjustment) return; // Too small
-        start_addr = (void*)(addr + adjustment);
-        size_bytes -= adjustment;
+    if (start_addr == NULL) {
+        syslog_write("Heap: No address range to initialize");
+        return;
     }
+    spin_lock_register(&g_heap_lock);
 
-    if (size_bytes < sizeof(struct heap_block)) {
+    // 1. Page-align the reserved range; nothing in it is mapped yet
+    uintptr_t base = page_align_up((uintptr_t)start_addr);
+    uintptr_t limit = ((uintptr_t)start_addr + size_bytes) & ~(uintptr_t)(HEAP_PAGE_SIZE - 1);
+    if (limit <= base || limit - base < 2 * HEAP_INITIAL_SIZE) {
         syslog_write("Heap: Too small to initialize");
         return;
     }
+    g_heap_reserved_size = limit - base;
+
+    // 2. The slab arena takes the start of the range
+    size_t slab_bytes = g_heap_reserved_size / HEAP_SLAB_DIVISOR;
+    if (slab_bytes > HEAP_SLAB_RESERVE) slab_bytes = HEAP_SLAB_RESERVE;
+    slab_bytes &= ~(size_t)(HEAP_PAGE_SIZE - 1);
+    slab_init((void*)base, slab_bytes);
+    base += slab_bytes;
+
+    for (int fl = 0; fl < FL_COUNT; fl++) {
+        g_sl_bitmap[fl] = 0;
+        for (int sl = 0; sl < SL_COUNT; sl++) g_free_bins[fl][sl] = NULL;
+    }
+    g_fl_bitmap = 0;
+    g_free_bytes = 0;
+    g_stats = (struct heap_stats){0};
+    for (int t = 0; t < HEAP_TAG_COUNT; t++) g_tag_stats[t] = (struct heap_tag_stats){0};
+
+    // 3. Map the initial chunk
+    if (!paging_commit(base, HEAP_INITIAL_SIZE / HEAP_PAGE_SIZE)) {
+        syslog_write("Heap: No memory to initialize");
+        return;
+    }
+    g_heap_start = (uint8_t*)base;
+    g_heap_mapped_end = g_heap_start + HEAP_INITIAL_SIZE;
+    g_heap_min_end = g_heap_mapped_end;
+    g_heap_limit = (uint8_t*)limit;
+
+    // 4. One big free block followed by a zero-sized, permanently used sentinel
+    write_sentinel(g_heap_mapped_end - HEAP_HDR);
+
+    struct heap_block* first = (struct heap_block*)g_heap_start;
+    first->size = HEAP_INITIAL_SIZE - 2 * HEAP_HDR;
+    first->magic = HEAP_MAGIC;
+    first->tag = HEAP_TAG_MISC;
+    block_mark_free(first);
+    index_insert(first);
 
-    g_head = (struct heap_block*)start_addr;
-    g_head->size = size_bytes - sizeof(struct heap_block);
-    g_head->is_free = true;
-    g_head->next = NULL;
-    g_heap_total_size = size_bytes;
-    
-    syslog_write("Heap: Initialized (16-byte aligned)");
+    syslog_write("Heap: Initialized (boundary tags, segregated fit, on-demand mapping)");
 }
 
 void* kmalloc(size_t size) {
-    if (size == 0 || g_head == NULL) return NULL;
+    return kmalloc_tagged(size, HEAP_TAG_MISC);
+}
 
-    // Align requested size to 16 bytes
-    size_t aligned_size = (size + 15) & ~15;
-    
-    struct heap_block* curr = g_head;
-    while (curr) {
-        if (curr->is_free && curr->size >= aligned_size) {
-            // Found a fit. Check if we can split
-            if (curr->size >= aligned_size + sizeof(struct heap_block) + 16) {
-                struct heap_block* new_block = (struct heap_block*)((uint8_t*)curr + sizeof(struct heap_block) + aligned_size);
-                
-                new_block->size = curr->size - aligned_size - sizeof(struct heap_block);
-                new_block->is_free = true;
-                new_block->next = curr->next;
-                
-                curr->size = aligned_size;
-                curr->next = new_block;
-            }
-            curr->is_free = false;
-            
-            // Return pointer to data payload
-            return (void*)((uint8_t*)curr + sizeof(struct heap_block));
+void* kmalloc_tagged(size_t size, enum heap_tag tag) {
+    return kmalloc_aligned_tagged(size, HEAP_ALIGN, tag);
+}
+
+void* kmalloc_aligned(size_t size, size_t align) {
+    return kmalloc_aligned_tagged(size, align, HEAP_TAG_MISC);
+}
+
+static void* alloc_locked(size_t size, size_t align, enum heap_tag tag) {
+    if (align < HEAP_ALIGN) align = HEAP_ALIGN;
+
+    // Small objects: O(1) size-class caches, list allocator only as fallback.
+    // Slab objects are naturally aligned to their (power of two) class size.
+    size_t class_request = size < align ? align : size;
+    if (class_request <= SLAB_MAX_SIZE) {
+        void* obj = slab_alloc(class_request, tag);
+        if (obj) {
+            account_alloc(size, slab_object_size(obj), tag);
+            trace_event('a', obj, size);
+            return obj;
         }
-        curr = curr->next;
     }
-    
-    syslog_write("Heap: Out of memory");
-    return NULL;
+
+    // Align requested size to 16 bytes
+    size_t aligned_size = (size + HEAP_ALIGN - 1) & ~(size_t)(HEAP_ALIGN - 1);
+    if (aligned_size < size) return NULL; // Overflow
+    if (aligned_size < HEAP_MIN_PAYLOAD) aligned_size = HEAP_MIN_PAYLOAD;
+
+    // Over-aligned requests search for enough slack to split off a prefix
+    size_t search_size = aligned_size;
+    if (align > HEAP_ALIGN) {
+        search_size = aligned_size + align + HEAP_HDR + HEAP_MIN_PAYLOAD;
+        if (search_size < aligned_size) return NULL; // Overflow
+    }
+
+    struct heap_block* block = index_find(search_size);
+    if (!block || block_size(block) < search_size) {
+        block = heap_grow(search_size);
+    }
+    if (!block || block_size(block) < search_size) {
+        g_stats.fail_count++;
+        syslog_write("Heap: Out of memory");
+        return NULL;
+    }
+
+    index_remove(block);
+    if (align > HEAP_ALIGN) block = block_align(block, align);
+    block_mark_used(block);
+    block_trim(block, aligned_size);
+    block->tag = tag;
+    account_alloc(size, block_size(block), tag);
+    trace_event('a', block_payload(block), size);
+    return block_payload(block);
 }
 
-void kfree(void* ptr) {
+void* kmalloc_aligned_tagged(size_t size, size_t align, enum heap_tag tag) {
+    if (size == 0 || g_heap_start == NULL) return NULL;
+    if ((unsigned)tag >= HEAP_TAG_COUNT) tag = HEAP_TAG_MISC;
+    if (align == 0 || (align & (align - 1)) != 0) {
+        syslog_write("Heap: Alignment must be a power of two");
+        return NULL;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&g_heap_lock);
+    void* ptr = alloc_locked(size, align, tag);
+    spin_unlock_irqrestore(&g_heap_lock, flags);
+    return ptr;
+}
+
+void* kmalloc_pages(size_t count) {
+    void* pages = pmm_alloc_pages(count);
+    if (pages) {
+        uint64_t flags = spin_lock_irqsave(&g_heap_lock);
+        g_stats.page_bytes += count * PMM_PAGE_SIZE;
+        spin_unlock_irqrestore(&g_heap_lock, flags);
+    }
+    return pages;
+}
+
+void kfree_pages(void* ptr, size_t count) {
     if (!ptr) return;
+    pmm_free_pages(ptr, count);
+    uint64_t flags = spin_lock_irqsave(&g_heap_lock);
+    g_stats.page_bytes -= count * PMM_PAGE_SIZE;
+    spin_unlock_irqrestore(&g_heap_lock, flags);
+}
+
+static void free_locked(void* ptr) {
+    trace_event('f', ptr, 0);
 
-    // Get header
-    struct heap_block* block = (struct heap_block*)((uint8_t*)ptr - sizeof(struct heap_block));
-    block->is_free = true;
-
-    // Merge with next if free
-    if (block->next && block->next->is_free) {
-        block->size += sizeof(struct heap_block) + block->next->size;
-        block->next = block->next->next;
-    }
-    
-    // Global merge pass (simple defragmentation)
-    struct heap_block* curr = g_head;
-    while (curr && curr->next) {
-        if (curr->is_free && curr->next->is_free) {
-            curr->size += sizeof(struct heap_block) + curr->next->size;
-            curr->next = curr->next->next;
-        } else {
-            curr = curr->next;
+    if (slab_owns(ptr)) {
+        size_t granted = slab_object_size(ptr);
+        if (granted == 0) {
+            syslog_write("Heap: Invalid slab free");
+            return;
         }
+        account_free(granted, slab_object_tag(ptr));
+        slab_free(ptr);
+        return;
+    }
+
+    uint8_t* p = (uint8_t*)ptr;
+    if (p < g_heap_start + HEAP_HDR || p >= g_heap_end) {
+        syslog_write("Heap: Free of foreign pointer");
+        return;
+    }
+
+    struct heap_block* block = block_from_payload(ptr);
+    if (block->magic != HEAP_MAGIC || block_is_free(block)) {
+        syslog_write("Heap: Invalid or double free");
+        return;
+    }
+
+    account_free(block_size(block), (enum heap_tag)block->tag);
+    block->size |= HEAP_FLAG_FREE;
+    block = block_coalesce(block);
+    if (block_next(block) == (struct heap_block*)g_heap_end) {
+        heap_trim(block);
     }
+    block_mark_free(block);
+    index_insert(block);
+}
+
+void kfree(void* ptr) {
+    if (!ptr) return;
+    uint64_t flags = spin_lock_irqsave(&g_heap_lock);
+    free_locked(ptr);
+    spin_unlock_irqrestore(&g_heap_lock, flags);
 }
 
 size_t heap_free_space(void) {
-    size_t total = 0;
-    struct heap_block* curr = g_head;
-    while (curr) {
-        if (curr->is_free) total += curr->size;
-        curr = curr->next;
-    }
-    return total;
+    return g_free_bytes;
+}
+
+void heap_get_stats(struct heap_stats* out) {
+    if (out == NULL) return;
+    uint64_t flags = spin_lock_irqsave(&g_heap_lock);
+    *out = g_stats;
+    out->total_bytes = (size_t)(g_heap_mapped_end - g_heap_start) + slab_mapped_bytes();
+    out->reserved_bytes = g_heap_reserved_size;
+    out->free_bytes = g_free_bytes;
+    out->largest_free = largest_free_block();
+    spin_unlock_irqrestore(&g_heap_lock, flags);
+    out->frag_percent = out->free_bytes ? (uint32_t)(100 - (out->largest_free * 100) / out->free_bytes) : 0;
+}
+
+bool heap_get_tag_stats(enum heap_tag tag, struct heap_tag_stats* out) {
+    if ((unsigned)tag >= HEAP_TAG_COUNT || out == NULL) return false;
+    uint64_t flags = spin_lock_irqsave(&g_heap_lock);
+    *out = g_tag_stats[tag];
+    spin_unlock_irqrestore(&g_heap_lock, flags);
+    out->name = HEAP_TAG_NAMES[tag];
+    return true;
 }
@@ -0,0 +1,45 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ACPI_MAX_CPUS       16
+#define ACPI_MAX_IOAPICS    4
+#define ACPI_MAX_OVERRIDES  16
+
+struct acpi_ioapic {
+    uint8_t id;
+    uint32_t address;
+    uint32_t gsi_base;      // First global system interrupt it serves
+};
+
+// ISA IRQ that the firmware routes to a different GSI or polarity
+struct acpi_irq_override {
+    uint8_t source;         // ISA IRQ
+    uint32_t gsi;
+    uint16_t flags;         // MPS INTI polarity (bits 0-1) and trigger (bits 2-3)
+};
+
+/* Interrupt topology from the MADT ("APIC" table). */
+struct acpi_madt_info {
+    uint32_t lapic_address;
+    uint8_t cpu_count;
+    uint8_t cpu_apic_ids[ACPI_MAX_CPUS];    // Enabled processors, BSP included
+    uint8_t ioapic_count;
+    struct acpi_ioapic ioapics[ACPI_MAX_IOAPICS];
+    uint8_t override_count;
+    struct acpi_irq_override overrides[ACPI_MAX_OVERRIDES];
+};
+
+/*
+ * Finds the RSDP and parses the MADT and HPET tables. Returns false if the
+ * RSDP or MADT is missing. Later calls return the first result.
+ */
+bool acpi_init(void);
+/* NULL until acpi_init has succeeded. */
+const struct acpi_madt_info* acpi_madt(void);
+/* Physical address of the HPET registers, 0 if there is none. */
+uint64_t acpi_hpet_address(void);
+
+#endif /* ACPI_H */
@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Per-task allocation arena backing sys_malloc/sys_free.
+ * Memory is carved from 64KB chunks taken from the kernel heap: small
+ * requests use power-of-two free lists, mid-sized ones a first-fit list,
+ * and large ones get a chunk of their own. Only the owning task touches
+ * its arena, so no locking is needed. When the task exits, all chunks are
+ * released at once; individual frees are optional.
+ */
+
+#define ARENA_CLASS_COUNT 8 // 16, 32, ... 2048
+
+struct arena_chunk;
+
+struct task_arena {
+    struct arena_chunk* chunks;
+    uint8_t* bump;                       // Next unused byte of the newest chunk
+    uint8_t* bump_end;
+    void* free_lists[ARENA_CLASS_COUNT]; // Freed small objects, by class
+    void* large_free;                    // Freed mid-sized objects, first fit
+    size_t bytes_in_use;
+    size_t bytes_reserved;               // Chunk memory held from the heap
+};
+
+/* A zeroed task_arena is a valid, empty arena. */
+void* arena_alloc(struct task_arena* arena, size_t size);
+void arena_free(struct task_arena* arena, void* ptr);
+
+/* Returns every chunk to the kernel heap and resets the arena. */
+void arena_release(struct task_arena* arena);
+
+#endif /* ARENA_H */
@@ -0,0 +1,22 @@
+#ifndef CLOCKSOURCE_H
+#define CLOCKSOURCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Monotonic clock with nanosecond resolution. clocksource_init picks the
+ * best free-running counter: the invariant TSC (calibrated against the
+ * PIT), then a 64-bit HPET. Without either, time advances in timer ticks.
+ */
+void clocksource_init(void);
+
+/* Nanoseconds since clocksource_init. Safe from any context, Ring 3 included. */
+uint64_t clock_monotonic_ns(void);
+
+/* "tsc", "hpet" or "tick". */
+const char* clocksource_name(void);
+/* True when clock_monotonic_ns keeps running without timer interrupts. */
+bool clocksource_is_continuous(void);
+
+#endif /* CLOCKSOURCE_H */
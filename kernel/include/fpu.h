@@ -0,0 +1,44 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct Task;
+
+/*
+ * x87/SSE/AVX state management. A task gets a save area the first time it
+ * executes an FPU/SIMD instruction: CR0.TS is set while tasks without one
+ * run, so that first use traps (#NM). From then on the state is saved
+ * (XSAVEOPT, or FXSAVE on older CPUs) and restored on every switch, which
+ * stays correct when a task moves to another CPU.
+ *
+ * SIMD code needs no special handling in Ring 3 or in kernel threads.
+ * Interrupt handlers must never use it, and code that may run in a user
+ * task's syscall path brackets it with kernel_fpu_begin/end.
+ */
+
+/* Boot CPU: detects XSAVE/AVX, enables them and builds the initial image. */
+void fpu_init(void);
+/* Same CR0/CR4/XCR0 setup on an application processor. */
+void fpu_init_cpu(void);
+
+/* True once SIMD state can be saved and restored per task. */
+bool fpu_available(void);
+
+/* #NM handler. Returns false if the FPU cannot be made available. */
+bool fpu_handle_trap(void);
+
+/* Called by schedule() with interrupts off, before the stack switch. */
+void fpu_switch(struct Task* prev, struct Task* next);
+void fpu_free(struct Task* task);
+
+/*
+ * Brackets kernel SIMD code. For a user task in Ring 0 this saves its
+ * registers and keeps interrupts off until kernel_fpu_end; otherwise both
+ * are no-ops. Pass the returned token to kernel_fpu_end.
+ */
+uint64_t kernel_fpu_begin(void);
+void kernel_fpu_end(uint64_t token);
+
+#endif /* FPU_H */
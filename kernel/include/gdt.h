@@ -7,8 +7,10 @@ extern uint8_t g_kernel_stack[];
 extern uint8_t* const g_kernel_stack_top;
 
 void gdt_init(void);
+/* Loads the GDT and TSS of the given CPU; APs call this on startup. */
+void gdt_init_cpu(uint32_t cpu);
 
-// Used by the scheduler to update the RSP0 in TSS when switching tasks
+// Used by the scheduler to update the RSP0 in the current CPU's TSS
 void gdt_set_kernel_stack(uint64_t stack_top);
 
 #endif /* GDT_H */
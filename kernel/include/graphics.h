@@ -21,6 +21,9 @@ void graphics_enable_double_buffer(void);
 void graphics_disable_double_buffer(void);
 void graphics_swap_buffer(void);
 
+/* Falls back to scalar drawing; used by the panic screen. */
+void graphics_disable_simd(void);
+
 uint32_t graphics_get_width(void);
 uint32_t graphics_get_height(void);
 
@@ -3,7 +3,9 @@
 
 #include <stdbool.h>
 
+// The launcher installs the input event channel as the GUI task's first handle
+#define GUI_EVENT_HANDLE 0
+
 void gui_demo_run(void);
-bool gui_is_running(void);
 
 #endif
@@ -1,14 +1,71 @@
 #ifndef HEAP_H
 #define HEAP_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+// Subsystem tags used to attribute live heap memory (see 'heapstat')
+enum heap_tag {
+    HEAP_TAG_MISC = 0,  // Untagged kmalloc() callers
+    HEAP_TAG_TASK,      // Scheduler task descriptors
+    HEAP_TAG_USER,      // Task arena chunks backing sys_malloc
+    HEAP_TAG_IPC,       // IPC channels and their message rings
+    HEAP_TAG_COUNT
+};
+
+#define HEAP_HIST_BUCKETS 16 // <=16B, <=32B, ... <=256KB, larger
+
+struct heap_stats {
+    size_t total_bytes;      // Mapped bytes: slab arena plus list allocator
+    size_t reserved_bytes;   // Virtual range the heap may grow into
+    size_t in_use_bytes;     // Granted bytes (after size-class rounding)
+    size_t peak_bytes;       // High-water mark of in_use_bytes
+    size_t free_bytes;       // Free bytes in the list allocator
+    size_t largest_free;     // Largest single free block
+    uint32_t frag_percent;   // 100 * (1 - largest_free / free_bytes)
+    uint64_t alloc_count;
+    uint64_t free_count;
+    uint64_t fail_count;
+    size_t page_bytes;       // Live kmalloc_pages() memory (not part of the heap)
+    uint64_t grow_count;     // Times frames were mapped in
+    uint64_t trim_count;     // Times a free tail was handed back
+    uint64_t histogram[HEAP_HIST_BUCKETS]; // Requested sizes, by power of two
+};
+
+struct heap_tag_stats {
+    const char* name;
+    size_t bytes;     // Live bytes attributed to the tag
+    size_t blocks;    // Live allocations
+    uint64_t allocs;  // Allocations since boot
+};
+
 void heap_init(void* start_addr, size_t size_bytes);
 void* kmalloc(size_t size);
+void* kmalloc_tagged(size_t size, enum heap_tag tag);
+
+/*
+ * Returns memory aligned to 'align' (a power of two), released with kfree.
+ * Small requests come from the size-class caches, larger ones split the
+ * alignment gap off as a free block instead of over-allocating.
+ */
+void* kmalloc_aligned(size_t size, size_t align);
+void* kmalloc_aligned_tagged(size_t size, size_t align, enum heap_tag tag);
+
 void kfree(void* ptr);
 
+/*
+ * Page-granular allocation straight from the frame allocator: 'count'
+ * physically contiguous, identity-mapped 4KB pages (stacks, DMA buffers,
+ * surfaces). Must be released with kfree_pages and the same count.
+ */
+void* kmalloc_pages(size_t count);
+void kfree_pages(void* ptr, size_t count);
+
 // Helper to check heap health
 size_t heap_free_space(void);
 
+void heap_get_stats(struct heap_stats* out);
+bool heap_get_tag_stats(enum heap_tag tag, struct heap_tag_stats* out);
+
 #endif
@@ -1,11 +1,63 @@
 #ifndef INTERRUPTS_H
 #define INTERRUPTS_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 void interrupts_init(void);
+/* Loads the shared IDT on the calling CPU (APs after interrupts_init). */
+void interrupts_load_idt(void);
 
-/* Unmasks the specified IRQ (0-15) on the PIC */
+/*
+ * Moves device IRQs from the 8259 PIC to the IOAPIC, keeping their vectors
+ * and masks, and acknowledges them at the LAPIC from then on. Without an
+ * IOAPIC (or LAPIC) the PIC stays in charge and this returns false.
+ */
+bool interrupts_init_apic(void);
+
+/* Unmasks the specified ISA IRQ (0-15) on the IOAPIC or PIC */
 void interrupts_enable_irq(uint8_t irq);
+/* Masks the specified ISA IRQ (0-15) on the IOAPIC or PIC */
+void interrupts_disable_irq(uint8_t irq);
+
+/*
+ * Per-vector accounting of device and LAPIC interrupts. Handler time is
+ * counted in TSC cycles from entry to just before scheduler_tick, so a
+ * task switch out of the timer interrupt is not charged to it.
+ */
+struct irq_stats {
+    uint64_t count;             // Handled interrupts, spurious ones excluded
+    uint64_t spurious;
+    uint64_t cycles;
+    uint64_t max_cycles;
+};
+
+/* Returns false for vectors that are not accounted (exceptions, syscalls). */
+bool interrupts_get_stats(uint8_t vector, struct irq_stats* out);
+
+/* One vector that has fired, for irqstat and the System Monitor syscall. */
+struct irq_info {
+    uint32_t vector;
+    struct irq_stats stats;
+};
+
+/* Fills up to 'max' vectors that have fired, by vector, and returns how many. */
+size_t interrupts_snapshot(struct irq_info* out, size_t max);
+void interrupts_reset_stats(void);
+/* Short name of what raises 'vector', or NULL if nothing in particular. */
+const char* interrupts_vector_name(uint8_t vector);
+
+/* Disables interrupts and returns the previous RFLAGS for irq_restore. */
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+/* Re-enables interrupts only if they were enabled at the matching irq_save. */
+static inline void irq_restore(uint64_t flags) {
+    if (flags & 0x200) __asm__ volatile("sti" : : : "memory");
+}
 
 #endif /* INTERRUPTS_H */
@@ -0,0 +1,20 @@
+#ifndef IOAPIC_H
+#define IOAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * I/O APICs from the ACPI MADT. ISA IRQs are translated through the MADT
+ * interrupt source overrides, so callers keep using legacy IRQ numbers.
+ */
+
+/* Maps every IOAPIC and masks all of its inputs. False if there is none. */
+bool ioapic_init(void);
+bool ioapic_available(void);
+
+/* Points ISA 'irq' at 'vector' on the CPU with 'apic_id', masked. */
+bool ioapic_route_isa(uint8_t irq, uint8_t vector, uint8_t apic_id);
+void ioapic_set_masked(uint8_t irq, bool masked);
+
+#endif /* IOAPIC_H */
@@ -0,0 +1,85 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "scheduler.h"
+#include "spinlock.h"
+#include "waitqueue.h"
+
+/*
+ * Channels: bounded rings of fixed-size messages. Receivers sleep while a
+ * channel is empty and blocking senders while it is full; try_send never
+ * sleeps and is what interrupt handlers use. A channel is reference
+ * counted. When only one holder is left it is closed: sends fail, and
+ * receives drain what is queued and then fail too.
+ */
+struct ipc_msg {
+    uint32_t type;
+    uint32_t sender;            // Task id set by sys_ipc_send; 0 from the kernel
+    uint64_t data[2];
+};
+
+// Message types the kernel sends itself; the payload is unused
+enum {
+    IPC_MSG_KEYBOARD = 1,       // Keys are waiting in the keyboard buffer
+    IPC_MSG_MOUSE,              // The mouse moved or a button changed
+    IPC_MSG_USER = 0x100        // First type free for tasks
+};
+
+#define IPC_OK            0
+#define IPC_ERR_BADF     -1     // No such handle
+#define IPC_ERR_CLOSED   -2
+#define IPC_ERR_AGAIN    -3     // Full (send) or empty (receive), or timed out
+#define IPC_ERR_NOSPC    -4     // Handle table full
+
+#define IPC_WAIT_FOREVER UINT64_MAX
+
+struct channel {
+    spinlock_t lock;
+    struct ipc_msg* ring;
+    uint32_t capacity;
+    uint32_t head;              // Oldest message
+    uint32_t count;
+    uint32_t refs;
+    bool closed;
+    bool dynamic;               // From channel_create; freed with the last reference
+    struct wait_queue readers;
+    struct wait_queue writers;
+};
+
+/* Static channel over caller-owned storage, held once by its owner. */
+#define CHANNEL_INIT(name, ring_buf, cap) \
+    { SPINLOCK_INIT(name), (ring_buf), (cap), 0, 0, 1, false, false, \
+      WAIT_QUEUE_INIT(name), WAIT_QUEUE_INIT(name) }
+
+/* Returns a heap channel holding one reference, or NULL. */
+struct channel* channel_create(uint32_t capacity);
+void channel_get(struct channel* ch);
+void channel_put(struct channel* ch);
+/* Drops queued messages and reopens a static channel for reuse. */
+void channel_reset(struct channel* ch);
+
+/* Never sleeps; safe from interrupt handlers. */
+int channel_try_send(struct channel* ch, const struct ipc_msg* msg);
+/* Kernel context only. */
+int channel_send(struct channel* ch, const struct ipc_msg* msg);
+/*
+ * Waits up to 'timeout' ticks for a message (0 polls, IPC_WAIT_FOREVER
+ * waits indefinitely). Kernel context only, unless 'timeout' is 0.
+ */
+int channel_recv(struct channel* ch, struct ipc_msg* out, uint64_t timeout);
+
+/*
+ * Per-task handle table. Only the owning task uses its table once it has
+ * started, so it is not locked; install handles before starting a task.
+ * Installing takes a reference, closing drops it.
+ */
+int ipc_handle_install(Task* task, struct channel* ch);
+struct channel* ipc_handle_get(Task* task, int handle);
+int ipc_handle_close(Task* task, int handle);
+/* Closes every handle; called when the task exits. */
+void ipc_release_handles(Task* task);
+
+#endif /* IPC_H */
@@ -17,6 +17,13 @@ void keyboard_init(void);
 /* Called by the interrupt handler (IRQ1) to push raw scancodes */
 void keyboard_push_byte(uint8_t byte);
 
+/*
+ * Posts IPC_MSG_KEYBOARD to 'ch' for every scancode, so a reader can sleep
+ * instead of polling. NULL stops it. The channel must stay valid for good.
+ */
+struct channel;
+void keyboard_set_event_channel(struct channel* ch);
+
 /* Blocking: Waits for a key */
 char keyboard_get_char(void);
 
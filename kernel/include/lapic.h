@@ -0,0 +1,34 @@
+#ifndef LAPIC_H
+#define LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LAPIC_TIMER_VECTOR    0x30
+#define LAPIC_KICK_VECTOR     0x31  // Cross-CPU "look at your timers and run queue"
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+
+/*
+ * Enables the local APIC of the calling CPU in virtual-wire mode, so the
+ * legacy PIC keeps delivering device IRQs until lapic_retire_pic. Returns
+ * false if there is none.
+ */
+bool lapic_init(void);
+/* Device IRQs now come from the IOAPIC: masks LINT0 here and on later CPUs. */
+void lapic_retire_pic(void);
+bool lapic_available(void);
+void lapic_eoi(void);
+uint8_t lapic_id(void);
+
+/* Inter-processor interrupts. INIT and STARTUP bring an AP out of reset. */
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector);
+void lapic_send_nmi(uint8_t apic_id);
+void lapic_send_init(uint8_t apic_id);
+void lapic_send_startup(uint8_t apic_id, uint8_t page);
+
+/* Timer runs at bus clock / 16. A count of 0 stops it. */
+void lapic_timer_oneshot(uint32_t count);
+void lapic_timer_stop(void);
+uint32_t lapic_timer_current(void);
+
+#endif /* LAPIC_H */
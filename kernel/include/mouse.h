@@ -15,6 +15,10 @@ void mouse_init(void);
 void mouse_handle_interrupt(void);
 MouseState mouse_get_state(void);
 
+/* Posts IPC_MSG_MOUSE to 'ch' after each packet; NULL stops it. */
+struct channel;
+void mouse_set_event_channel(struct channel* ch);
+
 // Sensitivity controls
 void mouse_set_sensitivity(int sense);
 int mouse_get_sensitivity(void);
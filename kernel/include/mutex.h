@@ -0,0 +1,32 @@
+#ifndef MUTEX_H
+#define MUTEX_H
+
+#include <stdbool.h>
+
+#include "scheduler.h"
+#include "spinlock.h"
+#include "waitqueue.h"
+
+/*
+ * Sleeping lock for code that may hold it across slow work (disk I/O,
+ * large copies). Uncontended lock/unlock is a single atomic each;
+ * contenders sleep on the wait queue instead of spinning. Not for
+ * interrupt handlers or Ring 3 callers.
+ */
+struct mutex {
+    Task* volatile owner;
+    struct wait_queue waiters;
+    struct lock_stats stats;    // waits counts sleeps
+};
+
+#define MUTEX_INIT(name) { NULL, WAIT_QUEUE_INIT(name), LOCK_STATS_INIT(name) }
+
+void mutex_init(struct mutex* m, const char* name);
+/* Adds the mutex to lockstat. */
+void mutex_register(struct mutex* m);
+
+void mutex_lock(struct mutex* m);
+bool mutex_trylock(struct mutex* m);
+void mutex_unlock(struct mutex* m);
+
+#endif /* MUTEX_H */
@@ -1,8 +1,39 @@
 #ifndef PAGING_H
 #define PAGING_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "system.h"
 
+// Physical memory below this limit is identity mapped at boot
+#define PAGING_DIRECT_MAP_GB    4
+#define PAGING_DIRECT_MAP_LIMIT ((uint64_t)PAGING_DIRECT_MAP_GB << 30)
+
+// Virtual range reserved for the kernel heap (PML4 slot 1), mapped on demand
+#define PAGING_HEAP_BASE        0x0000008000000000ull
+#define PAGING_HEAP_SIZE        (4ull << 30)
+
+#define PAGING_PAGE_SIZE        4096
+
 void paging_init(const struct BootInfo* boot_info);
 
+/*
+ * 4KB mappings outside the direct map. Page tables are allocated from the
+ * PMM as needed and kept. Mappings are always writable and user accessible,
+ * like the rest of the address space.
+ */
+bool paging_map_page(uint64_t virt, uint64_t phys);
+/* Returns the physical frame that was mapped, or 0. Flushes this CPU's TLB only. */
+uint64_t paging_unmap_page(uint64_t virt);
+
+/* Backs [virt, virt + pages * 4KB) with fresh frames; all or nothing. */
+bool paging_commit(uint64_t virt, size_t pages);
+/* Unmaps the range, shoots down other CPUs' TLBs and returns the frames to the PMM. */
+void paging_decommit(uint64_t virt, size_t pages);
+
+/* Makes the direct-map page holding 'phys' uncacheable, for MMIO registers. */
+bool paging_set_uncached(uint64_t phys);
+
 #endif /* PAGING_H */
@@ -0,0 +1,32 @@
+#ifndef PMM_H
+#define PMM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "system.h"
+
+/*
+ * Physical page frame allocator.
+ * Built from the BIOS E820 map handed over in BootInfo; one bit per 4KB
+ * frame below the direct-map limit. Frames are returned as identity-mapped
+ * pointers, so callers can use them directly.
+ */
+
+#define PMM_PAGE_SIZE 4096
+
+/* Takes ownership of all usable RAM outside the kernel image and low memory. */
+void pmm_init(const struct BootInfo* boot_info);
+
+/* Allocates count physically contiguous frames. Returns NULL on failure. */
+void* pmm_alloc_pages(size_t count);
+void pmm_free_pages(void* addr, size_t count);
+
+size_t pmm_total_pages(void);
+size_t pmm_free_page_count(void);
+
+/* Highest usable physical address reported by the firmware. */
+uint64_t pmm_memory_top(void);
+
+#endif /* PMM_H */
@@ -0,0 +1,31 @@
+#ifndef RTC_H
+#define RTC_H
+
+#include <stdint.h>
+
+/* Broken-down wall-clock time, as kept by the CMOS RTC (no time zone). */
+struct rtc_time {
+    uint16_t year;
+    uint8_t month;      // 1-12
+    uint8_t day;        // 1-31
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+};
+
+/*
+ * Reads the CMOS clock once. Later queries add clock_monotonic_ns to that
+ * reading, so they are plain memory reads that never touch the RTC ports.
+ * Call after the clocksource is up.
+ */
+void rtc_init(void);
+
+/* Seconds since 1970-01-01 00:00:00 in RTC time. */
+uint64_t rtc_unix_time(void);
+void rtc_get_time(struct rtc_time* out);
+
+/* "YYYY-MM-DD HH:MM:SS"; 'buf' needs RTC_FORMAT_LEN bytes. */
+#define RTC_FORMAT_LEN 20
+void rtc_format(const struct rtc_time* t, char* buf);
+
+#endif /* RTC_H */
@@ -3,26 +3,132 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "arena.h"
+
+// Lower number = higher priority. Tasks of the highest non-empty level run
+// round-robin; lower levels only run when every higher level is blocked.
+#define SCHED_PRIORITIES            8
+#define TASK_PRIORITY_INTERACTIVE   2   // GUI session
+#define TASK_PRIORITY_NORMAL        4   // Shell and kernel threads
+#define TASK_PRIORITY_IDLE          (SCHED_PRIORITIES - 1)
+
+// Time slices in microseconds. Interactive tasks get short slices so one
+// busy window cannot hold up the others for long.
+#define SCHED_SLICE_US              20000
+#define SCHED_INTERACTIVE_SLICE_US  500
 
 typedef enum {
-    TASK_READY,
+    TASK_READY,     // Running or queued to run
+    TASK_BLOCKED,   // Waiting for scheduler_wake
+    TASK_SLEEPING,  // Waiting for a timer deadline
     TASK_DEAD
 } TaskState;
 
-typedef struct {
+#define TASK_NAME_LEN 16
+#define TASK_MAX_HANDLES 8
+
+struct channel;
+struct syscall_ring;
+
+typedef struct Task {
     uint64_t id;
+    char name[TASK_NAME_LEN];
     uint64_t rsp;
     uint64_t kernel_stack_top; // For Ring 3 -> 0 transitions
+    void* kernel_stack;        // Stack allocations, freed by the reaper
+    void* user_stack;
     bool is_user;
     TaskState state;
-    void* next;
+    uint8_t priority;
+    uint32_t cpu;              // Run queue that owns the task
+    volatile bool on_cpu;      // Running, or not yet fully switched out
+    bool on_rq;
+    uint64_t slice_end;        // timer_get_us() deadline of the current slice
+    struct Task* run_next;     // Ready queue links (only while queued)
+    struct Task* run_prev;
+    struct Task* waiter;       // Task blocked in scheduler_join on this one
+    struct task_arena arena;   // Backs sys_malloc, released on exit
+    void* fpu_state;           // XSAVE/FXSAVE area, allocated on first FPU use
+    struct channel* handles[TASK_MAX_HANDLES]; // IPC handle table, see ipc.h
+    struct syscall_ring* sys_ring; // Batched syscalls, lives in the arena
+    // CPU accounting in clock_monotonic_ns() nanoseconds, charged by schedule()
+    uint64_t run_start;        // When it last got a CPU, 0 while not running
+    uint64_t runtime;
+    uint64_t switches;         // Times it was switched in
+    uint64_t voluntary;        // Switched out because it blocked, slept or exited
+    uint64_t involuntary;      // Preempted or yielded while still runnable
+    uint64_t syscalls;         // Charged by the syscall dispatcher
+    uint64_t syscall_ns;       // Time inside them, blocked time included
+    struct Task* next;         // List of all tasks
 } Task;
 
 void scheduler_init(void);
-void spawn_task(void (*entry_point)(void));
-void spawn_user_task(void (*entry_point)(void));
+/* Turns an AP's boot context into its idle task and never returns. */
+void scheduler_run_ap(uint32_t cpu);
+Task* spawn_task(void (*entry_point)(void));
+Task* spawn_user_task(void (*entry_point)(void));
+/* Builds a Ring 3 task without running it, so handles can be installed first. */
+Task* create_user_task(void (*entry_point)(void));
+void start_task(Task* task);
 void schedule(void);
 void exit_current_task(void);
+/* Called on the new task's stack after every switch (entry.asm too). */
+void schedule_tail(void);
+Task* scheduler_current_task(void);
+
+/* Called from the timer interrupt; preempts when the slice has run out. */
+void scheduler_tick(void);
+
+void scheduler_set_priority(Task* task, uint8_t priority);
+
+/*
+ * Parks the current task until scheduler_wake. To avoid lost wakeups, check
+ * the wait condition and call this with interrupts disabled (irq_save).
+ */
+void scheduler_block(void);
+/*
+ * Publishes the current task's state before a wait condition is rechecked:
+ * set BLOCKED/SLEEPING, recheck, then schedule() or set READY again. A wakeup
+ * from another CPU in between then makes schedule() return at once.
+ */
+void scheduler_set_state(TaskState state);
+/* Makes a blocked or sleeping task runnable. Safe from interrupt handlers. */
+void scheduler_wake(Task* task);
+
+/* Blocks until 'task' has exited. */
+void scheduler_join(Task* task);
+
+void scheduler_set_name(Task* task, const char* name);
+
+/* Snapshot of one task for ps/top and the Task Manager syscall. */
+struct task_info {
+    uint64_t id;
+    char name[TASK_NAME_LEN];
+    uint8_t state;             // TaskState
+    uint8_t priority;
+    bool is_user;
+    bool is_idle;
+    uint32_t cpu;
+    uint64_t runtime_us;
+    uint64_t switches;
+    uint64_t voluntary;
+    uint64_t involuntary;
+    uint64_t syscalls;
+    uint64_t syscall_us;
+};
+
+/* Busy and idle time summed over all online CPUs since they came up. */
+struct cpu_times {
+    uint64_t busy_us;
+    uint64_t idle_us;
+    uint32_t cpus;
+};
+
+/* Fills up to 'max' entries and returns how many were written. */
+size_t scheduler_task_snapshot(struct task_info* out, size_t max);
+void scheduler_cpu_times(struct cpu_times* out);
 
 // Assembly helper
 extern void context_switch(uint64_t* old_sp_ptr, uint64_t new_sp);
@@ -0,0 +1,17 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * SSE2 pixel kernels (simd.c is the only file built with SSE enabled).
+ * Callers in code that may run in a user task's syscall path wrap them in
+ * kernel_fpu_begin/end; never call them from an interrupt handler.
+ */
+void simd_fill32(uint32_t* dest, uint32_t value, size_t count);
+void simd_copy32(uint32_t* dest, const uint32_t* src, size_t count);
+/* dest = (color * alpha + dest * (255 - alpha)) / 255 per channel, opaque. */
+void simd_blend32(uint32_t* dest, uint32_t color, uint8_t alpha, size_t count);
+
+#endif /* SIMD_H */
@@ -0,0 +1,59 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "heap.h"
+
+/*
+ * Size-class object caches sitting in front of the list allocator.
+ * Requests of up to SLAB_MAX_SIZE bytes are rounded up to a power of two
+ * and served from 4KB slab pages carved out of a dedicated arena, so both
+ * allocation and free are O(1).
+ */
+
+#define SLAB_MIN_SIZE   16
+#define SLAB_MAX_SIZE   2048
+#define SLAB_PAGE_SIZE  4096
+#define SLAB_CACHE_COUNT 8 // 16, 32, 64, 128, 256, 512, 1024, 2048
+
+struct slab_cache_stats {
+    size_t object_size;
+    uint64_t allocs;     // Successful allocations
+    uint64_t frees;
+    uint64_t hits;       // Served from an already populated slab page
+    uint64_t refills;    // Needed a fresh page from the arena
+    uint64_t fallbacks;  // Arena exhausted, request passed to the list allocator
+    size_t active;       // Objects currently handed out
+    size_t pages;        // Slab pages currently owned by the cache
+};
+
+/* Hands the unmapped virtual range [start, start + size) to the slab layer. */
+void slab_init(void* start, size_t size);
+
+/*
+ * Returns NULL if size is out of range or the arena is exhausted.
+ * Pages are segregated by tag so every object's owner can be recovered on free.
+ */
+void* slab_alloc(size_t size, enum heap_tag tag);
+void slab_free(void* ptr);
+
+/* True if ptr lies inside the slab arena. */
+bool slab_owns(const void* ptr);
+
+/* Size class and tag of a live slab object. */
+size_t slab_object_size(const void* ptr);
+enum heap_tag slab_object_tag(const void* ptr);
+
+size_t slab_cache_count(void);
+bool slab_cache_stats(size_t index, struct slab_cache_stats* out);
+
+/* Arena usage in pages (for diagnostics). */
+size_t slab_arena_pages_total(void);
+size_t slab_arena_pages_free(void);
+/* Physical memory currently backing the arena, descriptors included. */
+size_t slab_mapped_bytes(void);
+
+#endif /* SLAB_H */
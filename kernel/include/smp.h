@@ -0,0 +1,36 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acpi.h"
+
+#define SMP_MAX_CPUS ACPI_MAX_CPUS
+
+/*
+ * Brings up the application processors listed in the MADT. Each AP gets
+ * its own GDT/TSS and enters the scheduler as that CPU's idle task.
+ */
+void smp_init(void);
+
+/* Index of the calling CPU (0 = boot CPU). Stable only with interrupts off. */
+uint32_t smp_cpu_id(void);
+/* Number of CPUs that are online. */
+uint32_t smp_cpu_count(void);
+bool smp_cpu_online(uint32_t cpu);
+
+/* Interrupts another CPU so it re-checks its timers and run queue. */
+void smp_kick(uint32_t cpu);
+
+/*
+ * Makes every other online CPU drop its TLB entries for [virt, virt +
+ * pages * 4KB) and waits until they have. Call after unmapping and before
+ * the frames are reused. Safe with interrupts off and locks held.
+ */
+void smp_tlb_shootdown(uint64_t virt, size_t pages);
+/* NMI handler hook: services a pending shootdown for this CPU. */
+void smp_handle_nmi(void);
+
+#endif /* SMP_H */
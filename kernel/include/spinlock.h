@@ -0,0 +1,94 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "interrupts.h"
+
+/*
+ * Contention counters shared by spinlocks and mutexes. They are only
+ * updated by the lock holder, so they need no atomics of their own.
+ * Registered locks show up in the 'lockstat' shell command.
+ */
+struct lock_stats {
+    const char* name;
+    int16_t instance;       // Per-CPU locks: CPU index, otherwise -1
+    uint64_t acquired;
+    uint64_t contended;     // Acquisitions that had to wait
+    uint64_t waits;         // Spin iterations, or sleeps for a mutex
+    struct lock_stats* next;
+};
+
+#define LOCK_STATS_INIT(n) { (n), -1, 0, 0, 0, NULL }
+
+void lockstat_register(struct lock_stats* stats);
+/* Head of the registered list; follow ->next. */
+const struct lock_stats* lockstat_first(void);
+void lockstat_reset(void);
+
+/*
+ * Ticket spinlock: waiters are served in arrival order, so no CPU can be
+ * starved by a faster one. Use the _irqsave variants for any lock that an
+ * interrupt handler may also take.
+ */
+typedef struct {
+    volatile uint16_t next;   // Next ticket to hand out
+    volatile uint16_t owner;  // Ticket currently being served
+    struct lock_stats stats;
+} spinlock_t;
+
+#define SPINLOCK_INIT(name) { 0, 0, LOCK_STATS_INIT(name) }
+
+static inline void spin_lock_init(spinlock_t* lock, const char* name) {
+    lock->next = 0;
+    lock->owner = 0;
+    lock->stats = (struct lock_stats)LOCK_STATS_INIT(name);
+}
+
+static inline void spin_lock_register(spinlock_t* lock) {
+    lockstat_register(&lock->stats);
+}
+
+static inline void spin_lock(spinlock_t* lock) {
+    uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    uint64_t spins = 0;
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        __asm__ volatile("pause");
+        spins++;
+    }
+    lock->stats.acquired++;
+    if (spins) {
+        lock->stats.contended++;
+        lock->stats.waits += spins;
+    }
+}
+
+static inline bool spin_trylock(spinlock_t* lock) {
+    uint16_t owner = __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+    uint16_t expected = owner;
+    if (!__atomic_compare_exchange_n(&lock->next, &expected, (uint16_t)(owner + 1), false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    lock->stats.acquired++;
+    return true;
+}
+
+static inline void spin_unlock(spinlock_t* lock) {
+    __atomic_store_n(&lock->owner, (uint16_t)(lock->owner + 1), __ATOMIC_RELEASE);
+}
+
+static inline uint64_t spin_lock_irqsave(spinlock_t* lock) {
+    uint64_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint64_t flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+#endif /* SPINLOCK_H */
@@ -1,8 +1,92 @@
 #ifndef SYSCALL_H
 #define SYSCALL_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/*
+ * System calls enter through int 0x80 or, where the CPU has it, the
+ * SYSCALL instruction (syscall_entry in entry.asm). Both take the number
+ * in rdi and arguments in rsi, rdx and r10, and return in rax; SYSCALL
+ * also clobbers rcx and r11.
+ */
 void syscall_init(void);
+/* Programs this CPU's SYSCALL MSRs; APs call this on startup. */
+void syscall_init_cpu(uint32_t cpu);
+/* True once SYSCALL/SYSRET may be used from Ring 3. */
+bool syscall_fast_available(void);
+
+// Used by the scheduler, next to gdt_set_kernel_stack: SYSCALL does not
+// switch stacks through the TSS, so the entry stub loads this one
+void syscall_set_kernel_stack(uint64_t stack_top);
+
+/*
+ * Submission/completion ring shared by a task and the kernel, set up by
+ * syscall 15. The task fills sq[] entries with ordinary syscall numbers
+ * and arguments, advances sq_tail and enters the kernel once with syscall
+ * 16; the kernel runs them in order and posts one cq[] entry each.
+ * Indices run freely and are masked with SYSCALL_RING_ENTRIES - 1. The
+ * kernel stops early rather than overrun the completion ring.
+ */
+#define SYSCALL_RING_ENTRIES 64
+#define SYSCALL_RING_BADOP   ((int64_t)-1)   // exit and the ring calls themselves
+
+struct syscall_sqe {
+    uint64_t op;                // Syscall number
+    uint64_t args[3];           // rsi, rdx, r10
+    uint64_t user_data;         // Copied to the completion
+};
+
+struct syscall_cqe {
+    uint64_t user_data;
+    int64_t result;             // What rax would have held
+};
+
+struct syscall_ring {
+    uint32_t sq_head;           // Written by the kernel
+    uint32_t sq_tail;           // Written by the task
+    uint32_t cq_head;           // Written by the task
+    uint32_t cq_tail;           // Written by the kernel
+    struct syscall_sqe sq[SYSCALL_RING_ENTRIES];
+    struct syscall_cqe cq[SYSCALL_RING_ENTRIES];
+};
+
+/*
+ * Per-number call counts and latency, measured with clock_monotonic_ns
+ * around each call (batched ring entries are counted one by one). Bucket
+ * b of the histogram counts calls that took [2^b, 2^(b+1)) ns.
+ */
+#define SYSCALL_COUNT        18
+#define SYSCALL_HIST_BUCKETS 32
+
+struct syscall_stats {
+    uint64_t calls;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t hist[SYSCALL_HIST_BUCKETS];
+};
+
+/* NULL for numbers that are not assigned. */
+const char* syscall_name(uint32_t nr);
+/* Returns false if 'nr' is out of range. */
+bool syscall_get_stats(uint32_t nr, struct syscall_stats* out);
+void syscall_reset_stats(void);
+
+/* strace-like log of the most recent calls, off by default. */
+#define SYSCALL_TRACE_ENTRIES 64
+
+struct syscall_trace {
+    uint64_t task;
+    uint64_t nr;
+    uint64_t args[3];
+    uint64_t ret;
+    uint64_t duration_ns;
+};
+
+void syscall_trace_enable(bool on);
+bool syscall_trace_enabled(void);
+/* Copies up to 'max' entries, oldest first, and returns how many. */
+size_t syscall_trace_read(struct syscall_trace* out, size_t max);
 
 #endif
@@ -5,6 +5,8 @@
 
 void syslog_init(void);
 void syslog_write(const char* message);
+// Debug console (port 0xE9) only; high-volume traces stay out of the log ring
+void syslog_trace(const char* message);
 size_t syslog_length(void);
 const char* syslog_entry(size_t index);
 
@@ -3,14 +3,28 @@
 
 #include <stdint.h>
 
+// Layout shared with bootloader/stage2.asm (BOOT_INFO)
 struct BootInfo {
     uint32_t width;
     uint32_t height;
     uint32_t pitch;
     uint32_t bpp;
     uint64_t framebuffer;
+    uint32_t e820_count;    // 0 if the BIOS did not provide a map
+    uint32_t reserved;
+    uint64_t e820_map;      // Physical address of e820_count entries
 };
 
+// BIOS E820 memory map entry
+struct e820_entry {
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+    uint32_t acpi;
+} __attribute__((packed));
+
+#define E820_TYPE_USABLE 1
+
 struct system_profile {
     const char* architecture;
     uint32_t memory_total_kb;
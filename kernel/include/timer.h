@@ -2,16 +2,71 @@
 #define TIMER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 void timer_init(void);
 void timer_phase(int hz);
+/* Timer interrupt work. The handler calls scheduler_tick afterwards. */
 void timer_handler(void);
-void timer_wait(int ticks);
 uint64_t timer_get_ticks(void);
 uint64_t timer_get_uptime(void);
+/* Monotonic microseconds since boot; tick resolution unless tickless. */
+uint64_t timer_get_us(void);
+
+/* Busy-waits; for hardware delays before the scheduler is useful. */
+void timer_udelay(uint64_t us);
+/*
+ * Busy-waits 'ms' (at most 54) on PIT channel 2, independent of the system
+ * timer. Calibration reads its own counter on either side of the call.
+ */
+void pit_oneshot_wait(uint32_t ms);
+/* True when the LAPIC timer and the clocksource have replaced the PIT. */
+bool timer_is_tickless(void);
+
+#define TIMER_NO_DEADLINE UINT64_MAX
+
+/*
+ * Deadline (timer_get_us) for this CPU's running task's slice; 0 asks for an
+ * interrupt as soon as possible. In tickless mode this is what keeps a
+ * busy CPU preemptible; with the PIT it is polled every tick.
+ */
+void timer_arm_slice(uint64_t deadline_us);
 
 // Callback typedef
 typedef void (*timer_callback_t)(void);
+/*
+ * Runs 'callback' every 4th tick on a worker thread. Once this returns the
+ * previous callback is no longer running. Kernel tasks only.
+ */
 void timer_set_callback(timer_callback_t callback);
 
+/*
+ * One-shot kernel timer. The caller owns the storage, which must stay valid
+ * until timer_cancel returns. 'fn' runs in CPU 0's timer interrupt; once
+ * timer_cancel returns it is no longer running, so 'fn' must not cancel
+ * its own timer.
+ */
+struct timer {
+    uint64_t expires;           // Absolute tick
+    void (*fn)(void* arg);
+    void* arg;
+    struct timer* next;
+    struct timer** pprev;       // Link that points at us, for O(1) removal
+    uint8_t level;
+    uint8_t slot;
+    bool pending;
+    bool running;               // 'fn' is executing with the wheel unlocked
+};
+
+void timer_add(struct timer* t, uint64_t expires, void (*fn)(void* arg), void* arg);
+/* Returns true if the timer was still pending. Waits for a running 'fn'. */
+bool timer_cancel(struct timer* t);
+
+/* Park the calling task until the deadline; other tasks (or hlt) get the CPU. */
+void sleep_ticks(uint64_t ticks);
+void sleep_until(uint64_t tick);
+
+/* Kernel code sleeps; Ring 3 callers fall back to spinning. */
+void timer_wait(int ticks);
+
 #endif
@@ -0,0 +1,67 @@
+#ifndef VDSO_H
+#define VDSO_H
+
+#include <stdint.h>
+
+#include "mouse.h"
+
+/*
+ * One page of kernel-published state that Ring 3 reads without a syscall.
+ * Each group has a single writer (CPU 0's timer interrupt, the mouse IRQ)
+ * and its own sequence count: odd while an update is in progress. Readers
+ * retry until they see the same even count before and after copying.
+ */
+struct vdso_data {
+    uint32_t time_seq;
+    uint32_t mouse_seq;
+    uint64_t ticks;             // timer_get_ticks() at the last update
+    uint64_t monotonic_ns;      // clock_monotonic_ns() at the last update
+    uint64_t unix_time;         // rtc_unix_time() at the last update
+    MouseState mouse;
+};
+
+struct vdso_time {
+    uint64_t ticks;
+    uint64_t monotonic_ns;
+    uint64_t unix_time;
+};
+
+/* Page-aligned and mapped user-readable, like all kernel memory here. */
+const struct vdso_data* vdso_page(void);
+
+// Writers; each is only called from its own interrupt handler
+void vdso_update_time(uint64_t ticks);
+void vdso_update_mouse(const MouseState* state);
+
+static inline uint32_t vdso_read_begin(const uint32_t* seq) {
+    uint32_t s;
+    while ((s = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) {
+        __asm__ volatile("pause");
+    }
+    return s;
+}
+
+static inline int vdso_read_retry(const uint32_t* seq, uint32_t start) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+static inline void vdso_read_time(const struct vdso_data* v, struct vdso_time* out) {
+    uint32_t s;
+    do {
+        s = vdso_read_begin(&v->time_seq);
+        out->ticks = v->ticks;
+        out->monotonic_ns = v->monotonic_ns;
+        out->unix_time = v->unix_time;
+    } while (vdso_read_retry(&v->time_seq, s));
+}
+
+static inline void vdso_read_mouse(const struct vdso_data* v, MouseState* out) {
+    uint32_t s;
+    do {
+        s = vdso_read_begin(&v->mouse_seq);
+        *out = v->mouse;
+    } while (vdso_read_retry(&v->mouse_seq, s));
+}
+
+#endif /* VDSO_H */
@@ -0,0 +1,56 @@
+#ifndef WAITQUEUE_H
+#define WAITQUEUE_H
+
+#include <stdbool.h>
+
+#include "scheduler.h"
+#include "spinlock.h"
+
+/*
+ * Tasks sleeping until some condition becomes true. Wakers change the
+ * condition first, then call wait_queue_wake_*; both are safe from
+ * interrupt handlers. Only kernel (Ring 0) code may wait.
+ */
+struct wait_entry {
+    Task* task;
+    struct wait_entry* next;
+    bool queued;
+    uint64_t flags;             // irq_save state of the waiter
+};
+
+struct wait_queue {
+    spinlock_t lock;
+    struct wait_entry* head;
+    struct wait_entry* tail;
+};
+
+#define WAIT_QUEUE_INIT(name) { SPINLOCK_INIT(name), NULL, NULL }
+
+void wait_queue_init(struct wait_queue* wq, const char* name);
+
+/* Wakes the longest waiter / every waiter. Returns how many were woken. */
+unsigned wait_queue_wake_one(struct wait_queue* wq);
+unsigned wait_queue_wake_all(struct wait_queue* wq);
+
+/* Building blocks of wait_event. */
+void wait_prepare(struct wait_queue* wq, struct wait_entry* entry);
+void wait_sleep(void);
+void wait_finish(struct wait_queue* wq, struct wait_entry* entry);
+
+/*
+ * Sleeps until 'condition' is true. The task is queued and marked blocked
+ * before each check, so a wakeup between the check and the sleep is not
+ * lost. The condition is evaluated with interrupts disabled.
+ */
+#define wait_event(wq, condition)                     \
+    do {                                              \
+        struct wait_entry wait_entry__ = {0};         \
+        wait_prepare((wq), &wait_entry__);            \
+        while (!(condition)) {                        \
+            wait_sleep();                             \
+            wait_prepare((wq), &wait_entry__);        \
+        }                                             \
+        wait_finish((wq), &wait_entry__);             \
+    } while (0)
+
+#endif /* WAITQUEUE_H */
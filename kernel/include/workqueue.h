@@ -0,0 +1,36 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <stdbool.h>
+
+/*
+ * Deferred work: interrupt handlers queue a work item and return; kernel
+ * worker threads run it later with interrupts enabled. The caller owns
+ * the storage. Queueing an item that is already pending does nothing, so
+ * a slow item never piles up, and one item never runs on two workers at
+ * once.
+ */
+struct work {
+    void (*fn)(void* arg);
+    void* arg;
+    struct work* next;
+    bool pending;               // Queued, not yet started
+    bool running;               // A worker is inside fn
+};
+
+#define WORK_INIT(f, a) { (f), (a), NULL, false, false }
+
+/* Starts one worker thread per online CPU. Call after smp_init. */
+void workqueue_init(void);
+
+/* Safe from interrupt handlers. Returns false if it was already pending. */
+bool work_queue(struct work* w);
+
+/*
+ * Drops a pending run and waits for a running one to finish, so the
+ * caller may free or reuse what fn touches. Kernel tasks only.
+ * Returns true if a pending run was dropped.
+ */
+bool work_cancel(struct work* w);
+
+#endif /* WORKQUEUE_H */
@@ -9,6 +9,12 @@
 #include "timer.h"
 #include "graphics.h"
 #include "mouse.h"
+#include "ioapic.h"
+#include "lapic.h"
+#include "fpu.h"
+#include "cpu.h"
+#include "scheduler.h"
+#include "smp.h"
 
 struct interrupt_frame {
     uint64_t rip;
@@ -40,6 +46,13 @@ static struct idt_entry g_idt[256];
 #define PIC2_COMMAND 0xA0
 #define PIC2_DATA    0xA1
 #define PIC_EOI      0x20
+#define PIC_READ_ISR 0x0B
+
+#define IRQ_VECTOR_BASE 0x20
+#define IRQ_CASCADE     2
+
+// Set once device IRQs arrive through the IOAPIC
+static bool g_apic_mode = false;
 
 // ASM entry point for syscalls
 extern void isr_syscall(void);
@@ -71,6 +84,10 @@ static void pic_remap_and_mask(void) {
 }
 
 void interrupts_enable_irq(uint8_t irq) {
+    if (g_apic_mode) {
+        ioapic_set_masked(irq, false);
+        return;
+    }
     uint16_t port;
     uint8_t value;
     if (irq < 8) { port = PIC1_DATA; } else { port = PIC2_DATA; irq -= 8; }
@@ -78,6 +95,16 @@ void interrupts_enable_irq(uint8_t irq) {
     outb(port, value);
 }
 
+void interrupts_disable_irq(uint8_t irq) {
+    if (g_apic_mode) {
+        ioapic_set_masked(irq, true);
+        return;
+    }
+    uint16_t port;
+    if (irq < 8) { port = PIC1_DATA; } else { port = PIC2_DATA; irq -= 8; }
+    outb(port, inb(port) | (uint8_t)(1 << irq));
+}
+
 static const char* const EXCEPTION_NAMES[] = {
     "Divide-by-zero", "Debug", "NMI", "Breakpoint", "Overflow", 
     "Bound Range", "Invalid Opcode", "Device NA", "Double Fault", 
@@ -90,6 +117,8 @@ static size_t panic_line = 0;
 static void panic_draw_bg(void) {
     // Critical: Disable double buffering to ensure panic is seen on screen
     graphics_disable_double_buffer();
+    // The fault may have come from the FPU itself; stay on plain registers
+    graphics_disable_simd();
     
     if (graphics_get_width() > 0) graphics_fill_rect(0, 0, graphics_get_width(), graphics_get_height(), 0xFF0000AA);
     panic_line = 0;
@@ -140,19 +169,112 @@ static void exception_panic(uint8_t vector, uint64_t error_code, bool has_error_
     }
 
 DECLARE_NOERR_HANDLER(0); DECLARE_NOERR_HANDLER(1);
-__attribute__((interrupt)) static void handler_2(struct interrupt_frame* frame) { (void)frame; }
-DECLARE_NOERR_HANDLER(3); DECLARE_NOERR_HANDLER(4); DECLARE_NOERR_HANDLER(5); DECLARE_NOERR_HANDLER(6); DECLARE_NOERR_HANDLER(7);
+// Other CPUs send NMIs for TLB shootdowns; anything else is ignored
+__attribute__((interrupt)) static void handler_2(struct interrupt_frame* frame) { (void)frame; smp_handle_nmi(); }
+DECLARE_NOERR_HANDLER(3); DECLARE_NOERR_HANDLER(4); DECLARE_NOERR_HANDLER(5); DECLARE_NOERR_HANDLER(6);
+// Device Not Available: first FPU/SIMD use by a task (CR0.TS set)
+__attribute__((interrupt)) static void handler_7(struct interrupt_frame* frame) { if (!fpu_handle_trap()) exception_panic(7, 0, false, frame); }
 DECLARE_ERR_HANDLER(8); DECLARE_NOERR_HANDLER(9); DECLARE_ERR_HANDLER(10); DECLARE_ERR_HANDLER(11); DECLARE_ERR_HANDLER(12);
 DECLARE_ERR_HANDLER(13); DECLARE_ERR_HANDLER(14); DECLARE_NOERR_HANDLER(15); DECLARE_NOERR_HANDLER(16); DECLARE_ERR_HANDLER(17);
 DECLARE_NOERR_HANDLER(18); DECLARE_NOERR_HANDLER(19); DECLARE_NOERR_HANDLER(20); DECLARE_ERR_HANDLER(21); DECLARE_NOERR_HANDLER(22);
 DECLARE_NOERR_HANDLER(23); DECLARE_NOERR_HANDLER(24); DECLARE_NOERR_HANDLER(25); DECLARE_NOERR_HANDLER(26); DECLARE_NOERR_HANDLER(27);
 DECLARE_NOERR_HANDLER(28); DECLARE_NOERR_HANDLER(29); DECLARE_NOERR_HANDLER(30); DECLARE_NOERR_HANDLER(31);
 
-__attribute__((interrupt)) static void handler_irq_master(struct interrupt_frame* frame) { (void)frame; outb(PIC1_COMMAND, PIC_EOI); }
-__attribute__((interrupt)) static void handler_irq_slave(struct interrupt_frame* frame) { (void)frame; outb(PIC2_COMMAND, PIC_EOI); outb(PIC1_COMMAND, PIC_EOI); }
-__attribute__((interrupt)) static void handler_irq_keyboard(struct interrupt_frame* frame) { (void)frame; uint8_t scancode = inb(0x60); outb(PIC1_COMMAND, PIC_EOI); keyboard_push_byte(scancode); }
-__attribute__((interrupt)) static void handler_irq_timer(struct interrupt_frame* frame) { (void)frame; timer_handler(); outb(PIC1_COMMAND, PIC_EOI); }
-__attribute__((interrupt)) static void handler_irq_mouse(struct interrupt_frame* frame) { (void)frame; mouse_handle_interrupt(); outb(PIC2_COMMAND, PIC_EOI); outb(PIC1_COMMAND, PIC_EOI); }
+// One MMIO write on the LAPIC; the PIC needs a port write per chip
+static inline void irq_eoi(uint8_t irq) {
+    if (g_apic_mode) { lapic_eoi(); return; }
+    if (irq >= 8) outb(PIC2_COMMAND, PIC_EOI);
+    outb(PIC1_COMMAND, PIC_EOI);
+}
+
+// Updated with relaxed atomics; the LAPIC vectors fire on every CPU
+static struct irq_stats g_irq_stats[256];
+
+static inline void irq_account(uint8_t vector, uint64_t start) {
+    struct irq_stats* st = &g_irq_stats[vector];
+    uint64_t cycles = rdtsc() - start;
+    __atomic_fetch_add(&st->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&st->cycles, cycles, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&st->max_cycles, __ATOMIC_RELAXED);
+    while (cycles > max && !__atomic_compare_exchange_n(&st->max_cycles, &max, cycles, true,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+static inline void irq_spurious(uint8_t vector) {
+    __atomic_fetch_add(&g_irq_stats[vector].spurious, 1, __ATOMIC_RELAXED);
+}
+
+// IRQ 7 and 15 also signal a request the PIC dropped; its ISR bit is then clear
+static bool pic_spurious(uint8_t irq) {
+    if (g_apic_mode) return false;
+    uint16_t port = irq < 8 ? PIC1_COMMAND : PIC2_COMMAND;
+    outb(port, PIC_READ_ISR);
+    return !(inb(port) & (1u << (irq & 7)));
+}
+
+#define DECLARE_IRQ_HANDLER(irq) \
+    __attribute__((interrupt)) static void handler_irq_##irq(struct interrupt_frame* frame) { \
+        (void)frame; uint64_t start = rdtsc(); irq_eoi(irq); irq_account(IRQ_VECTOR_BASE + (irq), start); \
+    }
+
+DECLARE_IRQ_HANDLER(2); DECLARE_IRQ_HANDLER(3); DECLARE_IRQ_HANDLER(4); DECLARE_IRQ_HANDLER(5);
+DECLARE_IRQ_HANDLER(6); DECLARE_IRQ_HANDLER(8); DECLARE_IRQ_HANDLER(9); DECLARE_IRQ_HANDLER(10);
+DECLARE_IRQ_HANDLER(11); DECLARE_IRQ_HANDLER(13); DECLARE_IRQ_HANDLER(14);
+
+__attribute__((interrupt)) static void handler_irq_7(struct interrupt_frame* frame) {
+    (void)frame;
+    if (pic_spurious(7)) { irq_spurious(IRQ_VECTOR_BASE + 7); return; }
+    uint64_t start = rdtsc(); irq_eoi(7); irq_account(IRQ_VECTOR_BASE + 7, start);
+}
+// A spurious IRQ 15 still came through the master's cascade input
+__attribute__((interrupt)) static void handler_irq_15(struct interrupt_frame* frame) {
+    (void)frame;
+    if (pic_spurious(15)) { outb(PIC1_COMMAND, PIC_EOI); irq_spurious(IRQ_VECTOR_BASE + 15); return; }
+    uint64_t start = rdtsc(); irq_eoi(15); irq_account(IRQ_VECTOR_BASE + 15, start);
+}
+__attribute__((interrupt)) static void handler_irq_keyboard(struct interrupt_frame* frame) {
+    (void)frame; uint64_t start = rdtsc();
+    uint8_t scancode = inb(0x60); irq_eoi(1); keyboard_push_byte(scancode);
+    irq_account(IRQ_VECTOR_BASE + 1, start);
+}
+// A task switched to from here resumes in Ring 0 expecting the kernel GS
+// (syscall.c), so handlers that can reschedule swap it in over a user GS.
+// The others never touch GS and leave it as they found it.
+static inline void swapgs_if_user(const struct interrupt_frame* frame) {
+    if (frame->cs & 3) __asm__ volatile("swapgs" ::: "memory");
+}
+
+// EOI goes out first: scheduler_tick may switch tasks and not return here for a while
+__attribute__((interrupt)) static void handler_irq_timer(struct interrupt_frame* frame) {
+    swapgs_if_user(frame); uint64_t start = rdtsc();
+    irq_eoi(0); timer_handler();
+    irq_account(IRQ_VECTOR_BASE, start);
+    scheduler_tick();
+    swapgs_if_user(frame);
+}
+__attribute__((interrupt)) static void handler_lapic_timer(struct interrupt_frame* frame) {
+    swapgs_if_user(frame); uint64_t start = rdtsc();
+    lapic_eoi(); timer_handler();
+    irq_account(LAPIC_TIMER_VECTOR, start);
+    scheduler_tick();
+    swapgs_if_user(frame);
+}
+// Sent by another CPU after it queued work or a timer for this one; the
+// timer path re-arms this CPU's deadline and reschedules if asked to
+__attribute__((interrupt)) static void handler_lapic_kick(struct interrupt_frame* frame) {
+    swapgs_if_user(frame); uint64_t start = rdtsc();
+    lapic_eoi(); timer_handler();
+    irq_account(LAPIC_KICK_VECTOR, start);
+    scheduler_tick();
+    swapgs_if_user(frame);
+}
+// Spurious LAPIC interrupts must not be acknowledged
+__attribute__((interrupt)) static void handler_lapic_spurious(struct interrupt_frame* frame) { (void)frame; irq_spurious(LAPIC_SPURIOUS_VECTOR); }
+__attribute__((interrupt)) static void handler_irq_mouse(struct interrupt_frame* frame) {
+    (void)frame; uint64_t start = rdtsc();
+    mouse_handle_interrupt(); irq_eoi(12);
+    irq_account(IRQ_VECTOR_BASE + 12, start);
+}
 
 static void idt_set_gate(uint8_t vector, void* handler) {
     uint64_t address = (uint64_t)handler;
@@ -191,8 +313,9 @@ static void idt_set_syscall_gate(uint8_t vector, void* handler) {
 void interrupts_init(void) {
     pic_remap_and_mask();
 
-    idt_set_gate(0, handler_0); idt_set_gate(1, handler_1); idt_set_gate(2, handler_2); idt_set_gate(3, handler_3);
+    idt_set_gate(0, handler_0); idt_set_gate(1, handler_1); idt_set_gate(3, handler_3);
     idt_set_gate(4, handler_4); idt_set_gate(5, handler_5); idt_set_gate(6, handler_6); idt_set_gate(7, handler_7);
+    idt_set_gate_with_ist(2, handler_2, 2);
     idt_set_gate_with_ist(8, handler_8, 1);
     idt_set_gate(9, handler_9); idt_set_gate(10, handler_10); idt_set_gate(11, handler_11); idt_set_gate(12, handler_12);
     idt_set_gate(13, handler_13); idt_set_gate(14, handler_14); idt_set_gate(15, handler_15); idt_set_gate(16, handler_16);
@@ -201,20 +324,106 @@ void interrupts_init(void) {
     idt_set_gate(25, handler_25); idt_set_gate(26, handler_26); idt_set_gate(27, handler_27); idt_set_gate(28, handler_28);
     idt_set_gate(29, handler_29); idt_set_gate(30, handler_30); idt_set_gate(31, handler_31);
 
-    for (uint8_t vector = 0x20; vector < 0x28; vector++) { idt_set_gate(vector, handler_irq_master); }
-    for (uint8_t vector = 0x28; vector < 0x30; vector++) { idt_set_gate(vector, handler_irq_slave); }
-
-    idt_set_gate(0x20, handler_irq_timer);
-    idt_set_gate(0x21, handler_irq_keyboard);
-    idt_set_gate(0x2C, handler_irq_mouse);
+    idt_set_gate(0x20, handler_irq_timer); idt_set_gate(0x21, handler_irq_keyboard); idt_set_gate(0x22, handler_irq_2);
+    idt_set_gate(0x23, handler_irq_3); idt_set_gate(0x24, handler_irq_4); idt_set_gate(0x25, handler_irq_5);
+    idt_set_gate(0x26, handler_irq_6); idt_set_gate(0x27, handler_irq_7); idt_set_gate(0x28, handler_irq_8);
+    idt_set_gate(0x29, handler_irq_9); idt_set_gate(0x2A, handler_irq_10); idt_set_gate(0x2B, handler_irq_11);
+    idt_set_gate(0x2C, handler_irq_mouse); idt_set_gate(0x2D, handler_irq_13); idt_set_gate(0x2E, handler_irq_14);
+    idt_set_gate(0x2F, handler_irq_15);
+    idt_set_gate(LAPIC_TIMER_VECTOR, handler_lapic_timer);
+    idt_set_gate(LAPIC_KICK_VECTOR, handler_lapic_kick);
+    idt_set_gate(LAPIC_SPURIOUS_VECTOR, handler_lapic_spurious);
     
     // Enable Syscall
     idt_set_syscall_gate(0x80, isr_syscall);
 
-    const struct idt_descriptor descriptor = { .limit = (uint16_t)(sizeof(g_idt) - 1), .base = (uint64_t)g_idt };
-    
     if (g_idt[8].selector != 0x08 || g_idt[8].ist != 1) { halt_on_invalid("Critical: IDT vector 8 misconfigured."); }
 
-    __asm__ volatile("lidt %0" : : "m"(descriptor));
+    interrupts_load_idt();
     syslog_write("Interrupts initialized with Syscall (0x80) support");
 }
+
+bool interrupts_init_apic(void) {
+    if (!lapic_available() && !lapic_init()) return false;
+    if (!ioapic_init()) {
+        syslog_write("Interrupts: Staying on the 8259 PIC");
+        return false;
+    }
+
+    uint64_t flags = irq_save();
+    uint16_t pic_mask = (uint16_t)(inb(PIC1_DATA) | (inb(PIC2_DATA) << 8));
+    uint8_t bsp = lapic_id();
+    for (uint8_t irq = 0; irq < 16; irq++) {
+        if (irq == IRQ_CASCADE) continue;
+        if (!ioapic_route_isa(irq, (uint8_t)(IRQ_VECTOR_BASE + irq), bsp)) continue;
+        if (!(pic_mask & (1u << irq))) ioapic_set_masked(irq, false);
+    }
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+    lapic_retire_pic();
+    g_apic_mode = true;
+    irq_restore(flags);
+
+    syslog_write("Interrupts: Device IRQs routed through the IOAPIC");
+    return true;
+}
+
+static bool vector_accounted(uint8_t vector) {
+    return (vector >= IRQ_VECTOR_BASE && vector < IRQ_VECTOR_BASE + 16) ||
+           vector == LAPIC_TIMER_VECTOR || vector == LAPIC_KICK_VECTOR ||
+           vector == LAPIC_SPURIOUS_VECTOR;
+}
+
+bool interrupts_get_stats(uint8_t vector, struct irq_stats* out) {
+    if (!vector_accounted(vector) || !out) return false;
+    const struct irq_stats* st = &g_irq_stats[vector];
+    out->count = __atomic_load_n(&st->count, __ATOMIC_RELAXED);
+    out->spurious = __atomic_load_n(&st->spurious, __ATOMIC_RELAXED);
+    out->cycles = __atomic_load_n(&st->cycles, __ATOMIC_RELAXED);
+    out->max_cycles = __atomic_load_n(&st->max_cycles, __ATOMIC_RELAXED);
+    return true;
+}
+
+size_t interrupts_snapshot(struct irq_info* out, size_t max) {
+    if (!out) return 0;
+    size_t count = 0;
+    for (int v = 0; v < 256 && count < max; v++) {
+        struct irq_stats st;
+        if (!interrupts_get_stats((uint8_t)v, &st) || (st.count == 0 && st.spurious == 0)) continue;
+        out[count].vector = (uint32_t)v;
+        out[count].stats = st;
+        count++;
+    }
+    return count;
+}
+
+void interrupts_reset_stats(void) {
+    for (int v = 0; v < 256; v++) {
+        struct irq_stats* st = &g_irq_stats[v];
+        __atomic_store_n(&st->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&st->spurious, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&st->cycles, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&st->max_cycles, 0, __ATOMIC_RELAXED);
+    }
+}
+
+const char* interrupts_vector_name(uint8_t vector) {
+    switch (vector) {
+        case IRQ_VECTOR_BASE + 0: return "timer";
+        case IRQ_VECTOR_BASE + 1: return "keyboard";
+        case IRQ_VECTOR_BASE + 7: return "lpt1";
+        case IRQ_VECTOR_BASE + 8: return "rtc";
+        case IRQ_VECTOR_BASE + 12: return "mouse";
+        case IRQ_VECTOR_BASE + 14: return "ata0";
+        case IRQ_VECTOR_BASE + 15: return "ata1";
+        case LAPIC_TIMER_VECTOR: return "lapic-timer";
+        case LAPIC_KICK_VECTOR: return "kick-ipi";
+        case LAPIC_SPURIOUS_VECTOR: return "lapic-spurious";
+        default: return NULL;
+    }
+}
+
+void interrupts_load_idt(void) {
+    const struct idt_descriptor descriptor = { .limit = (uint16_t)(sizeof(g_idt) - 1), .base = (uint64_t)g_idt };
+    __asm__ volatile("lidt %0" : : "m"(descriptor));
+}
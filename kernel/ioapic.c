@@ -0,0 +1,135 @@
+#include "ioapic.h"
+
+#include <stddef.h>
+#include "acpi.h"
+#include "paging.h"
+#include "spinlock.h"
+#include "syslog.h"
+
+#define IOAPIC_REG_SELECT   0x00
+#define IOAPIC_REG_WINDOW   0x10
+
+#define IOAPIC_VERSION      0x01
+#define IOAPIC_REDIR_BASE   0x10
+
+#define REDIR_ACTIVE_LOW    (1u << 13)
+#define REDIR_LEVEL         (1u << 15)
+#define REDIR_MASKED        (1u << 16)
+
+// MPS INTI flags of an interrupt source override
+#define INTI_POLARITY_MASK  0x3
+#define INTI_POLARITY_LOW   0x3
+#define INTI_TRIGGER_MASK   0xC
+#define INTI_TRIGGER_LEVEL  0xC
+
+#define ISA_IRQS            16
+
+struct ioapic {
+    volatile uint32_t* regs;
+    uint32_t gsi_base;
+    uint32_t inputs;        // Redirection entries
+};
+
+static struct ioapic g_ioapics[ACPI_MAX_IOAPICS];
+static uint8_t g_ioapic_count = 0;
+// Register select and window must be used as a pair
+static spinlock_t g_ioapic_lock = SPINLOCK_INIT("ioapic");
+static uint32_t g_isa_gsi[ISA_IRQS];
+
+static uint32_t ioapic_read(const struct ioapic* io, uint32_t reg) {
+    io->regs[IOAPIC_REG_SELECT / 4] = reg;
+    return io->regs[IOAPIC_REG_WINDOW / 4];
+}
+
+static void ioapic_write(const struct ioapic* io, uint32_t reg, uint32_t value) {
+    io->regs[IOAPIC_REG_SELECT / 4] = reg;
+    io->regs[IOAPIC_REG_WINDOW / 4] = value;
+}
+
+static const struct ioapic* ioapic_for_gsi(uint32_t gsi, uint32_t* input) {
+    for (uint8_t i = 0; i < g_ioapic_count; i++) {
+        const struct ioapic* io = &g_ioapics[i];
+        if (gsi >= io->gsi_base && gsi < io->gsi_base + io->inputs) {
+            *input = gsi - io->gsi_base;
+            return io;
+        }
+    }
+    return NULL;
+}
+
+static const struct acpi_irq_override* isa_override(uint8_t irq) {
+    const struct acpi_madt_info* madt = acpi_madt();
+    for (uint8_t i = 0; i < madt->override_count; i++) {
+        if (madt->overrides[i].source == irq) return &madt->overrides[i];
+    }
+    return NULL;
+}
+
+bool ioapic_init(void) {
+    if (!acpi_init() || acpi_madt()->ioapic_count == 0) {
+        syslog_write("IOAPIC: None described by ACPI");
+        return false;
+    }
+
+    const struct acpi_madt_info* madt = acpi_madt();
+    spin_lock_register(&g_ioapic_lock);
+    for (uint8_t i = 0; i < madt->ioapic_count; i++) {
+        const struct acpi_ioapic* desc = &madt->ioapics[i];
+        if (!paging_set_uncached(desc->address)) {
+            syslog_write("IOAPIC: Registers outside the direct map");
+            continue;
+        }
+        struct ioapic* io = &g_ioapics[g_ioapic_count++];
+        io->regs = (volatile uint32_t*)(uintptr_t)desc->address;
+        io->gsi_base = desc->gsi_base;
+        io->inputs = ((ioapic_read(io, IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+        for (uint32_t n = 0; n < io->inputs; n++) {
+            ioapic_write(io, IOAPIC_REDIR_BASE + n * 2, REDIR_MASKED);
+        }
+    }
+    for (uint8_t irq = 0; irq < ISA_IRQS; irq++) {
+        const struct acpi_irq_override* ov = isa_override(irq);
+        g_isa_gsi[irq] = ov ? ov->gsi : irq;
+    }
+
+    if (g_ioapic_count == 0) return false;
+    syslog_write("IOAPIC: Enabled");
+    return true;
+}
+
+bool ioapic_available(void) {
+    return g_ioapic_count != 0;
+}
+
+bool ioapic_route_isa(uint8_t irq, uint8_t vector, uint8_t apic_id) {
+    if (irq >= ISA_IRQS) return false;
+    uint32_t input;
+    const struct ioapic* io = ioapic_for_gsi(g_isa_gsi[irq], &input);
+    if (!io) return false;
+
+    // ISA defaults are edge triggered and active high unless overridden
+    uint32_t low = REDIR_MASKED | vector;
+    const struct acpi_irq_override* ov = isa_override(irq);
+    if (ov && (ov->flags & INTI_POLARITY_MASK) == INTI_POLARITY_LOW) low |= REDIR_ACTIVE_LOW;
+    if (ov && (ov->flags & INTI_TRIGGER_MASK) == INTI_TRIGGER_LEVEL) low |= REDIR_LEVEL;
+
+    uint64_t flags = spin_lock_irqsave(&g_ioapic_lock);
+    ioapic_write(io, IOAPIC_REDIR_BASE + input * 2, REDIR_MASKED);
+    ioapic_write(io, IOAPIC_REDIR_BASE + input * 2 + 1, (uint32_t)apic_id << 24);
+    ioapic_write(io, IOAPIC_REDIR_BASE + input * 2, low);
+    spin_unlock_irqrestore(&g_ioapic_lock, flags);
+    return true;
+}
+
+void ioapic_set_masked(uint8_t irq, bool masked) {
+    if (irq >= ISA_IRQS) return;
+    uint32_t input;
+    const struct ioapic* io = ioapic_for_gsi(g_isa_gsi[irq], &input);
+    if (!io) return;
+
+    uint64_t flags = spin_lock_irqsave(&g_ioapic_lock);
+    uint32_t low = ioapic_read(io, IOAPIC_REDIR_BASE + input * 2);
+    low = masked ? (low | REDIR_MASKED) : (low & ~REDIR_MASKED);
+    ioapic_write(io, IOAPIC_REDIR_BASE + input * 2, low);
+    spin_unlock_irqrestore(&g_ioapic_lock, flags);
+}
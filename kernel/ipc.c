@@ -0,0 +1,165 @@
+#include "ipc.h"
+
+#include <stddef.h>
+
+#include "heap.h"
+#include "syslog.h"
+#include "timer.h"
+
+struct channel* channel_create(uint32_t capacity) {
+    if (capacity == 0) return NULL;
+    struct channel* ch = (struct channel*)kmalloc_tagged(sizeof(struct channel), HEAP_TAG_IPC);
+    struct ipc_msg* ring = (struct ipc_msg*)kmalloc_tagged(capacity * sizeof(struct ipc_msg), HEAP_TAG_IPC);
+    if (!ch || !ring) {
+        syslog_write("IPC: Out of memory for a channel");
+        kfree(ch);
+        kfree(ring);
+        return NULL;
+    }
+    // Heap channels stay out of lockstat; its registry never shrinks
+    spin_lock_init(&ch->lock, "ipc.channel");
+    ch->ring = ring;
+    ch->capacity = capacity;
+    ch->head = 0;
+    ch->count = 0;
+    ch->refs = 1;
+    ch->closed = false;
+    ch->dynamic = true;
+    wait_queue_init(&ch->readers, "ipc.readers");
+    wait_queue_init(&ch->writers, "ipc.writers");
+    return ch;
+}
+
+void channel_get(struct channel* ch) {
+    uint64_t flags = spin_lock_irqsave(&ch->lock);
+    ch->refs++;
+    spin_unlock_irqrestore(&ch->lock, flags);
+}
+
+void channel_put(struct channel* ch) {
+    uint64_t flags = spin_lock_irqsave(&ch->lock);
+    uint32_t refs = --ch->refs;
+    if (refs == 1) ch->closed = true;
+    spin_unlock_irqrestore(&ch->lock, flags);
+
+    if (refs == 1) {
+        // Whoever is left must not sleep on a peer that is gone
+        wait_queue_wake_all(&ch->readers);
+        wait_queue_wake_all(&ch->writers);
+    } else if (refs == 0 && ch->dynamic) {
+        kfree(ch->ring);
+        kfree(ch);
+    }
+}
+
+void channel_reset(struct channel* ch) {
+    uint64_t flags = spin_lock_irqsave(&ch->lock);
+    ch->head = 0;
+    ch->count = 0;
+    ch->closed = false;
+    spin_unlock_irqrestore(&ch->lock, flags);
+}
+
+int channel_try_send(struct channel* ch, const struct ipc_msg* msg) {
+    uint64_t flags = spin_lock_irqsave(&ch->lock);
+    int ret = IPC_OK;
+    if (ch->closed) {
+        ret = IPC_ERR_CLOSED;
+    } else if (ch->count == ch->capacity) {
+        ret = IPC_ERR_AGAIN;
+    } else {
+        ch->ring[(ch->head + ch->count) % ch->capacity] = *msg;
+        __atomic_store_n(&ch->count, ch->count + 1, __ATOMIC_RELEASE);
+    }
+    spin_unlock_irqrestore(&ch->lock, flags);
+
+    if (ret == IPC_OK) wait_queue_wake_one(&ch->readers);
+    return ret;
+}
+
+static int channel_try_recv(struct channel* ch, struct ipc_msg* out) {
+    uint64_t flags = spin_lock_irqsave(&ch->lock);
+    int ret = IPC_OK;
+    if (ch->count == 0) {
+        ret = ch->closed ? IPC_ERR_CLOSED : IPC_ERR_AGAIN;
+    } else {
+        *out = ch->ring[ch->head];
+        ch->head = (ch->head + 1) % ch->capacity;
+        __atomic_store_n(&ch->count, ch->count - 1, __ATOMIC_RELEASE);
+    }
+    spin_unlock_irqrestore(&ch->lock, flags);
+
+    if (ret == IPC_OK) wait_queue_wake_one(&ch->writers);
+    return ret;
+}
+
+static bool channel_readable(struct channel* ch) {
+    return __atomic_load_n(&ch->count, __ATOMIC_ACQUIRE) != 0 ||
+           __atomic_load_n(&ch->closed, __ATOMIC_ACQUIRE);
+}
+
+static bool channel_writable(struct channel* ch) {
+    return __atomic_load_n(&ch->count, __ATOMIC_ACQUIRE) != ch->capacity ||
+           __atomic_load_n(&ch->closed, __ATOMIC_ACQUIRE);
+}
+
+int channel_send(struct channel* ch, const struct ipc_msg* msg) {
+    int ret;
+    while ((ret = channel_try_send(ch, msg)) == IPC_ERR_AGAIN) {
+        wait_event(&ch->writers, channel_writable(ch));
+    }
+    return ret;
+}
+
+static void recv_timed_out(void* arg) {
+    scheduler_wake((Task*)arg);
+}
+
+int channel_recv(struct channel* ch, struct ipc_msg* out, uint64_t timeout) {
+    int ret = channel_try_recv(ch, out);
+    if (ret != IPC_ERR_AGAIN || timeout == 0) return ret;
+
+    bool timed = timeout != IPC_WAIT_FOREVER;
+    struct timer t = {0};
+    if (timed) timer_add(&t, timer_get_ticks() + timeout, recv_timed_out, scheduler_current_task());
+
+    while ((ret = channel_try_recv(ch, out)) == IPC_ERR_AGAIN) {
+        if (timed && !__atomic_load_n(&t.pending, __ATOMIC_ACQUIRE)) break;
+        wait_event(&ch->readers, channel_readable(ch) ||
+                   (timed && !__atomic_load_n(&t.pending, __ATOMIC_ACQUIRE)));
+    }
+    // Also waits out recv_timed_out if it is still waking us on CPU 0: 't'
+    // is on this stack and the task may exit as soon as we return
+    if (timed) timer_cancel(&t);
+    return ret;
+}
+
+int ipc_handle_install(Task* task, struct channel* ch) {
+    for (int i = 0; i < TASK_MAX_HANDLES; i++) {
+        if (task->handles[i] == NULL) {
+            channel_get(ch);
+            task->handles[i] = ch;
+            return i;
+        }
+    }
+    return IPC_ERR_NOSPC;
+}
+
+struct channel* ipc_handle_get(Task* task, int handle) {
+    if (!task || handle < 0 || handle >= TASK_MAX_HANDLES) return NULL;
+    return task->handles[handle];
+}
+
+int ipc_handle_close(Task* task, int handle) {
+    struct channel* ch = ipc_handle_get(task, handle);
+    if (!ch) return IPC_ERR_BADF;
+    task->handles[handle] = NULL;
+    channel_put(ch);
+    return IPC_OK;
+}
+
+void ipc_release_handles(Task* task) {
+    for (int i = 0; i < TASK_MAX_HANDLES; i++) {
+        if (task->handles[i]) ipc_handle_close(task, i);
+    }
+}
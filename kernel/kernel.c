@@ -3,7 +3,6 @@
 
 #include "background.h"
 #include "fs.h"
-#include "memtest.h"
 #include "shell.h"
 #include "system.h"
 #include "syslog.h"
@@ -12,8 +11,16 @@
 #include "mouse.h" // Added include for mouse
 #include "timer.h" 
 #include "banner.h"
+#include "fpu.h"
 #include "heap.h"
+#include "interrupts.h"
+#include "paging.h"
+#include "pmm.h"
 #include "scheduler.h"
+#include "rtc.h"
+#include "smp.h"
+#include "syscall.h"
+#include "workqueue.h"
 #include "gui_demo.h"
 #include "kstdio.h"
 
@@ -24,22 +31,35 @@ static void boot_sequence(const struct BootInfo* boot_info) {
     system_cache_boot_info(boot_info);
     const struct BootInfo* cached = system_boot_info();
 
+    // 1. Take over physical memory; everything below allocates from it
+    pmm_init(cached);
+    system_set_total_memory((uint32_t)(pmm_total_pages() * (PMM_PAGE_SIZE / 1024)));
+
     terminal_initialize(cached->width, cached->height);
     
-    // 1. Initialize Heap (16MB starting at 8MB mark)
-    heap_init((void*)0x800000, 16 * 1024 * 1024);
+    // Initialize Heap (reserved virtual range, mapped on demand)
+    heap_init((void*)PAGING_HEAP_BASE, PAGING_HEAP_SIZE);
+
+    // SSE/AVX for tasks; needs the heap for its save areas
+    fpu_init();
 
     // 2. Initialize Interrupts, Timer & Input
     timer_init();
+    interrupts_init_apic();
     keyboard_init();
     mouse_init(); // Initialize Mouse Driver
-    
-    size_t memory_bytes = memtest_detect_upper_limit();
-    system_set_total_memory((uint32_t)(memory_bytes / 1024));
+    rtc_init();
+    syscall_init();
 
     // 3. Initialize Scheduler
     scheduler_init();
 
+    // 4. Bring up the other CPUs; each joins the scheduler as it comes online
+    smp_init();
+
+    // Worker threads for deferred work, one per CPU
+    workqueue_init();
+
     background_render();
     timer_set_callback(background_animate);
     
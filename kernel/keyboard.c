@@ -7,6 +7,9 @@
 #include "kstring.h"
 #include "terminal.h"
 #include "interrupts.h"
+#include "ipc.h"
+#include "spinlock.h"
+#include "waitqueue.h"
 
 /* --- Constants & Macros --- */
 
@@ -32,6 +35,14 @@ static volatile uint8_t g_kb_buffer[SCANCODE_BUFFER_SIZE];
 static volatile size_t g_kb_head = 0;
 static volatile size_t g_kb_tail = 0;
 
+// The IRQ is the only producer and publishes g_kb_head with a release
+// store, so it takes no lock. Consumers serialize on a plain spinlock
+// (the GUI polls from Ring 3, where cli is not allowed); the IRQ never
+// takes it, so an interrupted holder cannot deadlock it.
+static spinlock_t g_kb_consumer_lock = SPINLOCK_INIT("keyboard");
+static struct wait_queue g_kb_waiters = WAIT_QUEUE_INIT("keyboard.wait");
+static struct channel* g_kb_events = NULL;
+
 static bool g_shift_l = false;
 static bool g_shift_r = false;
 static bool g_caps_lock = false;
@@ -75,32 +86,55 @@ static const struct keymap_entry KEYMAP_SET1[128] = {
 void keyboard_init(void) {
     g_kb_head = 0;
     g_kb_tail = 0;
+    spin_lock_register(&g_kb_consumer_lock);
     interrupts_enable_irq(1); // Unmask Keyboard IRQ
 }
 
 /* Called from ISR */
 void keyboard_push_byte(uint8_t byte) {
-    size_t next = (g_kb_head + 1) & SCANCODE_BUFFER_MASK;
-    if (next != g_kb_tail) {
-        g_kb_buffer[g_kb_head] = byte;
-        g_kb_head = next;
+    size_t head = g_kb_head;
+    size_t next = (head + 1) & SCANCODE_BUFFER_MASK;
+    if (next != __atomic_load_n(&g_kb_tail, __ATOMIC_ACQUIRE)) {
+        g_kb_buffer[head] = byte;
+        __atomic_store_n(&g_kb_head, next, __ATOMIC_RELEASE);
+        wait_queue_wake_all(&g_kb_waiters);
+
+        struct channel* events = __atomic_load_n(&g_kb_events, __ATOMIC_ACQUIRE);
+        if (events) {
+            // A full channel already has a notification queued
+            struct ipc_msg msg = { .type = IPC_MSG_KEYBOARD };
+            channel_try_send(events, &msg);
+        }
     }
 }
 
-static uint8_t keyboard_pop_byte(void) {
-    while (g_kb_head == g_kb_tail) {
-        __asm__ volatile("hlt");
-    }
-    uint8_t byte = g_kb_buffer[g_kb_tail];
-    g_kb_tail = (g_kb_tail + 1) & SCANCODE_BUFFER_MASK;
-    return byte;
+void keyboard_set_event_channel(struct channel* ch) {
+    __atomic_store_n(&g_kb_events, ch, __ATOMIC_RELEASE);
+}
+
+static bool keyboard_has_input(void) {
+    return __atomic_load_n(&g_kb_head, __ATOMIC_ACQUIRE) != g_kb_tail;
 }
 
 static bool keyboard_try_pop_byte(uint8_t* out) {
-    if (g_kb_head == g_kb_tail) return false;
-    *out = g_kb_buffer[g_kb_tail];
-    g_kb_tail = (g_kb_tail + 1) & SCANCODE_BUFFER_MASK;
-    return true;
+    spin_lock(&g_kb_consumer_lock);
+    size_t tail = g_kb_tail;
+    bool ok = __atomic_load_n(&g_kb_head, __ATOMIC_ACQUIRE) != tail;
+    if (ok) {
+        *out = g_kb_buffer[tail];
+        __atomic_store_n(&g_kb_tail, (tail + 1) & SCANCODE_BUFFER_MASK, __ATOMIC_RELEASE);
+    }
+    spin_unlock(&g_kb_consumer_lock);
+    return ok;
+}
+
+// Kernel callers only: sleeps until a byte arrives
+static uint8_t keyboard_pop_byte(void) {
+    uint8_t byte;
+    while (!keyboard_try_pop_byte(&byte)) {
+        wait_event(&g_kb_waiters, keyboard_has_input());
+    }
+    return byte;
 }
 
 /* --- Translation Logic --- */
@@ -310,8 +344,13 @@ void keyboard_read_line_ex(char* buffer, size_t size, keyboard_idle_callback_t o
         // Polling loop
         uint16_t raw = 0;
         while (!keyboard_poll_scancode(&raw)) {
-            if (on_idle) on_idle();
-            
+            if (!on_idle) {
+                // Sleep until the IRQ queues input; other tasks get the CPU
+                wait_event(&g_kb_waiters, keyboard_has_input());
+                continue;
+            }
+            on_idle();
+
             // Wait for interrupt (Timer IRQ 100Hz or Keyboard IRQ)
             // This prevents the CPU from spinning at 100% and running animations too fast
             __asm__ volatile("hlt"); 
@@ -0,0 +1,136 @@
+#include "lapic.h"
+
+#include "cpu.h"
+#include "interrupts.h"
+#include "paging.h"
+#include "syslog.h"
+
+#define IA32_APIC_BASE_MSR    0x1B
+#define APIC_BASE_ENABLE      (1ull << 11)
+#define APIC_BASE_ADDR_MASK   0xFFFFFF000ull
+
+#define CPUID_FEAT_EDX_APIC   (1u << 9)
+
+// Register offsets
+#define LAPIC_REG_ID          0x020
+#define LAPIC_REG_TPR         0x080
+#define LAPIC_REG_EOI         0x0B0
+#define LAPIC_REG_SVR         0x0F0
+#define LAPIC_REG_ICR_LOW     0x300
+#define LAPIC_REG_ICR_HIGH    0x310
+#define LAPIC_REG_LVT_TIMER   0x320
+#define LAPIC_REG_LVT_LINT0   0x350
+#define LAPIC_REG_LVT_LINT1   0x360
+#define LAPIC_REG_TIMER_INIT  0x380
+#define LAPIC_REG_TIMER_CUR   0x390
+#define LAPIC_REG_TIMER_DIV   0x3E0
+
+#define LAPIC_SVR_ENABLE      0x100
+#define LAPIC_LVT_MASKED      (1u << 16)
+#define LAPIC_DELIVERY_EXTINT 0x700
+#define LAPIC_DELIVERY_NMI    0x400
+#define LAPIC_TIMER_DIV_16    0x3
+
+#define ICR_DELIVERY_NMI      0x400
+#define ICR_DELIVERY_INIT     0x500
+#define ICR_DELIVERY_STARTUP  0x600
+#define ICR_LEVEL_ASSERT      0x4000
+#define ICR_SEND_PENDING      0x1000
+
+static volatile uint32_t* g_lapic = NULL;
+static bool g_pic_retired = false;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return g_lapic[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    g_lapic[reg / 4] = value;
+}
+
+bool lapic_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEAT_EDX_APIC)) {
+        syslog_write("LAPIC: Not present");
+        return false;
+    }
+
+    uint64_t base = rdmsr(IA32_APIC_BASE_MSR);
+    uint64_t phys = base & APIC_BASE_ADDR_MASK;
+    if (!paging_set_uncached(phys)) {
+        syslog_write("LAPIC: Registers outside the direct map");
+        return false;
+    }
+    wrmsr(IA32_APIC_BASE_MSR, base | APIC_BASE_ENABLE);
+    g_lapic = (volatile uint32_t*)phys;
+
+    // Virtual wire: the PIC stays on LINT0, NMIs on LINT1
+    lapic_write(LAPIC_REG_LVT_LINT0, g_pic_retired ? LAPIC_LVT_MASKED : LAPIC_DELIVERY_EXTINT);
+    lapic_write(LAPIC_REG_LVT_LINT1, LAPIC_DELIVERY_NMI);
+    lapic_write(LAPIC_REG_TPR, 0);
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+
+    lapic_write(LAPIC_REG_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_VECTOR);
+
+    syslog_write("LAPIC: Enabled");
+    return true;
+}
+
+void lapic_retire_pic(void) {
+    g_pic_retired = true;
+    lapic_write(LAPIC_REG_LVT_LINT0, LAPIC_LVT_MASKED);
+}
+
+bool lapic_available(void) {
+    return g_lapic != NULL;
+}
+
+uint8_t lapic_id(void) {
+    return g_lapic ? (uint8_t)(lapic_read(LAPIC_REG_ID) >> 24) : 0;
+}
+
+static void lapic_send(uint8_t apic_id, uint32_t command) {
+    uint64_t flags = irq_save();
+    while (lapic_read(LAPIC_REG_ICR_LOW) & ICR_SEND_PENDING) {
+        __asm__ volatile("pause");
+    }
+    lapic_write(LAPIC_REG_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_REG_ICR_LOW, command);
+    irq_restore(flags);
+}
+
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector) {
+    lapic_send(apic_id, ICR_LEVEL_ASSERT | vector);
+}
+
+void lapic_send_nmi(uint8_t apic_id) {
+    lapic_send(apic_id, ICR_LEVEL_ASSERT | ICR_DELIVERY_NMI);
+}
+
+void lapic_send_init(uint8_t apic_id) {
+    lapic_send(apic_id, ICR_LEVEL_ASSERT | ICR_DELIVERY_INIT);
+}
+
+void lapic_send_startup(uint8_t apic_id, uint8_t page) {
+    lapic_send(apic_id, ICR_LEVEL_ASSERT | ICR_DELIVERY_STARTUP | page);
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_REG_EOI, 0);
+}
+
+void lapic_timer_oneshot(uint32_t count) {
+    // One-shot is mode 0, so only the vector and mask bit matter
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_REG_TIMER_INIT, count);
+}
+
+void lapic_timer_stop(void) {
+    lapic_write(LAPIC_REG_TIMER_INIT, 0);
+}
+
+uint32_t lapic_timer_current(void) {
+    return lapic_read(LAPIC_REG_TIMER_CUR);
+}
@@ -0,0 +1,27 @@
+#include "spinlock.h"
+
+#include <stddef.h>
+
+// Locks register once at init and are never removed
+static struct lock_stats* g_registered = NULL;
+
+void lockstat_register(struct lock_stats* stats) {
+    struct lock_stats* head = __atomic_load_n(&g_registered, __ATOMIC_RELAXED);
+    do {
+        stats->next = head;
+    } while (!__atomic_compare_exchange_n(&g_registered, &head, stats, false,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+const struct lock_stats* lockstat_first(void) {
+    return __atomic_load_n(&g_registered, __ATOMIC_ACQUIRE);
+}
+
+// Racy against holders updating their counters, which is fine for a reset
+void lockstat_reset(void) {
+    for (struct lock_stats* s = g_registered; s; s = s->next) {
+        s->acquired = 0;
+        s->contended = 0;
+        s->waits = 0;
+    }
+}
@@ -2,7 +2,9 @@
 #include "io.h"
 #include "interrupts.h"
 #include "graphics.h"
+#include "ipc.h"
 #include "syslog.h"
+#include "vdso.h"
 
 #define MOUSE_PORT_DATA    0x60
 #define MOUSE_PORT_STATUS  0x64
@@ -15,6 +17,7 @@ static int     g_mouse_y = 0;
 static bool    g_left_btn = false;
 static bool    g_right_btn = false;
 static int     g_sensitivity = 1;
+static struct channel* g_mouse_events = NULL;
 
 static void mouse_wait(bool type) {
     uint32_t timeout = 100000;
@@ -82,6 +85,8 @@ void mouse_init(void) {
     g_mouse_y = (h > 0) ? h / 2 : 300;
     g_sensitivity = 1;
     g_mouse_cycle = 0;
+    MouseState initial = mouse_get_state();
+    vdso_update_mouse(&initial);
 
     // Unmask IRQ 12 (Slave PIC line 4)
     interrupts_enable_irq(12);
@@ -162,10 +167,23 @@ void mouse_handle_interrupt(void) {
             // Buttons
             g_left_btn = (g_mouse_byte[0] & 0x01) != 0;
             g_right_btn = (g_mouse_byte[0] & 0x02) != 0;
+
+            MouseState state = mouse_get_state();
+            vdso_update_mouse(&state);
+
+            struct channel* events = __atomic_load_n(&g_mouse_events, __ATOMIC_ACQUIRE);
+            if (events) {
+                struct ipc_msg msg = { .type = IPC_MSG_MOUSE };
+                channel_try_send(events, &msg);
+            }
             break;
     }
 }
 
+void mouse_set_event_channel(struct channel* ch) {
+    __atomic_store_n(&g_mouse_events, ch, __ATOMIC_RELEASE);
+}
+
 MouseState mouse_get_state(void) {
     MouseState s;
     s.x = g_mouse_x;
@@ -0,0 +1,52 @@
+#include "mutex.h"
+
+#include <stddef.h>
+
+void mutex_init(struct mutex* m, const char* name) {
+    m->owner = NULL;
+    wait_queue_init(&m->waiters, name);
+    m->stats = (struct lock_stats)LOCK_STATS_INIT(name);
+}
+
+void mutex_register(struct mutex* m) {
+    lockstat_register(&m->stats);
+}
+
+// Before the scheduler starts there is a single thread of execution;
+// any non-NULL owner token will do
+static Task* owner_token(void) {
+    Task* self = scheduler_current_task();
+    return self ? self : (Task*)1;
+}
+
+static bool try_acquire(struct mutex* m, Task* self) {
+    Task* expected = NULL;
+    return __atomic_compare_exchange_n(&m->owner, &expected, self, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+bool mutex_trylock(struct mutex* m) {
+    if (!try_acquire(m, owner_token())) return false;
+    m->stats.acquired++;
+    return true;
+}
+
+void mutex_lock(struct mutex* m) {
+    Task* self = owner_token();
+    if (try_acquire(m, self)) {
+        m->stats.acquired++;
+        return;
+    }
+
+    uint64_t attempts = 0;
+    wait_event(&m->waiters, (attempts++, try_acquire(m, self)));
+    m->stats.acquired++;
+    m->stats.contended++;
+    // Every attempt but the last one was followed by a sleep
+    m->stats.waits += attempts - 1;
+}
+
+void mutex_unlock(struct mutex* m) {
+    __atomic_store_n(&m->owner, NULL, __ATOMIC_RELEASE);
+    wait_queue_wake_one(&m->waiters);
+}
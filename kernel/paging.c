@@ -3,16 +3,22 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include "pmm.h"
+#include "smp.h"
 #include "syslog.h"
 #include "system.h"
 
 #define PAGE_PRESENT (1ull << 0)
 #define PAGE_RW      (1ull << 1)
 #define PAGE_USER    (1ull << 2) // Allow Ring 3
+#define PAGE_PWT     (1ull << 3)
+#define PAGE_PCD     (1ull << 4)
 #define PAGE_PS      (1ull << 7) 
+#define PAGE_ADDR_MASK 0x000FFFFFFFFFF000ull
 
 #define PAGE_SIZE       0x1000ull
 #define HUGE_PAGE_SIZE  0x200000ull
+#define DECOMMIT_BATCH  32          // Frames held back per TLB shootdown
 
 extern uint8_t __text_start[];
 extern uint8_t __text_end[];
@@ -23,7 +29,7 @@ extern uint8_t __bss_end[];
 
 static uint64_t g_pml4[512] __attribute__((aligned(PAGE_SIZE)));
 static uint64_t g_pdpt[512] __attribute__((aligned(PAGE_SIZE)));
-static uint64_t g_pd[512] __attribute__((aligned(PAGE_SIZE)));
+static uint64_t g_pd[PAGING_DIRECT_MAP_GB][512] __attribute__((aligned(PAGE_SIZE)));
 static uint64_t g_kernel_pt[512] __attribute__((aligned(PAGE_SIZE)));
 static uint64_t g_framebuffer_pd[512] __attribute__((aligned(PAGE_SIZE)));
 
@@ -38,14 +44,16 @@ static void initialize_identity_map(const struct BootInfo* boot_info) {
     uint64_t flags = PAGE_PRESENT | PAGE_RW | PAGE_USER;
 
     g_pml4[0] = (uint64_t)g_pdpt | flags;
-    g_pdpt[0] = (uint64_t)g_pd | flags;
 
-    // 0-1GB
-    g_pd[0] = (uint64_t)g_kernel_pt | flags;
-    for (size_t i = 1; i < 512; i++) {
-        uint64_t base = (uint64_t)i * HUGE_PAGE_SIZE;
-        g_pd[i] = base | flags | PAGE_PS;
+    // 0-4GB direct map, so every frame the PMM hands out is addressable
+    for (size_t gb = 0; gb < PAGING_DIRECT_MAP_GB; gb++) {
+        g_pdpt[gb] = (uint64_t)g_pd[gb] | flags;
+        for (size_t i = 0; i < 512; i++) {
+            uint64_t base = ((uint64_t)gb << 30) + (uint64_t)i * HUGE_PAGE_SIZE;
+            g_pd[gb][i] = base | flags | PAGE_PS;
+        }
     }
+    g_pd[0][0] = (uint64_t)g_kernel_pt | flags;
 
     // 0-2MB (4KB pages)
     for (size_t i = 0; i < 512; i++) {
@@ -58,7 +66,8 @@ static void initialize_identity_map(const struct BootInfo* boot_info) {
         size_t pdpt_idx = (fb >> 30) & 0x1FF;
         size_t pd_idx   = (fb >> 21) & 0x1FF;
         
-        if (pdpt_idx > 0) {
+        // Framebuffers below 4GB are already covered by the direct map
+        if (pdpt_idx >= PAGING_DIRECT_MAP_GB) {
             g_pdpt[pdpt_idx] = (uint64_t)g_framebuffer_pd | flags;
             for (size_t i = 0; i < 8; i++) {
                 if (pd_idx + i < 512) {
@@ -80,3 +89,84 @@ void paging_init(const struct BootInfo* boot_info) {
     load_new_tables();
     syslog_write("Paging: Initialized (User Access Enabled)");
 }
+
+// Returns the table an entry points to, allocating an empty one if asked.
+// Fails on entries covered by a large page (the direct map is never split).
+static uint64_t* next_table(uint64_t* table, size_t index, bool create) {
+    uint64_t entry = table[index];
+    if (entry & PAGE_PRESENT) {
+        if (entry & PAGE_PS) return NULL;
+        return (uint64_t*)(entry & PAGE_ADDR_MASK);
+    }
+    if (!create) return NULL;
+
+    uint64_t* fresh = (uint64_t*)pmm_alloc_pages(1);
+    if (!fresh) return NULL;
+    for (size_t i = 0; i < 512; i++) fresh[i] = 0;
+    table[index] = (uint64_t)fresh | PAGE_PRESENT | PAGE_RW | PAGE_USER;
+    return fresh;
+}
+
+static uint64_t* lookup_pte(uint64_t virt, bool create) {
+    uint64_t* pdpt = next_table(g_pml4, (virt >> 39) & 0x1FF, create);
+    if (!pdpt) return NULL;
+    uint64_t* pd = next_table(pdpt, (virt >> 30) & 0x1FF, create);
+    if (!pd) return NULL;
+    uint64_t* pt = next_table(pd, (virt >> 21) & 0x1FF, create);
+    if (!pt) return NULL;
+    return &pt[(virt >> 12) & 0x1FF];
+}
+
+bool paging_map_page(uint64_t virt, uint64_t phys) {
+    uint64_t* pte = lookup_pte(virt, true);
+    if (!pte || (*pte & PAGE_PRESENT)) return false;
+    *pte = (phys & PAGE_ADDR_MASK) | PAGE_PRESENT | PAGE_RW | PAGE_USER;
+    return true;
+}
+
+uint64_t paging_unmap_page(uint64_t virt) {
+    uint64_t* pte = lookup_pte(virt, false);
+    if (!pte || !(*pte & PAGE_PRESENT)) return 0;
+    uint64_t phys = *pte & PAGE_ADDR_MASK;
+    *pte = 0;
+    __asm__ volatile("invlpg (%0)" : : "r"(virt) : "memory");
+    return phys;
+}
+
+bool paging_commit(uint64_t virt, size_t pages) {
+    for (size_t i = 0; i < pages; i++) {
+        void* frame = pmm_alloc_pages(1);
+        if (!frame || !paging_map_page(virt + i * PAGE_SIZE, (uint64_t)frame)) {
+            if (frame) pmm_free_pages(frame, 1);
+            paging_decommit(virt, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+void paging_decommit(uint64_t virt, size_t pages) {
+    uint64_t frames[DECOMMIT_BATCH];
+    while (pages > 0) {
+        size_t batch = pages < DECOMMIT_BATCH ? pages : DECOMMIT_BATCH;
+        size_t count = 0;
+        for (size_t i = 0; i < batch; i++) {
+            uint64_t phys = paging_unmap_page(virt + i * PAGE_SIZE);
+            if (phys) frames[count++] = phys;
+        }
+        // Other CPUs may still cache the old translations and write through
+        // them; the frames go back to the PMM only once they are flushed
+        if (count) smp_tlb_shootdown(virt, batch);
+        for (size_t i = 0; i < count; i++) pmm_free_pages((void*)frames[i], 1);
+        virt += batch * PAGE_SIZE;
+        pages -= batch;
+    }
+}
+
+bool paging_set_uncached(uint64_t phys) {
+    if (phys >= PAGING_DIRECT_MAP_LIMIT) return false;
+    uint64_t* entry = &g_pd[phys >> 30][(phys >> 21) & 0x1FF];
+    *entry |= PAGE_PCD | PAGE_PWT;
+    __asm__ volatile("invlpg (%0)" : : "r"(align_down(phys, HUGE_PAGE_SIZE)) : "memory");
+    return true;
+}
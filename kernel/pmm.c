@@ -0,0 +1,193 @@
+#include "pmm.h"
+
+#include "paging.h"
+#include "memtest.h"
+#include "spinlock.h"
+#include "syslog.h"
+
+/*
+ * One bit per frame, set = used. Everything starts out used; the usable
+ * E820 ranges are then released, and anything the kernel already sits on
+ * is reserved again. Allocation is next-fit over 64-bit words so runs of
+ * fully used memory are skipped quickly.
+ */
+
+#define PMM_MAX_PAGES   (PAGING_DIRECT_MAP_LIMIT / PMM_PAGE_SIZE)
+#define PMM_WORDS       (PMM_MAX_PAGES / 64)
+
+// Low memory, the kernel image and the boot stack (top at 0x3FF000)
+#define PMM_RESERVED_LOW (4 * 1024 * 1024)
+
+extern uint8_t __kernel_end[];
+
+static uint64_t g_bitmap[PMM_WORDS];
+static size_t g_page_limit = 0;   // Frames at or above this index are never handed out
+static size_t g_total_pages = 0;  // Usable frames reported by the firmware
+static size_t g_free_pages = 0;
+static size_t g_next_hint = 0;    // Word index where the next search starts
+static uint64_t g_memory_top = 0;
+static spinlock_t g_pmm_lock = SPINLOCK_INIT("pmm");
+
+static inline bool frame_used(size_t frame) {
+    return (g_bitmap[frame / 64] >> (frame % 64)) & 1;
+}
+
+static inline void frame_set(size_t frame) {
+    g_bitmap[frame / 64] |= 1ull << (frame % 64);
+}
+
+static inline void frame_clear(size_t frame) {
+    g_bitmap[frame / 64] &= ~(1ull << (frame % 64));
+}
+
+static void mark_range(uint64_t base, uint64_t length, bool used) {
+    if (length == 0) return;
+
+    // Free ranges shrink inward, reserved ranges grow outward
+    uint64_t start = used ? base / PMM_PAGE_SIZE : (base + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE;
+    uint64_t end = used ? (base + length + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE : (base + length) / PMM_PAGE_SIZE;
+    if (end > g_page_limit) end = g_page_limit;
+
+    for (uint64_t frame = start; frame < end; frame++) {
+        if (used && !frame_used(frame)) {
+            frame_set(frame);
+            g_free_pages--;
+        } else if (!used && frame_used(frame)) {
+            frame_clear(frame);
+            g_free_pages++;
+        }
+    }
+}
+
+static void add_usable(uint64_t base, uint64_t length) {
+    uint64_t end = base + length;
+    if (end > g_memory_top) g_memory_top = end;
+    g_total_pages += length / PMM_PAGE_SIZE;
+    mark_range(base, length, false);
+}
+
+void pmm_init(const struct BootInfo* boot_info) {
+    spin_lock_register(&g_pmm_lock);
+    for (size_t i = 0; i < PMM_WORDS; i++) g_bitmap[i] = ~0ull;
+    g_page_limit = PMM_MAX_PAGES;
+    g_total_pages = 0;
+    g_free_pages = 0;
+    g_next_hint = 0;
+    g_memory_top = 0;
+
+    const struct e820_entry* map = NULL;
+    if (boot_info && boot_info->e820_count != 0 && boot_info->e820_map != 0) {
+        map = (const struct e820_entry*)(uintptr_t)boot_info->e820_map;
+    }
+
+    if (map) {
+        for (uint32_t i = 0; i < boot_info->e820_count; i++) {
+            if (map[i].type == E820_TYPE_USABLE) add_usable(map[i].base, map[i].length);
+        }
+        // Firmware maps may overlap; a reserved range always wins
+        for (uint32_t i = 0; i < boot_info->e820_count; i++) {
+            if (map[i].type != E820_TYPE_USABLE) mark_range(map[i].base, map[i].length, true);
+        }
+        syslog_write("PMM: Using BIOS E820 memory map");
+    } else {
+        // No map from the bootloader: fall back to the write probe
+        add_usable(0, memtest_detect_upper_limit());
+        syslog_write("PMM: No E820 map, probed RAM instead");
+    }
+
+    uint64_t reserved = PMM_RESERVED_LOW;
+    if ((uint64_t)(uintptr_t)__kernel_end > reserved) {
+        reserved = (uint64_t)(uintptr_t)__kernel_end;
+    }
+    mark_range(0, reserved, true);
+
+    if (g_memory_top > PAGING_DIRECT_MAP_LIMIT) {
+        syslog_write("PMM: RAM above 4GB is not direct mapped, ignored");
+    }
+}
+
+static void* alloc_locked(size_t count) {
+    if (count == 0 || count > g_free_pages) return NULL;
+
+    size_t words = (g_page_limit + 63) / 64;
+    size_t run_start = 0;
+    size_t run_length = 0;
+
+    // Two passes: from the hint to the end, then the whole bitmap
+    for (size_t pass = 0; pass < 2; pass++) {
+        run_length = 0;
+
+        for (size_t word = pass == 0 ? g_next_hint : 0; word < words; word++) {
+            if (g_bitmap[word] == ~0ull) {
+                run_length = 0;
+                continue;
+            }
+            for (size_t bit = 0; bit < 64; bit++) {
+                size_t frame = word * 64 + bit;
+                if (frame >= g_page_limit || frame_used(frame)) {
+                    run_length = 0;
+                    continue;
+                }
+                if (run_length == 0) run_start = frame;
+                if (++run_length == count) {
+                    for (size_t f = run_start; f < run_start + count; f++) frame_set(f);
+                    g_free_pages -= count;
+                    g_next_hint = (run_start + count) / 64;
+                    return (void*)(uintptr_t)((uint64_t)run_start * PMM_PAGE_SIZE);
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void* pmm_alloc_pages(size_t count) {
+    uint64_t flags = spin_lock_irqsave(&g_pmm_lock);
+    void* frames = alloc_locked(count);
+    spin_unlock_irqrestore(&g_pmm_lock, flags);
+    if (!frames && count != 0) syslog_write("PMM: Out of physical memory");
+    return frames;
+}
+
+void pmm_free_pages(void* addr, size_t count) {
+    uint64_t base = (uint64_t)(uintptr_t)addr;
+    if (addr == NULL || base % PMM_PAGE_SIZE != 0) {
+        syslog_write("PMM: Free of unaligned frame");
+        return;
+    }
+
+    size_t first = (size_t)(base / PMM_PAGE_SIZE);
+    if (first + count > g_page_limit) {
+        syslog_write("PMM: Free outside managed memory");
+        return;
+    }
+
+    size_t double_frees = 0;
+    uint64_t flags = spin_lock_irqsave(&g_pmm_lock);
+    for (size_t frame = first; frame < first + count; frame++) {
+        if (!frame_used(frame)) {
+            double_frees++;
+            continue;
+        }
+        frame_clear(frame);
+        g_free_pages++;
+    }
+
+    if (first / 64 < g_next_hint) g_next_hint = first / 64;
+    spin_unlock_irqrestore(&g_pmm_lock, flags);
+
+    if (double_frees) syslog_write("PMM: Double free of frame");
+}
+
+size_t pmm_total_pages(void) {
+    return g_total_pages;
+}
+
+size_t pmm_free_page_count(void) {
+    return g_free_pages;
+}
+
+uint64_t pmm_memory_top(void) {
+    return g_memory_top;
+}
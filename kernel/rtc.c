@@ -0,0 +1,143 @@
+#include "rtc.h"
+
+#include <stdbool.h>
+#include "clocksource.h"
+#include "io.h"
+#include "syslog.h"
+
+#define CMOS_ADDRESS 0x70
+#define CMOS_DATA    0x71
+
+#define RTC_SECONDS  0x00
+#define RTC_MINUTES  0x02
+#define RTC_HOURS    0x04
+#define RTC_DAY      0x07
+#define RTC_MONTH    0x08
+#define RTC_YEAR     0x09
+#define RTC_STATUS_A 0x0A
+#define RTC_STATUS_B 0x0B
+
+#define RTC_A_UPDATING  0x80
+#define RTC_B_24HOUR    0x02
+#define RTC_B_BINARY    0x04
+#define RTC_HOUR_PM     0x80
+
+#define SECS_PER_DAY    86400ull
+#define NSEC_PER_SEC    1000000000ull
+
+static uint64_t g_boot_unix = 0;    // RTC reading at rtc_init
+static uint64_t g_boot_ns = 0;      // clock_monotonic_ns at that moment
+
+static uint8_t cmos_read(uint8_t reg) {
+    outb(CMOS_ADDRESS, reg);
+    return inb(CMOS_DATA);
+}
+
+static uint8_t bcd_to_bin(uint8_t value) {
+    return (uint8_t)((value & 0x0F) + (value >> 4) * 10);
+}
+
+static void cmos_read_raw(struct rtc_time* t) {
+    while (cmos_read(RTC_STATUS_A) & RTC_A_UPDATING) {}
+    t->second = cmos_read(RTC_SECONDS);
+    t->minute = cmos_read(RTC_MINUTES);
+    t->hour = cmos_read(RTC_HOURS);
+    t->day = cmos_read(RTC_DAY);
+    t->month = cmos_read(RTC_MONTH);
+    t->year = cmos_read(RTC_YEAR);
+}
+
+static bool same_time(const struct rtc_time* a, const struct rtc_time* b) {
+    return a->second == b->second && a->minute == b->minute && a->hour == b->hour &&
+           a->day == b->day && a->month == b->month && a->year == b->year;
+}
+
+// Days from 1970-01-01 to the given civil date (proleptic Gregorian)
+static uint64_t days_from_civil(uint32_t y, uint32_t m, uint32_t d) {
+    y -= m <= 2;
+    uint32_t era = y / 400;
+    uint32_t yoe = y - era * 400;
+    uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (uint64_t)era * 146097 + doe - 719468;
+}
+
+static void civil_from_days(uint64_t days, struct rtc_time* t) {
+    days += 719468;
+    uint32_t era = (uint32_t)(days / 146097);
+    uint32_t doe = (uint32_t)(days - (uint64_t)era * 146097);
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    uint32_t m = mp < 10 ? mp + 3 : mp - 9;
+    t->year = (uint16_t)(yoe + era * 400 + (m <= 2));
+    t->month = (uint8_t)m;
+    t->day = (uint8_t)(doy - (153 * mp + 2) / 5 + 1);
+}
+
+void rtc_init(void) {
+    // Read until two passes agree, so no update lands between the fields
+    struct rtc_time t, again;
+    cmos_read_raw(&t);
+    while (cmos_read_raw(&again), !same_time(&t, &again)) t = again;
+    g_boot_ns = clock_monotonic_ns();
+
+    uint8_t status_b = cmos_read(RTC_STATUS_B);
+    bool pm = !(status_b & RTC_B_24HOUR) && (t.hour & RTC_HOUR_PM);
+    t.hour &= (uint8_t)~RTC_HOUR_PM;
+    if (!(status_b & RTC_B_BINARY)) {
+        t.second = bcd_to_bin(t.second);
+        t.minute = bcd_to_bin(t.minute);
+        t.hour = bcd_to_bin(t.hour);
+        t.day = bcd_to_bin(t.day);
+        t.month = bcd_to_bin(t.month);
+        t.year = bcd_to_bin((uint8_t)t.year);
+    }
+    if (!(status_b & RTC_B_24HOUR)) t.hour = (uint8_t)(t.hour % 12 + (pm ? 12 : 0));
+    // The century register is not reliable across firmware; assume 20xx
+    t.year += 2000;
+    if (t.month < 1 || t.month > 12 || t.day < 1) {
+        syslog_write("RTC: Invalid date, wall clock starts at the epoch");
+        return;
+    }
+
+    g_boot_unix = days_from_civil(t.year, t.month, t.day) * SECS_PER_DAY +
+                  (uint64_t)t.hour * 3600 + (uint64_t)t.minute * 60 + t.second;
+    syslog_write("RTC: Wall clock read once, now kept by the clocksource");
+}
+
+uint64_t rtc_unix_time(void) {
+    return g_boot_unix + (clock_monotonic_ns() - g_boot_ns) / NSEC_PER_SEC;
+}
+
+void rtc_get_time(struct rtc_time* out) {
+    uint64_t now = rtc_unix_time();
+    uint64_t secs = now % SECS_PER_DAY;
+    civil_from_days(now / SECS_PER_DAY, out);
+    out->hour = (uint8_t)(secs / 3600);
+    out->minute = (uint8_t)(secs / 60 % 60);
+    out->second = (uint8_t)(secs % 60);
+}
+
+static char* put_digits(char* p, uint32_t value, int digits) {
+    for (int i = digits - 1; i >= 0; i--) {
+        p[i] = (char)('0' + value % 10);
+        value /= 10;
+    }
+    return p + digits;
+}
+
+void rtc_format(const struct rtc_time* t, char* buf) {
+    char* p = put_digits(buf, t->year, 4);
+    *p++ = '-';
+    p = put_digits(p, t->month, 2);
+    *p++ = '-';
+    p = put_digits(p, t->day, 2);
+    *p++ = ' ';
+    p = put_digits(p, t->hour, 2);
+    *p++ = ':';
+    p = put_digits(p, t->minute, 2);
+    *p++ = ':';
+    p = put_digits(p, t->second, 2);
+    *p = '\0';
+}
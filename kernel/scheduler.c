@@ -1,81 +1,446 @@
 #include "scheduler.h"
+#include "clocksource.h"
+#include "fpu.h"
 #include "heap.h"
+#include "interrupts.h"
+#include "ipc.h"
+#include "pmm.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "syscall.h"
 #include "syslog.h"
 #include "gdt.h"
 #include "kstdio.h"
+#include "timer.h"
 
-static Task* g_current_task = NULL;
-static Task* g_head = NULL;
+/*
+ * Every CPU has its own run queue: one FIFO per priority level plus a
+ * bitmap of non-empty levels, so picking the next task is a single bit
+ * scan. The running task is never queued; it goes back to the tail of its
+ * level when it is preempted or yields. A CPU whose queue runs dry steals
+ * from the busiest other queue before falling back to its idle task.
+ *
+ * A task's state and queue links are guarded by the run queue lock of
+ * task->cpu, and a task only changes CPU with that lock held. on_cpu stays
+ * set until the task has fully switched out (schedule_tail), so no other
+ * CPU can resume it on a stack that is still in use.
+ */
+struct run_queue {
+    spinlock_t lock;
+    Task* head[SCHED_PRIORITIES];
+    Task* tail[SCHED_PRIORITIES];
+    uint32_t bitmap;
+    uint32_t count;
+};
+
+struct sched_cpu {
+    struct run_queue rq;
+    Task* current;
+    Task* idle;
+    Task* prev;                  // Switched away from, finished by schedule_tail
+    volatile bool need_resched;
+    // Accounting in nanoseconds; run_start is current's
+    uint64_t busy_time;
+    uint64_t idle_time;
+    uint64_t run_start;
+    bool running_idle;
+} __attribute__((aligned(64)));
+
+static struct sched_cpu g_cpus[SMP_MAX_CPUS];
+static Task* g_all_tasks = NULL;
+static spinlock_t g_tasks_lock = SPINLOCK_INIT("sched.tasks");
 static uint64_t g_next_pid = 1;
+static Task* g_reaper_task = NULL;
 
 #define STACK_SIZE 16384
+#define STACK_PAGES (STACK_SIZE / PMM_PAGE_SIZE)
+#define TASK_ALIGN 64 // Keep each Task on its own cache lines
+
+// entry.asm: enables interrupts and calls the entry point held in r12
+extern void task_start_stub(void);
+
+// Interrupts must be off, or the caller may migrate
+static struct sched_cpu* this_cpu(void) {
+    return &g_cpus[smp_cpu_id()];
+}
+
+// --- Run queue ---
+
+static void rq_push(uint32_t cpu, Task* task) {
+    struct run_queue* rq = &g_cpus[cpu].rq;
+    uint8_t prio = task->priority;
+    task->run_next = NULL;
+    task->run_prev = rq->tail[prio];
+    if (rq->tail[prio]) rq->tail[prio]->run_next = task;
+    else rq->head[prio] = task;
+    rq->tail[prio] = task;
+    rq->bitmap |= 1u << prio;
+    rq->count++;
+    task->cpu = cpu;
+    task->on_rq = true;
+}
+
+static void rq_remove(struct run_queue* rq, Task* task) {
+    uint8_t prio = task->priority;
+    if (task->run_prev) task->run_prev->run_next = task->run_next;
+    else rq->head[prio] = task->run_next;
+    if (task->run_next) task->run_next->run_prev = task->run_prev;
+    else rq->tail[prio] = task->run_prev;
+    if (rq->head[prio] == NULL) rq->bitmap &= ~(1u << prio);
+    rq->count--;
+    task->run_next = NULL;
+    task->run_prev = NULL;
+    task->on_rq = false;
+}
+
+// Names the queue lock for lockstat; the lock itself is already usable
+static void rq_register(uint32_t cpu) {
+    struct lock_stats* stats = &g_cpus[cpu].rq.lock.stats;
+    stats->name = "sched.runqueue";
+    stats->instance = (int16_t)cpu;
+    lockstat_register(stats);
+}
+
+static Task* rq_pop(struct run_queue* rq) {
+    if (rq->bitmap == 0) return NULL;
+    Task* task = rq->head[__builtin_ctz(rq->bitmap)];
+    rq_remove(rq, task);
+    return task;
+}
+
+// Locks the run queue that owns 'task'. Interrupts must be off.
+static struct sched_cpu* lock_task_cpu(Task* task) {
+    while (1) {
+        uint32_t cpu = __atomic_load_n(&task->cpu, __ATOMIC_ACQUIRE);
+        spin_lock(&g_cpus[cpu].rq.lock);
+        if (task->cpu == cpu) return &g_cpus[cpu];
+        spin_unlock(&g_cpus[cpu].rq.lock);
+    }
+}
+
+// Takes the best queued task of the busiest other CPU. We already hold our
+// own queue lock, so only trylock theirs to stay clear of lock cycles.
+static Task* steal_task(uint32_t self) {
+    struct sched_cpu* victim = NULL;
+    uint32_t most = 0;
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        if (cpu == self || !smp_cpu_online(cpu)) continue;
+        uint32_t count = __atomic_load_n(&g_cpus[cpu].rq.count, __ATOMIC_RELAXED);
+        if (count > most) {
+            most = count;
+            victim = &g_cpus[cpu];
+        }
+    }
+    if (!victim || !spin_trylock(&victim->rq.lock)) return NULL;
+
+    Task* task = rq_pop(&victim->rq);
+    if (task) task->cpu = self;
+    spin_unlock(&victim->rq.lock);
+    return task;
+}
+
+static uint64_t slice_length(const Task* task) {
+    return task->priority <= TASK_PRIORITY_INTERACTIVE ? SCHED_INTERACTIVE_SLICE_US : SCHED_SLICE_US;
+}
+
+// Only ask for a preemption interrupt when another task is waiting at the
+// same level; a lone task (or the idle task) runs without timer interrupts.
+static void arm_slice(void) {
+    struct sched_cpu* cpu = this_cpu();
+    Task* current = cpu->current;
+    if (!current) return;
+
+    uint64_t deadline = TIMER_NO_DEADLINE;
+    if (cpu->need_resched) deadline = 0;
+    else if (current != cpu->idle && (cpu->rq.bitmap & (1u << current->priority))) deadline = current->slice_end;
+    timer_arm_slice(deadline);
+}
+
+static void resched_cpu(uint32_t cpu) {
+    g_cpus[cpu].need_resched = true;
+    if (cpu == smp_cpu_id()) arm_slice();
+    else smp_kick(cpu);
+}
+
+// Gets a task queued on 'cpu' running soon: preempt that CPU if the task
+// beats what it is running, otherwise hand it to an idle CPU to steal.
+static void place_task(uint32_t cpu, Task* task, uint8_t running_priority) {
+    if (task->priority < running_priority) {
+        resched_cpu(cpu);
+        return;
+    }
+    uint32_t self = smp_cpu_id();
+    for (uint32_t other = 0; other < SMP_MAX_CPUS; other++) {
+        if (other == cpu || !smp_cpu_online(other)) continue;
+        struct sched_cpu* c = &g_cpus[other];
+        if (c->idle && c->current == c->idle) {
+            resched_cpu(other);
+            return;
+        }
+    }
+    // Nobody free: make sure that CPU starts slicing between its tasks
+    if (cpu == self) arm_slice();
+    else smp_kick(cpu);
+}
+
+// --- Accounting ---
+
+// Starts the clock for a task that is already running on this CPU
+static void account_start(struct sched_cpu* cpu, Task* task) {
+    uint64_t now = clock_monotonic_ns();
+    task->run_start = now;
+    cpu->run_start = now;
+    cpu->running_idle = task == cpu->idle;
+}
+
+// Charges 'prev' for its run and starts 'next'. Run queue lock held.
+static void account_switch(struct sched_cpu* cpu, Task* prev, Task* next) {
+    uint64_t now = clock_monotonic_ns();
+    uint64_t ran = now > prev->run_start ? now - prev->run_start : 0;
+    prev->runtime += ran;
+    if (prev == cpu->idle) cpu->idle_time += ran;
+    else cpu->busy_time += ran;
+    if (prev->state == TASK_READY) prev->involuntary++;
+    else prev->voluntary++;
+    __atomic_store_n(&prev->run_start, 0, __ATOMIC_RELAXED);
+
+    next->switches++;
+    __atomic_store_n(&next->run_start, now, __ATOMIC_RELAXED);
+    cpu->run_start = now;
+    cpu->running_idle = next == cpu->idle;
+}
+
+// --- Task creation ---
+
+static Task* task_alloc(bool is_user) {
+    Task* task = (Task*)kmalloc_aligned_tagged(sizeof(Task), TASK_ALIGN, HEAP_TAG_TASK);
+    if (!task) return NULL;
+    task->id = __atomic_fetch_add(&g_next_pid, 1, __ATOMIC_RELAXED);
+    task->name[0] = '\0';
+    task->rsp = 0;
+    task->kernel_stack_top = 0;
+    task->kernel_stack = NULL;
+    task->user_stack = NULL;
+    task->is_user = is_user;
+    task->state = TASK_READY;
+    task->priority = TASK_PRIORITY_NORMAL;
+    task->cpu = 0;
+    task->on_cpu = false;
+    task->on_rq = false;
+    task->slice_end = 0;
+    task->run_next = NULL;
+    task->run_prev = NULL;
+    task->waiter = NULL;
+    task->arena = (struct task_arena){0};
+    task->fpu_state = NULL;
+    for (int i = 0; i < TASK_MAX_HANDLES; i++) task->handles[i] = NULL;
+    task->sys_ring = NULL;
+    task->run_start = 0;
+    task->runtime = 0;
+    task->switches = 0;
+    task->voluntary = 0;
+    task->involuntary = 0;
+    task->syscalls = 0;
+    task->syscall_ns = 0;
+    return task;
+}
+
+static void task_link(Task* task) {
+    uint64_t flags = spin_lock_irqsave(&g_tasks_lock);
+    task->next = g_all_tasks;
+    g_all_tasks = task;
+    spin_unlock_irqrestore(&g_tasks_lock, flags);
+}
+
+static void task_publish(Task* task) {
+    task_link(task);
+
+    uint64_t flags = irq_save();
+    uint32_t self = smp_cpu_id();
+    struct sched_cpu* cpu = &g_cpus[self];
+    spin_lock(&cpu->rq.lock);
+    rq_push(self, task);
+    uint8_t running = cpu->current ? cpu->current->priority : TASK_PRIORITY_IDLE;
+    spin_unlock(&cpu->rq.lock);
+    place_task(self, task, running);
+    irq_restore(flags);
+}
+
+static void task_free(Task* task) {
+    kfree_pages(task->kernel_stack, STACK_PAGES);
+    kfree_pages(task->user_stack, STACK_PAGES);
+    fpu_free(task);
+    kfree(task);
+}
+
+// Builds a kernel task that starts in entry_point, without queueing it
+static Task* task_create_kernel(void (*entry_point)(void)) {
+    Task* new_task = task_alloc(false);
+    uint8_t* stack = (uint8_t*)kmalloc_pages(STACK_PAGES);
+    if (!new_task || !stack) {
+        syslog_write("Scheduler: Out of memory for new task");
+        kfree(new_task);
+        kfree_pages(stack, STACK_PAGES);
+        return NULL;
+    }
 
-void scheduler_init(void) {
-    Task* kmain_task = (Task*)kmalloc(sizeof(Task));
-    kmain_task->id = g_next_pid++;
-    kmain_task->rsp = 0; 
-    kmain_task->is_user = false;
-    kmain_task->state = TASK_READY;
-    kmain_task->kernel_stack_top = 0; 
-    kmain_task->next = kmain_task; // Circular list
-
-    g_head = kmain_task;
-    g_current_task = kmain_task;
-    
-    syslog_write("Scheduler: Initialized (Multitasking enabled)");
-}
-
-void spawn_task(void (*entry_point)(void)) {
-    Task* new_task = (Task*)kmalloc(sizeof(Task));
-    uint8_t* stack = (uint8_t*)kmalloc(STACK_SIZE);
-    
-    new_task->id = g_next_pid++;
-    new_task->is_user = false;
-    new_task->state = TASK_READY;
-    
     uint64_t* sp = (uint64_t*)(stack + STACK_SIZE);
-    
+
     // Return address for context_switch
-    *(--sp) = (uint64_t)entry_point;
-    
+    *(--sp) = (uint64_t)task_start_stub;
+
     // Callee saved registers
     *(--sp) = 0; // R15
     *(--sp) = 0; // R14
     *(--sp) = 0; // R13
-    *(--sp) = 0; // R12
+    *(--sp) = (uint64_t)entry_point; // R12, picked up by task_start_stub
     *(--sp) = 0; // RBP
     *(--sp) = 0; // RBX
-    
+
     new_task->rsp = (uint64_t)sp;
+    new_task->kernel_stack = stack;
     new_task->kernel_stack_top = (uint64_t)(stack + STACK_SIZE);
+    return new_task;
+}
+
+// Each CPU runs its idle task whenever its queue (and stealing) comes up
+// empty. It is never queued itself.
+static void idle_main(void) {
+    while (1) {
+        __asm__ volatile("sti; hlt" ::: "memory");
+        // A wakeup from an interrupt should not wait for the next tick
+        __asm__ volatile("cli");
+        if (this_cpu()->need_resched) schedule();
+    }
+}
+
+// A dead task can be freed once it is off every CPU and nobody is joining it
+static bool task_reapable(const Task* task) {
+    return task->state == TASK_DEAD &&
+           !__atomic_load_n(&task->on_cpu, __ATOMIC_ACQUIRE) &&
+           __atomic_load_n(&task->waiter, __ATOMIC_ACQUIRE) == NULL;
+}
 
-    new_task->next = g_head->next;
-    g_head->next = new_task;
+static void reaper_main(void) {
+    while (1) {
+        uint64_t flags = irq_save();
+        // Published before the scan, so a task dying meanwhile re-wakes us
+        scheduler_set_state(TASK_BLOCKED);
+
+        Task* reaped = NULL;
+        spin_lock(&g_tasks_lock);
+        Task** link = &g_all_tasks;
+        while (*link) {
+            Task* task = *link;
+            if (task_reapable(task)) {
+                *link = task->next;
+                task->next = reaped;
+                reaped = task;
+            } else {
+                link = &task->next;
+            }
+        }
+        spin_unlock(&g_tasks_lock);
+
+        if (reaped) scheduler_set_state(TASK_READY);
+        else schedule();
+        irq_restore(flags);
+
+        while (reaped) {
+            Task* next = reaped->next;
+            task_free(reaped);
+            reaped = next;
+        }
+    }
 }
 
-void spawn_user_task(void (*entry_point)(void)) {
-    Task* new_task = (Task*)kmalloc(sizeof(Task));
-    uint8_t* kstack = (uint8_t*)kmalloc(STACK_SIZE);
-    uint8_t* ustack = (uint8_t*)kmalloc(STACK_SIZE);
-    
-    new_task->id = g_next_pid++;
-    new_task->is_user = true;
-    new_task->state = TASK_READY;
+void scheduler_init(void) {
+    spin_lock_register(&g_tasks_lock);
+    rq_register(0);
+
+    Task* kmain_task = task_alloc(false);
+    scheduler_set_name(kmain_task, "kmain");
+    kmain_task->on_cpu = true;
+    kmain_task->next = NULL;
+
+    g_all_tasks = kmain_task;
+    g_cpus[0].current = kmain_task;
+    account_start(&g_cpus[0], kmain_task);
+
+    Task* idle = task_create_kernel(idle_main);
+    if (idle) {
+        scheduler_set_name(idle, "idle");
+        idle->priority = TASK_PRIORITY_IDLE;
+        task_link(idle);
+        g_cpus[0].idle = idle;
+    }
+    g_reaper_task = spawn_task(reaper_main);
+    scheduler_set_name(g_reaper_task, "reaper");
+    if (!idle || !g_reaper_task) {
+        syslog_write("Scheduler: Failed to start idle/reaper tasks");
+    }
+
+    syslog_write("Scheduler: Initialized (per-CPU priority run queues)");
+}
+
+void scheduler_run_ap(uint32_t cpu_index) {
+    struct sched_cpu* cpu = &g_cpus[cpu_index];
+    rq_register(cpu_index);
+
+    // The boot stack we are on becomes the idle task's
+    Task* idle = task_alloc(false);
+    if (!idle) {
+        syslog_write("Scheduler: No memory for an AP idle task");
+        while (1) __asm__ volatile("cli; hlt");
+    }
+    scheduler_set_name(idle, "idle");
+    idle->priority = TASK_PRIORITY_IDLE;
+    idle->cpu = cpu_index;
+    idle->on_cpu = true;
+    task_link(idle);
+
+    cpu->idle = idle;
+    cpu->current = idle;
+    account_start(cpu, idle);
+    idle_main();
+}
+
+Task* spawn_task(void (*entry_point)(void)) {
+    Task* new_task = task_create_kernel(entry_point);
+    if (!new_task) return NULL;
+    task_publish(new_task);
+    return new_task;
+}
+
+Task* create_user_task(void (*entry_point)(void)) {
+    Task* new_task = task_alloc(true);
+    uint8_t* kstack = (uint8_t*)kmalloc_pages(STACK_PAGES);
+    uint8_t* ustack = (uint8_t*)kmalloc_pages(STACK_PAGES);
+    if (!new_task || !kstack || !ustack) {
+        syslog_write("Scheduler: Out of memory for new task");
+        kfree(new_task);
+        kfree_pages(kstack, STACK_PAGES);
+        kfree_pages(ustack, STACK_PAGES);
+        return NULL;
+    }
+
+    new_task->kernel_stack = kstack;
+    new_task->user_stack = ustack;
     new_task->kernel_stack_top = (uint64_t)(kstack + STACK_SIZE);
 
     uint64_t* sp = (uint64_t*)(kstack + STACK_SIZE);
-    
+
     // IRETQ Frame
     *(--sp) = 0x18 | 3; // SS
     *(--sp) = (uint64_t)(ustack + STACK_SIZE); // RSP
     *(--sp) = 0x202; // RFLAGS
     *(--sp) = 0x20 | 3; // CS
     *(--sp) = (uint64_t)entry_point; // RIP
-    
+
     // Context Switch Frame
     extern void _iret_stub();
     *(--sp) = (uint64_t)_iret_stub;
-    
+
     *(--sp) = 0; // R15
     *(--sp) = 0; // R14
     *(--sp) = 0; // R13
@@ -84,56 +449,250 @@ void spawn_user_task(void (*entry_point)(void)) {
     *(--sp) = 0; // RBX
 
     new_task->rsp = (uint64_t)sp;
-    
-    new_task->next = g_head->next;
-    g_head->next = new_task;
+    return new_task;
+}
+
+void start_task(Task* task) {
+    if (task) task_publish(task);
+}
+
+Task* spawn_user_task(void (*entry_point)(void)) {
+    Task* new_task = create_user_task(entry_point);
+    start_task(new_task);
+    return new_task;
 }
 
 void exit_current_task(void) {
-    // We cannot free the stack we are currently using.
-    // Mark as dead, and the scheduler will simply skip it.
-    // In a real OS, a separate "reaper" thread would free these.
-    __asm__ volatile("cli");
-    if (g_current_task) {
-        g_current_task->state = TASK_DEAD;
-    }
-    __asm__ volatile("sti");
-    
-    // Yield immediately to switch away
+    // We cannot free the stack we are currently using; the reaper frees
+    // it and the Task once schedule_tail has seen us switch away.
+    irq_save();
+    Task* task = this_cpu()->current;
+    // Everything the task allocated through sys_malloc goes in one sweep
+    arena_release(&task->arena);
+    task->sys_ring = NULL;
+    // Peers blocked on its channels see them close
+    ipc_release_handles(task);
+    // Pairs with the joiner publishing 'waiter' before it checks our state
+    __atomic_store_n(&task->state, TASK_DEAD, __ATOMIC_SEQ_CST);
+    Task* waiter = __atomic_load_n(&task->waiter, __ATOMIC_SEQ_CST);
+    if (waiter) scheduler_wake(waiter);
+
+    // Switch away for good
     schedule();
-    
+
     // Should never reach here
     while(1);
 }
 
+Task* scheduler_current_task(void) {
+    uint64_t flags = irq_save();
+    Task* task = this_cpu()->current;
+    irq_restore(flags);
+    return task;
+}
+
+void scheduler_set_state(TaskState state) {
+    uint64_t flags = irq_save();
+    __atomic_store_n(&this_cpu()->current->state, state, __ATOMIC_SEQ_CST);
+    irq_restore(flags);
+}
+
 void schedule(void) {
-    if (!g_current_task) return;
+    uint64_t flags = irq_save();
+    uint32_t self = smp_cpu_id();
+    struct sched_cpu* cpu = &g_cpus[self];
+    Task* prev = cpu->current;
+    if (!prev) {
+        irq_restore(flags);
+        return;
+    }
 
-    Task* start_task = g_current_task;
-    Task* next = (Task*)g_current_task->next;
+    spin_lock(&cpu->rq.lock);
+    // A running task that is still runnable goes behind its peers
+    if (prev->state == TASK_READY && prev != cpu->idle) rq_push(self, prev);
 
-    // Find next READY task
-    while (next != start_task) {
-        if (next->state == TASK_READY) break;
-        next = (Task*)next->next;
+    Task* next = rq_pop(&cpu->rq);
+    if (!next) next = steal_task(self);
+    if (!next) next = cpu->idle ? cpu->idle : prev;
+    next->cpu = self;
+    next->slice_end = timer_get_us() + slice_length(next);
+    if (next != prev) account_switch(cpu, prev, next);
+    cpu->current = next;
+    cpu->need_resched = false;
+    spin_unlock(&cpu->rq.lock);
+    arm_slice();
+
+    if (next != prev) {
+        // A stolen task may still be switching out on its old CPU
+        while (__atomic_load_n(&next->on_cpu, __ATOMIC_ACQUIRE)) {
+            __asm__ volatile("pause");
+        }
+        next->on_cpu = true;
+        cpu->prev = prev;
+        if (next->kernel_stack_top != 0) {
+            gdt_set_kernel_stack(next->kernel_stack_top);
+            syscall_set_kernel_stack(next->kernel_stack_top);
+        }
+        fpu_switch(prev, next);
+        context_switch(&prev->rsp, next->rsp);
+        // We may be back on a different CPU
+        schedule_tail();
+    }
+
+    irq_restore(flags);
+}
+
+void schedule_tail(void) {
+    struct sched_cpu* cpu = this_cpu();
+    Task* prev = cpu->prev;
+    cpu->prev = NULL;
+    if (!prev) return;
+
+    bool dead = prev->state == TASK_DEAD;
+    // Its stack is no longer in use: other CPUs may now resume or free it
+    __atomic_store_n(&prev->on_cpu, false, __ATOMIC_RELEASE);
+    if (dead) scheduler_wake(g_reaper_task);
+}
+
+void scheduler_tick(void) {
+    struct sched_cpu* cpu = this_cpu();
+    Task* current = cpu->current;
+    if (!current) return;
+
+    if (cpu->need_resched || (current != cpu->idle && timer_get_us() >= current->slice_end)) {
+        schedule();
+    } else {
+        // A kick may have queued a competitor since the slice was armed
+        arm_slice();
+    }
+}
+
+void scheduler_set_priority(Task* task, uint8_t priority) {
+    if (!task || priority >= SCHED_PRIORITIES) return;
+
+    uint64_t flags = irq_save();
+    struct sched_cpu* cpu = lock_task_cpu(task);
+    bool queued = task->on_rq;
+    if (queued) rq_remove(&cpu->rq, task);
+    task->priority = priority;
+    if (queued) rq_push(task->cpu, task);
+    uint32_t target = task->cpu;
+    uint8_t running = cpu->current ? cpu->current->priority : TASK_PRIORITY_IDLE;
+    spin_unlock(&cpu->rq.lock);
+
+    if (queued) place_task(target, task, running);
+    else arm_slice();
+    irq_restore(flags);
+}
+
+void scheduler_block(void) {
+    uint64_t flags = irq_save();
+    scheduler_set_state(TASK_BLOCKED);
+    schedule();
+    irq_restore(flags);
+}
+
+void scheduler_wake(Task* task) {
+    if (!task) return;
+
+    uint64_t flags = irq_save();
+    struct sched_cpu* cpu = lock_task_cpu(task);
+    bool queued = false;
+    if (task->state == TASK_BLOCKED || task->state == TASK_SLEEPING) {
+        task->state = TASK_READY;
+        // Still on its way into schedule() there; it will simply carry on
+        if (task != cpu->current) {
+            rq_push(task->cpu, task);
+            queued = true;
+        }
+    }
+    uint32_t target = task->cpu;
+    uint8_t running = cpu->current ? cpu->current->priority : TASK_PRIORITY_IDLE;
+    spin_unlock(&cpu->rq.lock);
+
+    if (queued) place_task(target, task, running);
+    irq_restore(flags);
+}
+
+void scheduler_join(Task* task) {
+    if (!task) return;
+
+    uint64_t flags = irq_save();
+    __atomic_store_n(&task->waiter, this_cpu()->current, __ATOMIC_SEQ_CST);
+    while (1) {
+        scheduler_set_state(TASK_BLOCKED);
+        if (__atomic_load_n(&task->state, __ATOMIC_SEQ_CST) == TASK_DEAD) break;
+        schedule();
     }
+    scheduler_set_state(TASK_READY);
+    __atomic_store_n(&task->waiter, NULL, __ATOMIC_RELEASE);
+    // The reaper skipped it while we were waiting
+    scheduler_wake(g_reaper_task);
+    irq_restore(flags);
+}
+
+void scheduler_set_name(Task* task, const char* name) {
+    if (!task || !name) return;
+    size_t i = 0;
+    for (; i < TASK_NAME_LEN - 1 && name[i]; i++) task->name[i] = name[i];
+    task->name[i] = '\0';
+}
 
-    // If we looped all the way around, check if current is ready
-    if (next == start_task && start_task->state != TASK_READY) {
-        // All tasks are dead. In a real OS, idle task would run.
-        // For now, halt.
-        syslog_write("Scheduler: All tasks dead/waiting.");
-        while(1) __asm__ volatile("hlt");
+// Time since 'start' for something still running, 0 if it is not
+static uint64_t running_for(uint64_t start, uint64_t now) {
+    return start != 0 && now > start ? now - start : 0;
+}
+
+size_t scheduler_task_snapshot(struct task_info* out, size_t max) {
+    if (!out) return 0;
+
+    size_t count = 0;
+    uint64_t flags = spin_lock_irqsave(&g_tasks_lock);
+    uint64_t now = clock_monotonic_ns();
+    for (Task* task = g_all_tasks; task && count < max; task = task->next) {
+        struct task_info* info = &out[count++];
+        uint64_t start = __atomic_load_n(&task->run_start, __ATOMIC_RELAXED);
+        info->id = task->id;
+        // The name may be set while we copy; always hand back a terminated one
+        for (size_t i = 0; i < TASK_NAME_LEN; i++) info->name[i] = task->name[i];
+        info->name[TASK_NAME_LEN - 1] = '\0';
+        info->state = (uint8_t)task->state;
+        info->priority = task->priority;
+        info->is_user = task->is_user;
+        info->is_idle = task == g_cpus[task->cpu].idle;
+        info->cpu = task->cpu;
+        info->runtime_us = (task->runtime + running_for(start, now)) / 1000;
+        info->switches = task->switches;
+        info->voluntary = task->voluntary;
+        info->involuntary = task->involuntary;
+        info->syscalls = task->syscalls;
+        info->syscall_us = task->syscall_ns / 1000;
     }
+    spin_unlock_irqrestore(&g_tasks_lock, flags);
+    return count;
+}
 
-    if (next == g_current_task) return; // No switch needed
+void scheduler_cpu_times(struct cpu_times* out) {
+    if (!out) return;
 
-    Task* prev = g_current_task;
-    g_current_task = next;
-    
-    if (next->kernel_stack_top != 0) {
-        gdt_set_kernel_stack(next->kernel_stack_top);
+    uint64_t busy = 0, idle = 0;
+    uint32_t cpus = 0;
+    uint64_t flags = irq_save();
+    uint64_t now = clock_monotonic_ns();
+    for (uint32_t i = 0; i < SMP_MAX_CPUS; i++) {
+        if (!smp_cpu_online(i)) continue;
+        struct sched_cpu* cpu = &g_cpus[i];
+        // Unlocked: a switch in between only skews this sample slightly
+        uint64_t current = running_for(__atomic_load_n(&cpu->run_start, __ATOMIC_RELAXED), now);
+        if (cpu->running_idle) idle += current;
+        else busy += current;
+        busy += cpu->busy_time;
+        idle += cpu->idle_time;
+        cpus++;
     }
+    irq_restore(flags);
 
-    context_switch(&prev->rsp, next->rsp);
+    out->busy_us = busy / 1000;
+    out->idle_us = idle / 1000;
+    out->cpus = cpus;
 }
@@ -9,6 +9,7 @@
 #include "kstring.h"
 #include "memtest.h"
 #include "os_info.h"
+#include "rtc.h"
 #include "shell.h"
 #include "system.h"
 #include "syslog.h"
@@ -19,7 +20,16 @@
 #include "kstdio.h" 
 #include "ata.h"    
 #include "banner.h"
+#include "clocksource.h"
 #include "gui_demo.h" // Includes the GUI entry point
+#include "heap.h"
+#include "interrupts.h"
+#include "ipc.h"
+#include "mouse.h"
+#include "scheduler.h"
+#include "slab.h"
+#include "spinlock.h"
+#include "syscall.h"
 
 struct shell_command {
     const char* name;
@@ -45,6 +55,13 @@ static void command_rm(const char* args);
 static void command_sysinfo(const char* args);
 static void command_logs(const char* args);
 static void command_memtest(const char* args);
+static void command_slabinfo(const char* args);
+static void command_heapstat(const char* args);
+static void command_lockstat(const char* args);
+static void command_ps(const char* args);
+static void command_top(const char* args);
+static void command_sysstat(const char* args);
+static void command_irqstat(const char* args);
 static void command_reboot(const char* args);
 static void command_shutdown(const char* args);
 static void command_time(const char* args);
@@ -80,6 +97,13 @@ static const struct shell_command COMMANDS[] = {
     {"history", command_history, "Show recent commands"},
     {"sysinfo", command_sysinfo, "Display hardware info"},
     {"memtest", command_memtest, "Run memory diagnostics"},
+    {"slabinfo", command_slabinfo, "Show slab cache hit rates"},
+    {"heapstat", command_heapstat, "Show heap usage and leaks"},
+    {"lockstat", command_lockstat, "Show lock contention ('reset' clears)"},
+    {"irqstat", command_irqstat, "Interrupt counts and handler cycles ('reset' clears)"},
+    {"sysstat", command_sysstat, "Syscall counts and latency ('reset', 'trace [on|off]')"},
+    {"ps", command_ps, "List tasks with CPU time and switches"},
+    {"top", command_top, "Show CPU usage per task over one second"},
     {"logs", command_logs, "Show system logs"},
     {"echo", command_echo, "Display text back to you"},
     {"snake", command_snake, "Play the Snake game"},
@@ -97,30 +121,21 @@ static const char* COLOR_NAMES[16] = {
     "Light Magenta", "Yellow", "White",
 };
 
-#define CMOS_ADDRESS 0x70
-#define CMOS_DATA    0x71
-
-static uint8_t get_rtc_register(int reg) {
-    outb(CMOS_ADDRESS, (uint8_t)reg);
-    return inb(CMOS_DATA);
-}
-
 static void command_time(const char* args) {
     (void)args;
-    while (get_rtc_register(0x0A) & 0x80); 
-    uint8_t second = get_rtc_register(0x00);
-    uint8_t minute = get_rtc_register(0x02);
-    uint8_t hour   = get_rtc_register(0x04);
-    second = (second & 0x0F) + ((second / 16) * 10);
-    minute = (minute & 0x0F) + ((minute / 16) * 10);
-    hour   = ((hour & 0x0F) + ((hour / 16) * 10));
-    kprintf("RTC Time: %02u:%02u:%02u\n", hour, minute, second);
+    struct rtc_time now;
+    char buf[RTC_FORMAT_LEN];
+    rtc_get_time(&now);
+    rtc_format(&now, buf);
+    kprintf("RTC Time: %s\n", buf);
 }
 
 static void command_uptime(const char* args) {
     (void)args;
     uint64_t seconds = timer_get_uptime();
     kprintf("System Uptime: %u seconds (%u ticks)\n", (unsigned int)seconds, (unsigned int)timer_get_ticks());
+    kprintf("Clocksource: %s, %u ms since boot\n", clocksource_name(),
+            (unsigned int)(clock_monotonic_ns() / 1000000));
 }
 
 static void command_sleep(const char* args) {
@@ -294,6 +309,243 @@ static void command_memtest(const char* args) {
     memtest_run_diagnostic();
 }
 
+static void command_slabinfo(const char* args) {
+    (void)args;
+    kprintf("Slab caches:\n");
+    for (size_t i = 0; i < slab_cache_count(); i++) {
+        struct slab_cache_stats st;
+        if (!slab_cache_stats(i, &st)) continue;
+        unsigned int hit_pct = st.allocs ? (unsigned int)((st.hits * 100) / st.allocs) : 0;
+        kprintf("  %u B: active %u, allocs %u, hit %u%%, refills %u, fallbacks %u, pages %u\n",
+                (unsigned int)st.object_size, (unsigned int)st.active,
+                (unsigned int)st.allocs, hit_pct, (unsigned int)st.refills,
+                (unsigned int)st.fallbacks, (unsigned int)st.pages);
+    }
+    kprintf("Arena: %u of %u pages free\n",
+            (unsigned int)slab_arena_pages_free(), (unsigned int)slab_arena_pages_total());
+}
+
+static void command_heapstat(const char* args) {
+    (void)args;
+    struct heap_stats st;
+    heap_get_stats(&st);
+    kprintf("Heap: %u KB total, %u KB in use (peak %u KB), %u KB free\n",
+            (unsigned int)(st.total_bytes / 1024), (unsigned int)(st.in_use_bytes / 1024),
+            (unsigned int)(st.peak_bytes / 1024), (unsigned int)(st.free_bytes / 1024));
+    kprintf("Mapped %u KB of %u MB reserved (grown %u, trimmed %u times)\n",
+            (unsigned int)(st.total_bytes / 1024), (unsigned int)(st.reserved_bytes / (1024 * 1024)),
+            (unsigned int)st.grow_count, (unsigned int)st.trim_count);
+    kprintf("Page allocations: %u KB\n", (unsigned int)(st.page_bytes / 1024));
+    kprintf("Allocs %u, frees %u, failures %u\n",
+            (unsigned int)st.alloc_count, (unsigned int)st.free_count, (unsigned int)st.fail_count);
+    kprintf("Largest free block %u KB, fragmentation %u%%\n",
+            (unsigned int)(st.largest_free / 1024), st.frag_percent);
+
+    kprintf("Request sizes:\n");
+    for (size_t i = 0; i < HEAP_HIST_BUCKETS; i++) {
+        if (st.histogram[i] == 0) continue;
+        size_t limit = (size_t)16 << i;
+        if (i == HEAP_HIST_BUCKETS - 1) kprintf("  >%u KB: %u\n", (unsigned int)(limit / 2048), (unsigned int)st.histogram[i]);
+        else if (limit >= 1024) kprintf("  <=%u KB: %u\n", (unsigned int)(limit / 1024), (unsigned int)st.histogram[i]);
+        else kprintf("  <=%u B: %u\n", (unsigned int)limit, (unsigned int)st.histogram[i]);
+    }
+
+    kprintf("By subsystem:\n");
+    for (int t = 0; t < HEAP_TAG_COUNT; t++) {
+        struct heap_tag_stats ts;
+        if (!heap_get_tag_stats((enum heap_tag)t, &ts)) continue;
+        kprintf("  %s: %u KB in %u blocks (%u allocs)\n", ts.name,
+                (unsigned int)(ts.bytes / 1024), (unsigned int)ts.blocks, (unsigned int)ts.allocs);
+    }
+}
+
+static void command_lockstat(const char* args) {
+    if (args && kstrcmp(args, "reset") == 0) {
+        lockstat_reset();
+        kprintf("Lock statistics cleared\n");
+        return;
+    }
+
+    kprintf("Lock: acquired, contended (%%), waits per contention\n");
+    for (const struct lock_stats* s = lockstat_first(); s; s = s->next) {
+        unsigned int pct = s->acquired ? (unsigned int)((s->contended * 100) / s->acquired) : 0;
+        unsigned int avg = s->contended ? (unsigned int)(s->waits / s->contended) : 0;
+        if (s->instance >= 0) kprintf("  %s/%d", s->name, s->instance);
+        else kprintf("  %s", s->name);
+        kprintf(": %u, %u (%u%%), %u\n", (unsigned int)s->acquired,
+                (unsigned int)s->contended, pct, avg);
+    }
+}
+
+#define SHELL_MAX_TASKS 64
+static struct task_info g_task_before[SHELL_MAX_TASKS];
+static struct task_info g_task_after[SHELL_MAX_TASKS];
+
+static const char* task_state_name(uint8_t state) {
+    switch (state) {
+        case TASK_READY: return "ready";
+        case TASK_BLOCKED: return "blocked";
+        case TASK_SLEEPING: return "sleeping";
+        default: return "dead";
+    }
+}
+
+static void command_ps(const char* args) {
+    (void)args;
+    size_t count = scheduler_task_snapshot(g_task_after, SHELL_MAX_TASKS);
+    kprintf("PID name [state] cpu: run time, switches (voluntary/involuntary)\n");
+    for (size_t i = 0; i < count; i++) {
+        const struct task_info* t = &g_task_after[i];
+        kprintf("  %u %s [%s] cpu %u: %u ms, %u (%u/%u)\n", (unsigned int)t->id,
+                t->name[0] ? t->name : "-", task_state_name(t->state), t->cpu,
+                (unsigned int)(t->runtime_us / 1000), (unsigned int)t->switches,
+                (unsigned int)t->voluntary, (unsigned int)t->involuntary);
+    }
+}
+
+// Percent of 'whole' with one decimal, as tenths
+static unsigned int tenths_of(uint64_t part, uint64_t whole) {
+    return whole ? (unsigned int)((part * 1000) / whole) : 0;
+}
+
+static void command_top(const char* args) {
+    (void)args;
+    struct cpu_times t0, t1;
+    scheduler_cpu_times(&t0);
+    size_t before = scheduler_task_snapshot(g_task_before, SHELL_MAX_TASKS);
+    timer_wait(100);
+    scheduler_cpu_times(&t1);
+    size_t after = scheduler_task_snapshot(g_task_after, SHELL_MAX_TASKS);
+
+    uint64_t busy = t1.busy_us - t0.busy_us;
+    uint64_t total = busy + (t1.idle_us - t0.idle_us);
+    unsigned int pct = tenths_of(busy, total);
+    kprintf("CPU: %u.%u%% busy across %u CPU(s)\n", pct / 10, pct % 10, t1.cpus);
+
+    // Turn each task's runtime into what it used during the interval
+    for (size_t i = 0; i < after; i++) {
+        struct task_info* t = &g_task_after[i];
+        for (size_t j = 0; j < before; j++) {
+            if (g_task_before[j].id == t->id) {
+                t->runtime_us -= g_task_before[j].runtime_us;
+                break;
+            }
+        }
+    }
+    // Busiest first; the list is short
+    for (size_t i = 1; i < after; i++) {
+        struct task_info t = g_task_after[i];
+        size_t j = i;
+        while (j > 0 && g_task_after[j - 1].runtime_us < t.runtime_us) {
+            g_task_after[j] = g_task_after[j - 1];
+            j--;
+        }
+        g_task_after[j] = t;
+    }
+
+    for (size_t i = 0; i < after; i++) {
+        const struct task_info* t = &g_task_after[i];
+        if (t->runtime_us == 0) break;
+        unsigned int share = tenths_of(t->runtime_us, total);
+        kprintf("  %u %s: %u.%u%%\n", (unsigned int)t->id, t->name[0] ? t->name : "-",
+                share / 10, share % 10);
+    }
+}
+
+// Nanoseconds as microseconds with three decimals
+static void print_us(uint64_t ns) {
+    unsigned int frac = (unsigned int)(ns % 1000);
+    kprintf("%u.%u%u%u us", (unsigned int)(ns / 1000), frac / 100, frac / 10 % 10, frac % 10);
+}
+
+static struct syscall_trace g_trace_copy[SYSCALL_TRACE_ENTRIES];
+
+static void sysstat_trace(const char* args) {
+    args = kskip_spaces(args);
+    if (kstrcmp(args, "on") == 0 || kstrcmp(args, "off") == 0) {
+        syscall_trace_enable(args[1] == 'n');
+        kprintf("Syscall trace %s\n", syscall_trace_enabled() ? "on" : "off");
+        return;
+    }
+
+    size_t count = syscall_trace_read(g_trace_copy, SYSCALL_TRACE_ENTRIES);
+    if (count == 0) {
+        kprintf("Trace is empty%s\n", syscall_trace_enabled() ? "" : " (enable with 'sysstat trace on')");
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const struct syscall_trace* t = &g_trace_copy[i];
+        const char* name = syscall_name((uint32_t)t->nr);
+        kprintf("  [%u] ", (unsigned int)t->task);
+        if (name) kprintf("%s", name);
+        else kprintf("#%u", (unsigned int)t->nr);
+        kprintf("(%p, %p, %p) = %p, ", (void*)t->args[0], (void*)t->args[1],
+                (void*)t->args[2], (void*)t->ret);
+        print_us(t->duration_ns);
+        kprintf("\n");
+    }
+}
+
+static void command_sysstat(const char* args) {
+    args = kskip_spaces(args);
+    if (kstrcmp(args, "reset") == 0) {
+        syscall_reset_stats();
+        kprintf("Syscall statistics cleared\n");
+        return;
+    }
+    if (kstrncmp(args, "trace", 5) == 0) {
+        sysstat_trace(args + 5);
+        return;
+    }
+
+    kprintf("Syscall: calls, average, max; log2(ns) histogram\n");
+    for (uint32_t nr = 0; nr < SYSCALL_COUNT; nr++) {
+        struct syscall_stats st;
+        if (!syscall_get_stats(nr, &st) || st.calls == 0) continue;
+        kprintf("  %s: %u, ", syscall_name(nr), (unsigned int)st.calls);
+        print_us(st.total_ns / st.calls);
+        kprintf(", ");
+        print_us(st.max_ns);
+        kprintf("\n   ");
+        for (int b = 0; b < SYSCALL_HIST_BUCKETS; b++) {
+            if (st.hist[b]) kprintf(" %d:%u", b, (unsigned int)st.hist[b]);
+        }
+        kprintf("\n");
+    }
+
+    kprintf("By task: calls, time in syscalls\n");
+    size_t count = scheduler_task_snapshot(g_task_after, SHELL_MAX_TASKS);
+    for (size_t i = 0; i < count; i++) {
+        const struct task_info* t = &g_task_after[i];
+        if (t->syscalls == 0) continue;
+        kprintf("  %u %s: %u, %u ms\n", (unsigned int)t->id, t->name[0] ? t->name : "-",
+                (unsigned int)t->syscalls, (unsigned int)(t->syscall_us / 1000));
+    }
+}
+
+#define SHELL_MAX_IRQS 32
+static struct irq_info g_irq_info[SHELL_MAX_IRQS];
+
+static void command_irqstat(const char* args) {
+    args = kskip_spaces(args);
+    if (kstrcmp(args, "reset") == 0) {
+        interrupts_reset_stats();
+        kprintf("Interrupt statistics cleared\n");
+        return;
+    }
+
+    kprintf("Vector: count, spurious, average and max handler cycles\n");
+    size_t count = interrupts_snapshot(g_irq_info, SHELL_MAX_IRQS);
+    for (size_t i = 0; i < count; i++) {
+        const struct irq_info* irq = &g_irq_info[i];
+        const char* name = interrupts_vector_name((uint8_t)irq->vector);
+        uint64_t avg = irq->stats.count ? irq->stats.cycles / irq->stats.count : 0;
+        kprintf("  %x %s: %u, %u, %u, %u\n", irq->vector, name ? name : "-",
+                (unsigned int)irq->stats.count, (unsigned int)irq->stats.spurious,
+                (unsigned int)avg, (unsigned int)irq->stats.max_cycles);
+    }
+}
+
 static void command_logs(const char* args) {
     (void)args;
     size_t count = syslog_length();
@@ -342,23 +594,39 @@ static void command_banner(const char* args) {
     shell_print_banner();
 }
 
+// Input notifications for the GUI. Static, so an interrupt handler that
+// still sees it after the GUI has gone never touches freed memory.
+#define GUI_EVENT_CAPACITY 64
+static struct ipc_msg g_gui_event_ring[GUI_EVENT_CAPACITY];
+static struct channel g_gui_events = CHANNEL_INIT("gui.events", g_gui_event_ring, GUI_EVENT_CAPACITY);
+
 static void command_gui(const char* args) {
     (void)args;
     
     kprintf("Spawning GUI task in Ring 3...\n");
     timer_set_callback(NULL); // Stop kernel background animation
     
-    // 1. Set the flag explicitly BEFORE spawning to prevent race condition.
-    gui_set_running(true);
-
-    // 2. Launch as a User Mode task
-    spawn_user_task(gui_demo_run);
-    
-    // 3. Block shell execution until GUI exits
-    while (gui_is_running()) {
-        // Yield CPU to allow GUI to run
-        schedule();
+    // 1. Build the User Mode task and hand it its event channel before it runs
+    Task* gui = create_user_task(gui_demo_run);
+    if (!gui) {
+        kprintf("Failed to start the GUI task.\n");
+        timer_set_callback(background_animate);
+        return;
     }
+    channel_reset(&g_gui_events);
+    ipc_handle_install(gui, &g_gui_events);
+    scheduler_set_name(gui, "gui");
+    scheduler_set_priority(gui, TASK_PRIORITY_INTERACTIVE);
+    keyboard_set_event_channel(&g_gui_events);
+    mouse_set_event_channel(&g_gui_events);
+
+    // 2. Launch it, ahead of kernel work
+    start_task(gui);
+    
+    // 3. Sleep until the GUI task exits; its handle closes with it
+    scheduler_join(gui);
+    keyboard_set_event_channel(NULL);
+    mouse_set_event_channel(NULL);
     
     // 4. Restore shell environment
     background_render();
@@ -0,0 +1,69 @@
+#include "simd.h"
+
+// GCC vector extensions; the _u types allow unaligned pixel rows
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+typedef uint32_t v4u32_u __attribute__((vector_size(16), aligned(4)));
+typedef uint16_t v8u16 __attribute__((vector_size(16)));
+
+void simd_fill32(uint32_t* dest, uint32_t value, size_t count) {
+    v4u32 v = { value, value, value, value };
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        *(v4u32_u*)(dest + i) = v;
+        *(v4u32_u*)(dest + i + 4) = v;
+        *(v4u32_u*)(dest + i + 8) = v;
+        *(v4u32_u*)(dest + i + 12) = v;
+    }
+    for (; i + 4 <= count; i += 4) *(v4u32_u*)(dest + i) = v;
+    for (; i < count; i++) dest[i] = value;
+}
+
+void simd_copy32(uint32_t* dest, const uint32_t* src, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        v4u32 a = *(const v4u32_u*)(src + i);
+        v4u32 b = *(const v4u32_u*)(src + i + 4);
+        v4u32 c = *(const v4u32_u*)(src + i + 8);
+        v4u32 d = *(const v4u32_u*)(src + i + 12);
+        *(v4u32_u*)(dest + i) = a;
+        *(v4u32_u*)(dest + i + 4) = b;
+        *(v4u32_u*)(dest + i + 8) = c;
+        *(v4u32_u*)(dest + i + 12) = d;
+    }
+    for (; i + 4 <= count; i += 4) *(v4u32_u*)(dest + i) = *(const v4u32_u*)(src + i);
+    for (; i < count; i++) dest[i] = src[i];
+}
+
+// Exact x / 255 for x <= 255 * 255, in 16-bit lanes
+static inline v8u16 div255(v8u16 x) {
+    return (x + 1 + (x >> 8)) >> 8;
+}
+
+static inline uint32_t blend_scalar(uint32_t bg, uint32_t color, uint32_t alpha) {
+    uint32_t inv = 255 - alpha;
+    uint32_t r = (((color >> 16) & 0xFF) * alpha + ((bg >> 16) & 0xFF) * inv) / 255;
+    uint32_t g = (((color >> 8) & 0xFF) * alpha + ((bg >> 8) & 0xFF) * inv) / 255;
+    uint32_t b = ((color & 0xFF) * alpha + (bg & 0xFF) * inv) / 255;
+    return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+void simd_blend32(uint32_t* dest, uint32_t color, uint8_t alpha, size_t count) {
+    uint16_t inv = (uint16_t)(255 - alpha);
+    // Red and blue share a 32-bit lane as two 16-bit halves; green gets
+    // its own pass. Every product fits 16 bits.
+    uint32_t src_rb = (color & 0x00FF00FF) * alpha;
+    uint32_t src_g = ((color >> 8) & 0xFF) * alpha;
+    v4u32 src_rb_v = { src_rb, src_rb, src_rb, src_rb };
+    v4u32 src_g_v = { src_g, src_g, src_g, src_g };
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        v4u32 px = *(v4u32_u*)(dest + i);
+        v8u16 rb = (v8u16)(px & 0x00FF00FF);
+        v8u16 g = (v8u16)((px >> 8) & 0xFF);
+        rb = div255(rb * inv + (v8u16)src_rb_v);
+        g = div255(g * inv + (v8u16)src_g_v);
+        *(v4u32_u*)(dest + i) = 0xFF000000 | ((v4u32)rb & 0x00FF00FF) | ((v4u32)g << 8);
+    }
+    for (; i < count; i++) dest[i] = blend_scalar(dest[i], color, alpha);
+}
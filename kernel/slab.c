@@ -0,0 +1,261 @@
+#include "slab.h"
+#include "paging.h"
+#include "syslog.h"
+
+// Per-page descriptor. Kept off-page (in an array at the start of the arena)
+// so objects can start at page offset 0 and stay naturally aligned.
+struct slab_page {
+    struct slab_page* next;
+    struct slab_page* prev;
+    void* free_list;     // Objects returned to this page
+    uint16_t bump;       // Objects never handed out start at this index
+    uint16_t in_use;
+    uint16_t capacity;
+    uint8_t cache;       // Owning cache index, 0xFF when the page is unassigned
+    uint8_t tag;         // Every object on a page belongs to the same heap tag
+};
+
+struct slab_cache {
+    struct slab_page* partial[HEAP_TAG_COUNT]; // Pages with at least one free object
+    struct slab_cache_stats stats;
+};
+
+#define SLAB_PAGE_UNASSIGNED 0xFF
+
+static struct slab_cache g_caches[SLAB_CACHE_COUNT];
+static struct slab_page* g_pages = NULL;      // Descriptor array
+static uint8_t* g_arena_base = NULL;          // First object page
+static size_t g_arena_pages = 0;
+static size_t g_arena_next = 0;               // Pages never handed to a cache start here
+static struct slab_page* g_free_pages = NULL; // Pages returned by caches (unmapped)
+static size_t g_free_page_count = 0;
+static size_t g_desc_committed = 0;           // Bytes of the descriptor array backed by frames
+
+static inline size_t size_to_cache(size_t size) {
+    size_t index = 0;
+    size_t class_size = SLAB_MIN_SIZE;
+    while (class_size < size) {
+        class_size <<= 1;
+        index++;
+    }
+    return index;
+}
+
+static inline uint8_t* page_address(const struct slab_page* page) {
+    return g_arena_base + (size_t)(page - g_pages) * SLAB_PAGE_SIZE;
+}
+
+static inline struct slab_page* page_of(const void* ptr) {
+    return &g_pages[((const uint8_t*)ptr - g_arena_base) / SLAB_PAGE_SIZE];
+}
+
+static void list_push(struct slab_page** head, struct slab_page* page) {
+    page->prev = NULL;
+    page->next = *head;
+    if (*head) (*head)->prev = page;
+    *head = page;
+}
+
+static void list_remove(struct slab_page** head, struct slab_page* page) {
+    if (page->prev) page->prev->next = page->next;
+    else *head = page->next;
+    if (page->next) page->next->prev = page->prev;
+    page->next = NULL;
+    page->prev = NULL;
+}
+
+// Maps the descriptor array far enough to cover page index 'count - 1'.
+static bool descriptors_commit(size_t count) {
+    size_t needed = count * sizeof(struct slab_page);
+    while (g_desc_committed < needed) {
+        uint8_t* chunk = (uint8_t*)g_pages + g_desc_committed;
+        if (!paging_commit((uint64_t)chunk, 1)) return false;
+        g_desc_committed += SLAB_PAGE_SIZE;
+    }
+    return true;
+}
+
+// Object pages are only backed by a frame while a cache owns them.
+static struct slab_page* arena_take_page(void) {
+    struct slab_page* page;
+    if (g_free_pages) {
+        page = g_free_pages;
+        if (!paging_commit((uint64_t)page_address(page), 1)) return NULL;
+        g_free_pages = page->next;
+        g_free_page_count--;
+    } else if (g_arena_next < g_arena_pages) {
+        if (!descriptors_commit(g_arena_next + 1)) return NULL;
+        page = &g_pages[g_arena_next];
+        if (!paging_commit((uint64_t)page_address(page), 1)) return NULL;
+        g_arena_next++;
+    } else {
+        return NULL;
+    }
+    page->next = NULL;
+    page->prev = NULL;
+    return page;
+}
+
+static void arena_release_page(struct slab_page* page) {
+    paging_decommit((uint64_t)page_address(page), 1);
+    page->cache = SLAB_PAGE_UNASSIGNED;
+    page->free_list = NULL;
+    page->prev = NULL;
+    page->next = g_free_pages;
+    g_free_pages = page;
+    g_free_page_count++;
+}
+
+void slab_init(void* start, size_t size) {
+    uintptr_t base = ((uintptr_t)start + SLAB_PAGE_SIZE - 1) & ~(uintptr_t)(SLAB_PAGE_SIZE - 1);
+    uintptr_t end = (uintptr_t)start + size;
+
+    for (size_t i = 0; i < SLAB_CACHE_COUNT; i++) {
+        for (size_t t = 0; t < HEAP_TAG_COUNT; t++) g_caches[i].partial[t] = NULL;
+        g_caches[i].stats = (struct slab_cache_stats){ .object_size = (size_t)SLAB_MIN_SIZE << i };
+    }
+    g_free_pages = NULL;
+    g_free_page_count = 0;
+    g_arena_next = 0;
+    g_arena_pages = 0;
+    g_desc_committed = 0;
+
+    if (end <= base) return;
+
+    // Each page costs SLAB_PAGE_SIZE bytes of objects plus one descriptor.
+    size_t pages = (end - base) / (SLAB_PAGE_SIZE + sizeof(struct slab_page));
+    uintptr_t objects = (base + pages * sizeof(struct slab_page) + SLAB_PAGE_SIZE - 1) & ~(uintptr_t)(SLAB_PAGE_SIZE - 1);
+    while (pages > 0 && objects + pages * SLAB_PAGE_SIZE > end) {
+        pages--;
+    }
+    if (pages == 0) {
+        syslog_write("Slab: Arena too small");
+        return;
+    }
+
+    // Nothing is mapped yet; descriptors and object pages are backed as
+    // the caches grow.
+    g_pages = (struct slab_page*)base;
+    g_arena_base = (uint8_t*)objects;
+    g_arena_pages = pages;
+
+    syslog_write("Slab: Size-class caches ready (16..2048 bytes)");
+}
+
+// Only pages that were handed out at least once have a mapped descriptor.
+bool slab_owns(const void* ptr) {
+    const uint8_t* p = (const uint8_t*)ptr;
+    return g_arena_pages != 0 && p >= g_arena_base && p < g_arena_base + g_arena_next * SLAB_PAGE_SIZE;
+}
+
+void* slab_alloc(size_t size, enum heap_tag tag) {
+    if (size == 0 || size > SLAB_MAX_SIZE || (unsigned)tag >= HEAP_TAG_COUNT) return NULL;
+
+    size_t index = size_to_cache(size);
+    struct slab_cache* cache = &g_caches[index];
+    struct slab_page** partial = &cache->partial[tag];
+    struct slab_page* page = *partial;
+
+    if (page) {
+        cache->stats.hits++;
+    } else {
+        page = arena_take_page();
+        if (!page) {
+            cache->stats.fallbacks++;
+            return NULL;
+        }
+        page->cache = (uint8_t)index;
+        page->tag = (uint8_t)tag;
+        page->free_list = NULL;
+        page->bump = 0;
+        page->in_use = 0;
+        page->capacity = (uint16_t)(SLAB_PAGE_SIZE / cache->stats.object_size);
+        list_push(partial, page);
+        cache->stats.refills++;
+        cache->stats.pages++;
+    }
+
+    void* obj;
+    if (page->free_list) {
+        obj = page->free_list;
+        page->free_list = *(void**)obj;
+    } else {
+        obj = page_address(page) + (size_t)page->bump * cache->stats.object_size;
+        page->bump++;
+    }
+
+    page->in_use++;
+    if (page->in_use == page->capacity) {
+        list_remove(partial, page);
+    }
+
+    cache->stats.allocs++;
+    cache->stats.active++;
+    return obj;
+}
+
+void slab_free(void* ptr) {
+    if (!slab_owns(ptr)) return;
+
+    struct slab_page* page = page_of(ptr);
+    if (page->cache == SLAB_PAGE_UNASSIGNED) {
+        syslog_write("Slab: Free of unowned object");
+        return;
+    }
+    struct slab_cache* cache = &g_caches[page->cache];
+    struct slab_page** partial = &cache->partial[page->tag];
+
+    bool was_full = page->in_use == page->capacity;
+    *(void**)ptr = page->free_list;
+    page->free_list = ptr;
+    page->in_use--;
+
+    cache->stats.frees++;
+    cache->stats.active--;
+
+    if (was_full) {
+        list_push(partial, page);
+    }
+
+    // Keep one empty page per list to absorb alloc/free ping-pong,
+    // hand any further empty pages back to the arena.
+    if (page->in_use == 0 && (*partial != page || page->next != NULL)) {
+        list_remove(partial, page);
+        arena_release_page(page);
+        cache->stats.pages--;
+    }
+}
+
+size_t slab_object_size(const void* ptr) {
+    if (!slab_owns(ptr)) return 0;
+    const struct slab_page* page = page_of(ptr);
+    if (page->cache == SLAB_PAGE_UNASSIGNED) return 0;
+    return g_caches[page->cache].stats.object_size;
+}
+
+enum heap_tag slab_object_tag(const void* ptr) {
+    if (!slab_owns(ptr)) return HEAP_TAG_MISC;
+    return (enum heap_tag)page_of(ptr)->tag;
+}
+
+size_t slab_cache_count(void) {
+    return SLAB_CACHE_COUNT;
+}
+
+bool slab_cache_stats(size_t index, struct slab_cache_stats* out) {
+    if (index >= SLAB_CACHE_COUNT || out == NULL) return false;
+    *out = g_caches[index].stats;
+    return true;
+}
+
+size_t slab_arena_pages_total(void) {
+    return g_arena_pages;
+}
+
+size_t slab_arena_pages_free(void) {
+    return (g_arena_pages - g_arena_next) + g_free_page_count;
+}
+
+size_t slab_mapped_bytes(void) {
+    return (g_arena_next - g_free_page_count) * SLAB_PAGE_SIZE + g_desc_committed;
+}
@@ -0,0 +1,210 @@
+#include "smp.h"
+
+#include <stddef.h>
+#include "cpu.h"
+#include "fpu.h"
+#include "gdt.h"
+#include "heap.h"
+#include "interrupts.h"
+#include "lapic.h"
+#include "paging.h"
+#include "scheduler.h"
+#include "spinlock.h"
+#include "syscall.h"
+#include "syslog.h"
+#include "timer.h"
+
+/*
+ * AP startup: the real-mode trampoline from entry.asm is copied to a fixed
+ * page below 1MB, then each AP gets INIT followed by two STARTUP IPIs
+ * pointing at it. The trampoline switches straight to long mode using the
+ * boot CPU's CR3/CR4/EFER and calls ap_main on a fresh stack. APs are
+ * started one at a time because they share the parameter block.
+ */
+
+#define AP_TRAMPOLINE_BASE  0x1000  // Must match entry.asm
+#define AP_STACK_PAGES      4
+#define AP_START_TIMEOUT_US 100000
+#define SHOOTDOWN_MAX_INVLPG 32     // Larger ranges reload CR3 instead
+
+// Layout of ap_trampoline_params in entry.asm
+struct ap_boot_params {
+    uint64_t cr3;
+    uint64_t cr4;
+    uint64_t efer;
+    uint64_t stack;
+    uint64_t entry;
+    uint64_t cpu;
+};
+
+extern uint8_t ap_trampoline_start[];
+extern uint8_t ap_trampoline_end[];
+extern uint8_t ap_trampoline_params[];
+
+#define IA32_EFER_MSR 0xC0000080
+
+static uint8_t g_cpu_apic_id[SMP_MAX_CPUS];
+static uint8_t g_apic_to_cpu[256];
+// The boot CPU counts as online even when smp_init stays single processor
+static volatile bool g_cpu_online[SMP_MAX_CPUS] = { [0] = true };
+static uint32_t g_cpu_count = 1;
+static bool g_smp_active = false;
+
+uint32_t smp_cpu_id(void) {
+    return g_smp_active ? g_apic_to_cpu[lapic_id()] : 0;
+}
+
+uint32_t smp_cpu_count(void) {
+    return g_cpu_count;
+}
+
+bool smp_cpu_online(uint32_t cpu) {
+    return cpu < SMP_MAX_CPUS && g_cpu_online[cpu];
+}
+
+void smp_kick(uint32_t cpu) {
+    if (!g_smp_active || !smp_cpu_online(cpu)) return;
+    lapic_send_ipi(g_cpu_apic_id[cpu], LAPIC_KICK_VECTOR);
+}
+
+/*
+ * TLB shootdown. Requests go out as NMIs rather than a vector: callers such
+ * as heap_trim hold a lock with interrupts off, and a CPU spinning on that
+ * lock would never take a maskable IPI. One shootdown runs at a time.
+ */
+static spinlock_t g_shootdown_lock = SPINLOCK_INIT("smp.shootdown");
+static uint64_t g_shootdown_virt;
+static size_t g_shootdown_pages;
+static volatile bool g_shootdown_request[SMP_MAX_CPUS];
+static volatile uint32_t g_shootdown_pending;
+
+static void tlb_flush_range(uint64_t virt, size_t pages) {
+    if (pages > SHOOTDOWN_MAX_INVLPG) {
+        // No global pages, so this drops every cached translation
+        uint64_t cr3;
+        __asm__ volatile("mov %%cr3, %0\n mov %0, %%cr3" : "=r"(cr3) : : "memory");
+        return;
+    }
+    for (size_t i = 0; i < pages; i++) {
+        __asm__ volatile("invlpg (%0)" : : "r"(virt + i * PAGING_PAGE_SIZE) : "memory");
+    }
+}
+
+void smp_tlb_shootdown(uint64_t virt, size_t pages) {
+    if (!g_smp_active || pages == 0) return;
+
+    uint64_t flags = spin_lock_irqsave(&g_shootdown_lock);
+    uint32_t self = smp_cpu_id();
+    uint32_t targets = 0;
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        if (cpu != self && smp_cpu_online(cpu)) targets++;
+    }
+    g_shootdown_virt = virt;
+    g_shootdown_pages = pages;
+    // Count first: a stray NMI may pick up its request before we send ours
+    __atomic_store_n(&g_shootdown_pending, targets, __ATOMIC_SEQ_CST);
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        if (cpu == self || !smp_cpu_online(cpu)) continue;
+        __atomic_store_n(&g_shootdown_request[cpu], true, __ATOMIC_RELEASE);
+        lapic_send_nmi(g_cpu_apic_id[cpu]);
+    }
+    while (__atomic_load_n(&g_shootdown_pending, __ATOMIC_ACQUIRE) != 0) {
+        __asm__ volatile("pause");
+    }
+    spin_unlock_irqrestore(&g_shootdown_lock, flags);
+}
+
+void smp_handle_nmi(void) {
+    if (!g_smp_active) return;
+    uint32_t cpu = smp_cpu_id();
+    if (!__atomic_exchange_n(&g_shootdown_request[cpu], false, __ATOMIC_ACQ_REL)) return;
+    tlb_flush_range(g_shootdown_virt, g_shootdown_pages);
+    __atomic_fetch_sub(&g_shootdown_pending, 1, __ATOMIC_RELEASE);
+}
+
+// C entry point of every AP, on the stack smp_init handed it
+static void ap_main(uint32_t cpu) {
+    gdt_init_cpu(cpu);
+    syscall_init_cpu(cpu);
+    interrupts_load_idt();
+    fpu_init_cpu();
+    lapic_init();
+
+    __atomic_store_n(&g_cpu_online[cpu], true, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&g_cpu_count, 1, __ATOMIC_RELAXED);
+
+    // Becomes this CPU's idle task; never returns
+    scheduler_run_ap(cpu);
+}
+
+static bool ap_start(uint32_t cpu, uint8_t apic_id) {
+    uint8_t* stack = (uint8_t*)kmalloc_pages(AP_STACK_PAGES);
+    if (!stack) return false;
+
+    volatile struct ap_boot_params* params = (volatile struct ap_boot_params*)
+        (uintptr_t)(AP_TRAMPOLINE_BASE + (ap_trampoline_params - ap_trampoline_start));
+    params->stack = (uint64_t)(stack + AP_STACK_PAGES * PAGING_PAGE_SIZE);
+    params->cpu = cpu;
+
+    lapic_send_init(apic_id);
+    timer_udelay(10000);
+    for (int attempt = 0; attempt < 2 && !g_cpu_online[cpu]; attempt++) {
+        lapic_send_startup(apic_id, AP_TRAMPOLINE_BASE >> 12);
+        timer_udelay(200);
+    }
+
+    uint64_t deadline = timer_get_us() + AP_START_TIMEOUT_US;
+    while (!__atomic_load_n(&g_cpu_online[cpu], __ATOMIC_ACQUIRE)) {
+        // The stack stays allocated: a late AP could still be using it
+        if (timer_get_us() >= deadline) return false;
+        __asm__ volatile("pause");
+    }
+    return true;
+}
+
+void smp_init(void) {
+    const struct acpi_madt_info* madt = acpi_init() ? acpi_madt() : NULL;
+    // APs are preempted by their LAPIC timer and started on TSC delays
+    if (!madt || !timer_is_tickless() || madt->cpu_count < 2) {
+        syslog_write("SMP: Single processor");
+        return;
+    }
+
+    uint8_t bsp = lapic_id();
+    g_cpu_apic_id[0] = bsp;
+    g_apic_to_cpu[bsp] = 0;
+    g_smp_active = true;
+    spin_lock_register(&g_shootdown_lock);
+
+    // Trampoline and the parameters every AP shares
+    uint8_t* base = (uint8_t*)(uintptr_t)AP_TRAMPOLINE_BASE;
+    for (size_t i = 0; i < (size_t)(ap_trampoline_end - ap_trampoline_start); i++) {
+        base[i] = ap_trampoline_start[i];
+    }
+    volatile struct ap_boot_params* params = (volatile struct ap_boot_params*)
+        (base + (ap_trampoline_params - ap_trampoline_start));
+    uint64_t cr3, cr4;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    params->cr3 = cr3;
+    params->cr4 = cr4;
+    params->efer = rdmsr(IA32_EFER_MSR);
+    params->entry = (uint64_t)ap_main;
+
+    uint32_t next_cpu = 1;
+    for (uint8_t i = 0; i < madt->cpu_count && next_cpu < SMP_MAX_CPUS; i++) {
+        uint8_t apic_id = madt->cpu_apic_ids[i];
+        if (apic_id == bsp) continue;
+
+        uint32_t cpu = next_cpu;
+        g_cpu_apic_id[cpu] = apic_id;
+        g_apic_to_cpu[apic_id] = (uint8_t)cpu;
+        if (ap_start(cpu, apic_id)) {
+            next_cpu++;
+        } else {
+            syslog_write("SMP: An AP did not respond to STARTUP");
+        }
+    }
+
+    syslog_write(g_cpu_count > 1 ? "SMP: Application processors online" : "SMP: Single processor");
+}
@@ -1,23 +1,67 @@
 #include "syscall.h"
+#include "cpu.h"
+#include "gdt.h"
+#include "smp.h"
 #include "kstdio.h"
 #include "scheduler.h"
 #include "syslog.h"
 #include "io.h"
 #include "mouse.h"
-#include "heap.h"
+#include "arena.h"
+#include "clocksource.h"
+#include "interrupts.h"
+#include "ipc.h"
+#include "rtc.h"
+#include "spinlock.h"
+#include "timer.h"
 
 struct syscall_regs {
     uint64_t rbx, rcx, rdx, rsi, rdi, r8, r9, r10, r11, r12, r13, r14, r15, rbp;
     uint64_t rip, cs, rflags, rsp, ss; 
 };
 
-#define CMOS_ADDRESS 0x70
-#define CMOS_DATA    0x71
+#define IA32_EFER       0xC0000080
+#define IA32_STAR       0xC0000081
+#define IA32_LSTAR      0xC0000082
+#define IA32_FMASK      0xC0000084
+#define IA32_GS_BASE    0xC0000101
+#define IA32_KERNEL_GS_BASE 0xC0000102
 
-static uint8_t get_rtc_register(int reg) {
-    outb(CMOS_ADDRESS, (uint8_t)reg);
-    return inb(CMOS_DATA);
-}
+#define EFER_SCE        (1ull << 0)
+#define CPUID_EXT_SYSCALL (1u << 11)   // CPUID 0x80000001 EDX
+
+// Cleared on entry: IF, TF, DF, AC and NT, as an interrupt gate would
+#define SYSCALL_FMASK   0x47700ull
+
+/*
+ * Per-CPU block that GS points at in Ring 0. Ring 3 can load GS itself, so
+ * while user code runs the block sits in IA32_KERNEL_GS_BASE and every entry
+ * from Ring 3 that needs it swaps it in (see entry.asm and interrupts.c).
+ * Offsets are used by syscall_entry.
+ */
+struct syscall_cpu {
+    uint64_t kernel_rsp;        // gs:0
+    uint64_t user_rsp;          // gs:8, scratch while switching stacks
+} __attribute__((aligned(64)));
+
+static struct syscall_cpu g_syscall_cpu[SMP_MAX_CPUS];
+static bool g_fast_syscall = false;
+
+extern void syscall_entry(void);
+
+static const char* const SYSCALL_NAMES[SYSCALL_COUNT] = {
+    "yield", "exit", "log", NULL, "shutdown", "mouse", "malloc", "free", "get_time",
+    "sleep", "task_stats", "cpu_times", "ipc_send", "ipc_recv", "ipc_close",
+    "ring_setup", "ring_enter", "irq_stats",
+};
+
+// Updated with relaxed atomics from every CPU; readers may see a torn set
+static struct syscall_stats g_stats[SYSCALL_COUNT];
+
+static spinlock_t g_trace_lock = SPINLOCK_INIT("syscall.trace");
+static bool g_trace_on = false;
+static uint64_t g_trace_next = 0;           // Total entries ever written
+static struct syscall_trace g_trace[SYSCALL_TRACE_ENTRIES];
 
 static void sys_yield(void) { schedule(); }
 
@@ -26,8 +70,43 @@ static void sys_exit(void) {
     exit_current_task();
 }
 
+// Parks the caller in the timer wheel instead of spinning in Ring 3
+static void sys_sleep(uint64_t ticks) { sleep_ticks(ticks); }
+
 static void sys_log(const char* msg) { syslog_write(msg); }
 
+// Task Manager and System Monitor; the count goes in rdx
+static size_t sys_task_stats(struct task_info* user_buf, size_t max) {
+    return scheduler_task_snapshot(user_buf, max);
+}
+
+static void sys_cpu_times(struct cpu_times* user_struct) { scheduler_cpu_times(user_struct); }
+
+// System Monitor's interrupt view; the count goes in rdx
+static size_t sys_irq_stats(struct irq_info* user_buf, size_t max) {
+    return interrupts_snapshot(user_buf, max);
+}
+
+// IPC on the caller's handle table; the message goes in rdx, a timeout in r10
+static int64_t sys_ipc_send(int handle, const struct ipc_msg* user_msg) {
+    Task* self = scheduler_current_task();
+    struct channel* ch = ipc_handle_get(self, handle);
+    if (!ch || !user_msg) return IPC_ERR_BADF;
+    struct ipc_msg msg = *user_msg;
+    msg.sender = (uint32_t)self->id;
+    return channel_send(ch, &msg);
+}
+
+static int64_t sys_ipc_recv(int handle, struct ipc_msg* user_msg, uint64_t timeout) {
+    struct channel* ch = ipc_handle_get(scheduler_current_task(), handle);
+    if (!ch || !user_msg) return IPC_ERR_BADF;
+    return channel_recv(ch, user_msg, timeout);
+}
+
+static int64_t sys_ipc_close(int handle) {
+    return ipc_handle_close(scheduler_current_task(), handle);
+}
+
 static void sys_shutdown(void) {
     syslog_write("Syscall: Shutdown");
     outw(0x604, 0x2000); 
@@ -42,35 +121,226 @@ static void sys_get_mouse(MouseState* user_struct) {
     }
 }
 
-static void* sys_malloc(size_t size) { return kmalloc(size); }
-static void sys_free(void* ptr) { kfree(ptr); }
+// User allocations live in the calling task's arena, not the kernel heap
+static void* sys_malloc(size_t size) { return arena_alloc(&scheduler_current_task()->arena, size); }
+static void sys_free(void* ptr) { arena_free(&scheduler_current_task()->arena, ptr); }
 
+// "HH:MM" from the cached wall clock; no CMOS access on this path
 static void sys_get_time(char* buffer) {
-    while (get_rtc_register(0x0A) & 0x80); 
-    uint8_t m = get_rtc_register(0x02);
-    uint8_t h = get_rtc_register(0x04);
-    m = (m & 0x0F) + ((m / 16) * 10);
-    h = ((h & 0x0F) + ((h / 16) * 10));
-    buffer[0] = '0' + (h / 10); buffer[1] = '0' + (h % 10);
-    buffer[2] = ':';
-    buffer[3] = '0' + (m / 10); buffer[4] = '0' + (m % 10);
+    struct rtc_time now;
+    char full[RTC_FORMAT_LEN];
+    rtc_get_time(&now);
+    rtc_format(&now, full);
+    for (int i = 0; i < 5; i++) buffer[i] = full[11 + i];
     buffer[5] = 0;
 }
 
-// Returns value to be placed in RAX
-uint64_t syscall_dispatcher(struct syscall_regs* regs) {
-    uint64_t syscall_num = regs->rdi; 
+static uint64_t syscall_invoke(uint64_t num, uint64_t a1, uint64_t a2, uint64_t a3);
+
+// The ring lives in the caller's arena and goes away with it on exit
+static struct syscall_ring* sys_ring_setup(void) {
+    Task* self = scheduler_current_task();
+    if (!self->sys_ring) {
+        struct syscall_ring* ring = (struct syscall_ring*)arena_alloc(&self->arena, sizeof(struct syscall_ring));
+        if (!ring) {
+            syslog_write("Syscall: Out of memory for a syscall ring");
+            return NULL;
+        }
+        // Only the indices need a known start; entries are written before use
+        ring->sq_head = ring->sq_tail = 0;
+        ring->cq_head = ring->cq_tail = 0;
+        self->sys_ring = ring;
+    }
+    return self->sys_ring;
+}
+
+// Runs up to 'to_submit' queued calls and returns how many were consumed
+static uint64_t sys_ring_enter(uint64_t to_submit) {
+    struct syscall_ring* ring = scheduler_current_task()->sys_ring;
+    if (!ring) return 0;
+
+    uint32_t head = ring->sq_head;
+    uint32_t tail = __atomic_load_n(&ring->sq_tail, __ATOMIC_ACQUIRE);
+    uint32_t cq_tail = ring->cq_tail;
+    uint64_t done = 0;
+    while (done < to_submit && head != tail) {
+        if (cq_tail - __atomic_load_n(&ring->cq_head, __ATOMIC_ACQUIRE) >= SYSCALL_RING_ENTRIES) break;
+
+        // Copy first: the task may reuse the slot once sq_head moves past it
+        struct syscall_sqe sqe = ring->sq[head & (SYSCALL_RING_ENTRIES - 1)];
+        int64_t result = SYSCALL_RING_BADOP;
+        if (sqe.op != 1 && sqe.op != 15 && sqe.op != 16) {
+            result = (int64_t)syscall_invoke(sqe.op, sqe.args[0], sqe.args[1], sqe.args[2]);
+        }
+
+        struct syscall_cqe* cqe = &ring->cq[cq_tail & (SYSCALL_RING_ENTRIES - 1)];
+        cqe->user_data = sqe.user_data;
+        cqe->result = result;
+        head++;
+        cq_tail++;
+        done++;
+        __atomic_store_n(&ring->cq_tail, cq_tail, __ATOMIC_RELEASE);
+        __atomic_store_n(&ring->sq_head, head, __ATOMIC_RELEASE);
+    }
+    return done;
+}
+
+// Arguments arrive in rsi, rdx and r10, from either entry path or a ring
+static uint64_t syscall_call(uint64_t num, uint64_t a1, uint64_t a2, uint64_t a3) {
     uint64_t ret = 0;
 
-    switch (syscall_num) {
+    switch (num) {
         case 0: sys_yield(); break;
         case 1: sys_exit(); break;
-        case 2: sys_log((const char*)regs->rsi); break;
+        case 2: sys_log((const char*)a1); break;
         case 4: sys_shutdown(); break;
-        case 5: sys_get_mouse((MouseState*)regs->rsi); break;
-        case 6: ret = (uint64_t)sys_malloc((size_t)regs->rsi); break;
-        case 7: sys_free((void*)regs->rsi); break;
-        case 8: sys_get_time((char*)regs->rsi); break;
+        case 5: sys_get_mouse((MouseState*)a1); break;
+        case 6: ret = (uint64_t)sys_malloc((size_t)a1); break;
+        case 7: sys_free((void*)a1); break;
+        case 8: sys_get_time((char*)a1); break;
+        case 9: sys_sleep(a1); break;
+        case 10: ret = sys_task_stats((struct task_info*)a1, (size_t)a2); break;
+        case 11: sys_cpu_times((struct cpu_times*)a1); break;
+        case 12: ret = (uint64_t)sys_ipc_send((int)a1, (const struct ipc_msg*)a2); break;
+        case 13: ret = (uint64_t)sys_ipc_recv((int)a1, (struct ipc_msg*)a2, a3); break;
+        case 14: ret = (uint64_t)sys_ipc_close((int)a1); break;
+        case 15: ret = (uint64_t)sys_ring_setup(); break;
+        case 16: ret = sys_ring_enter(a1); break;
+        case 17: ret = sys_irq_stats((struct irq_info*)a1, (size_t)a2); break;
     }
     return ret;
 }
+
+static void stats_add(uint64_t* counter, uint64_t value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static void syscall_account(uint64_t num, uint64_t a1, uint64_t a2, uint64_t a3,
+                            uint64_t ret, uint64_t ns) {
+    if (num < SYSCALL_COUNT) {
+        struct syscall_stats* st = &g_stats[num];
+        uint32_t bucket = ns ? 63 - (uint32_t)__builtin_clzll(ns) : 0;
+        if (bucket >= SYSCALL_HIST_BUCKETS) bucket = SYSCALL_HIST_BUCKETS - 1;
+        stats_add(&st->calls, 1);
+        stats_add(&st->total_ns, ns);
+        stats_add(&st->hist[bucket], 1);
+        uint64_t max = __atomic_load_n(&st->max_ns, __ATOMIC_RELAXED);
+        while (ns > max && !__atomic_compare_exchange_n(&st->max_ns, &max, ns, true,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+    }
+
+    // Only the task itself charges these, so plain increments are enough
+    Task* self = scheduler_current_task();
+    self->syscalls++;
+    self->syscall_ns += ns;
+
+    if (!__atomic_load_n(&g_trace_on, __ATOMIC_RELAXED)) return;
+    uint64_t flags = spin_lock_irqsave(&g_trace_lock);
+    struct syscall_trace* t = &g_trace[g_trace_next++ % SYSCALL_TRACE_ENTRIES];
+    t->task = self->id;
+    t->nr = num;
+    t->args[0] = a1; t->args[1] = a2; t->args[2] = a3;
+    t->ret = ret;
+    t->duration_ns = ns;
+    spin_unlock_irqrestore(&g_trace_lock, flags);
+}
+
+static uint64_t syscall_invoke(uint64_t num, uint64_t a1, uint64_t a2, uint64_t a3) {
+    uint64_t start = clock_monotonic_ns();
+    uint64_t ret = syscall_call(num, a1, a2, a3);
+    syscall_account(num, a1, a2, a3, ret, clock_monotonic_ns() - start);
+    return ret;
+}
+
+// Returns value to be placed in RAX
+uint64_t syscall_dispatcher(struct syscall_regs* regs) {
+    return syscall_invoke(regs->rdi, regs->rsi, regs->rdx, regs->r10);
+}
+
+void syscall_set_kernel_stack(uint64_t stack_top) {
+    g_syscall_cpu[smp_cpu_id()].kernel_rsp = stack_top;
+}
+
+bool syscall_fast_available(void) {
+    return g_fast_syscall;
+}
+
+void syscall_init_cpu(uint32_t cpu) {
+    // After gdt_init_cpu: loading a selector into GS clears its base.
+    // Ring 0 owns the block; the first swapgs to Ring 3 hands it a null GS.
+    wrmsr(IA32_GS_BASE, (uint64_t)&g_syscall_cpu[cpu]);
+    wrmsr(IA32_KERNEL_GS_BASE, 0);
+    if (!g_fast_syscall) return;
+
+    // SYSCALL loads CS=0x08, SS=0x10; SYSRET loads CS=0x10+16, SS=0x10+8 (RPL 3)
+    wrmsr(IA32_STAR, (0x10ull << 48) | (0x08ull << 32));
+    wrmsr(IA32_LSTAR, (uint64_t)syscall_entry);
+    wrmsr(IA32_FMASK, SYSCALL_FMASK);
+    wrmsr(IA32_EFER, rdmsr(IA32_EFER) | EFER_SCE);
+}
+
+void syscall_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax >= 0x80000001) {
+        cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+        g_fast_syscall = (edx & CPUID_EXT_SYSCALL) != 0;
+    }
+
+    spin_lock_register(&g_trace_lock);
+    g_syscall_cpu[0].kernel_rsp = (uint64_t)g_kernel_stack_top;
+    syscall_init_cpu(0);
+    syslog_write(g_fast_syscall ? "Syscall: SYSCALL/SYSRET fast path enabled"
+                                : "Syscall: No SYSCALL support, using int 0x80");
+}
+
+const char* syscall_name(uint32_t nr) {
+    return nr < SYSCALL_COUNT ? SYSCALL_NAMES[nr] : NULL;
+}
+
+bool syscall_get_stats(uint32_t nr, struct syscall_stats* out) {
+    if (nr >= SYSCALL_COUNT || !out) return false;
+    const struct syscall_stats* st = &g_stats[nr];
+    out->calls = __atomic_load_n(&st->calls, __ATOMIC_RELAXED);
+    out->total_ns = __atomic_load_n(&st->total_ns, __ATOMIC_RELAXED);
+    out->max_ns = __atomic_load_n(&st->max_ns, __ATOMIC_RELAXED);
+    for (int b = 0; b < SYSCALL_HIST_BUCKETS; b++) {
+        out->hist[b] = __atomic_load_n(&st->hist[b], __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
+void syscall_reset_stats(void) {
+    for (uint32_t nr = 0; nr < SYSCALL_COUNT; nr++) {
+        struct syscall_stats* st = &g_stats[nr];
+        __atomic_store_n(&st->calls, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&st->total_ns, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&st->max_ns, 0, __ATOMIC_RELAXED);
+        for (int b = 0; b < SYSCALL_HIST_BUCKETS; b++) {
+            __atomic_store_n(&st->hist[b], 0, __ATOMIC_RELAXED);
+        }
+    }
+    uint64_t flags = spin_lock_irqsave(&g_trace_lock);
+    g_trace_next = 0;
+    spin_unlock_irqrestore(&g_trace_lock, flags);
+}
+
+void syscall_trace_enable(bool on) {
+    __atomic_store_n(&g_trace_on, on, __ATOMIC_RELAXED);
+}
+
+bool syscall_trace_enabled(void) {
+    return __atomic_load_n(&g_trace_on, __ATOMIC_RELAXED);
+}
+
+size_t syscall_trace_read(struct syscall_trace* out, size_t max) {
+    if (!out) return 0;
+    uint64_t flags = spin_lock_irqsave(&g_trace_lock);
+    uint64_t kept = g_trace_next < SYSCALL_TRACE_ENTRIES ? g_trace_next : SYSCALL_TRACE_ENTRIES;
+    size_t count = kept < max ? (size_t)kept : max;
+    for (size_t i = 0; i < count; i++) {
+        out[i] = g_trace[(g_trace_next - count + i) % SYSCALL_TRACE_ENTRIES];
+    }
+    spin_unlock_irqrestore(&g_trace_lock, flags);
+    return count;
+}
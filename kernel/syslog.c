@@ -8,9 +8,15 @@
 #define SYSLOG_CAPACITY 64
 #define SYSLOG_MESSAGE_LEN 80
 
+/*
+ * Writers claim a slot with one atomic increment and then fill it in, so
+ * logging never takes a lock. That matters because it is called from
+ * interrupt handlers and from Ring 3, where a lock holder could be
+ * interrupted by another logger on the same CPU. A reader racing a writer
+ * that laps the ring may see a half-copied line.
+ */
 static char g_entries[SYSLOG_CAPACITY][SYSLOG_MESSAGE_LEN];
-static size_t g_start = 0;
-static size_t g_count = 0;
+static uint64_t g_next_seq = 0; // Messages written since init; slot = seq % capacity
 
 static void copy_message(char* dest, const char* src) {
     size_t i = 0;
@@ -24,18 +30,13 @@ static void copy_message(char* dest, const char* src) {
 }
 
 void syslog_init(void) {
-    g_start = 0;
-    g_count = 0;
+    g_next_seq = 0;
     for (size_t i = 0; i < SYSLOG_CAPACITY; i++) {
         g_entries[i][0] = '\0';
     }
 }
 
-void syslog_write(const char* message) {
-    if (message == NULL) {
-        return;
-    }
-
+static void debug_port_write(const char* message) {
     // Check current privilege level (CPL) from CS register
     // If CPL is 3 (User Mode), we cannot execute 'outb' without GPF.
     // We skip the debug port output in that case.
@@ -49,27 +50,37 @@ void syslog_write(const char* message) {
         }
         outb(0xE9, '\n');
     }
+}
 
-    size_t index;
-    if (g_count < SYSLOG_CAPACITY) {
-        index = (g_start + g_count) % SYSLOG_CAPACITY;
-        g_count++;
-    } else {
-        index = g_start;
-        g_start = (g_start + 1) % SYSLOG_CAPACITY;
+void syslog_trace(const char* message) {
+    if (message == NULL) {
+        return;
     }
+    debug_port_write(message);
+}
+
+void syslog_write(const char* message) {
+    if (message == NULL) {
+        return;
+    }
+
+    debug_port_write(message);
 
-    copy_message(g_entries[index], message);
+    uint64_t seq = __atomic_fetch_add(&g_next_seq, 1, __ATOMIC_RELAXED);
+    copy_message(g_entries[seq % SYSLOG_CAPACITY], message);
 }
 
 size_t syslog_length(void) {
-    return g_count;
+    uint64_t written = __atomic_load_n(&g_next_seq, __ATOMIC_RELAXED);
+    return written < SYSLOG_CAPACITY ? (size_t)written : SYSLOG_CAPACITY;
 }
 
 const char* syslog_entry(size_t index) {
-    if (index >= g_count) {
+    uint64_t written = __atomic_load_n(&g_next_seq, __ATOMIC_RELAXED);
+    size_t count = written < SYSLOG_CAPACITY ? (size_t)written : SYSLOG_CAPACITY;
+    if (index >= count) {
         return NULL;
     }
-    size_t actual = (g_start + index) % SYSLOG_CAPACITY;
-    return g_entries[actual];
+    uint64_t first = written - count;
+    return g_entries[(first + index) % SYSLOG_CAPACITY];
 }
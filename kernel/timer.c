@@ -3,13 +3,62 @@
 #include "syslog.h"
 #include "interrupts.h"
 #include "scheduler.h"
+#include "clocksource.h"
+#include "cpu.h"
+#include "lapic.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "vdso.h"
+#include "workqueue.h"
 #include <stddef.h> 
 
 #define PIT_FREQUENCY 1193180
+#define PIT_CALIBRATE_MS 10
+#define TIMER_MAX_WAIT_US 60000000ull // Longest single LAPIC countdown we ask for
+
+/*
+ * Hierarchical timer wheel: 4 levels of 64 slots. Level n slots are 64^n
+ * ticks wide, so the wheel spans 2^24 ticks (~46 hours at 100 Hz); anything
+ * later parks in the last level and is re-filed when it cascades. Adding,
+ * cancelling and expiring are O(1); a higher-level slot is re-filed into
+ * the level below each time the level below wraps.
+ *
+ * The wheel is advanced by CPU 0 only; other CPUs add and cancel under
+ * g_wheel_lock and kick CPU 0 when they need it to wake up earlier.
+ */
+#define WHEEL_LEVELS     4
+#define WHEEL_SLOT_BITS  6
+#define WHEEL_SLOTS      (1 << WHEEL_SLOT_BITS)
+#define WHEEL_SLOT_MASK  (WHEEL_SLOTS - 1)
+#define WHEEL_SPAN       (1ull << (WHEEL_LEVELS * WHEEL_SLOT_BITS))
+
+struct timer_wheel {
+    struct timer* slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t occupied[WHEEL_LEVELS]; // Bit per non-empty slot
+    uint64_t now;                    // Last tick the wheel has processed
+};
 
 static volatile uint64_t g_ticks = 0;
 static int g_freq_hz = 100;
-static timer_callback_t g_callback = NULL;
+static volatile timer_callback_t g_callback = NULL;
+static struct timer_wheel g_wheel;
+static spinlock_t g_wheel_lock = SPINLOCK_INIT("timer.wheel");
+static uint64_t g_wheel_armed_tick = TIMER_NO_DEADLINE; // CPU 0's next wakeup
+
+/*
+ * Tickless mode: the PIT is masked, the LAPIC timer is armed one-shot for
+ * the next wheel event or slice end, and the clocksource keeps time in
+ * between.
+ */
+static bool g_tickless = false;
+static uint64_t g_ns_base = 0;
+static uint64_t g_us_base = 0;
+static uint64_t g_lapic_per_ms = 0;
+static uint64_t g_slice_deadline_us[SMP_MAX_CPUS];
+
+static uint64_t tick_us(void) {
+    return 1000000ull / (uint64_t)g_freq_hz;
+}
 
 void timer_phase(int hz) {
     if (hz == 0) hz = 100;
@@ -20,37 +69,355 @@ void timer_phase(int hz) {
     outb(0x40, (uint8_t)((divisor >> 8) & 0xFF));
 }
 
+// Runs the periodic callback on a worker thread, outside the interrupt
+static void callback_work_fn(void* arg) {
+    (void)arg;
+    timer_callback_t callback = g_callback;
+    if (callback) callback();
+}
+
+static struct work g_callback_work = WORK_INIT(callback_work_fn, NULL);
+
 void timer_set_callback(timer_callback_t callback) {
     g_callback = callback;
+    // The old callback may still be queued or drawing
+    work_cancel(&g_callback_work);
+}
+
+// --- Timer wheel ---
+
+static void wheel_insert(struct timer* t) {
+    uint64_t delta = t->expires - g_wheel.now;
+    if (delta >= WHEEL_SPAN) delta = WHEEL_SPAN - 1;
+
+    uint8_t level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (1ull << ((level + 1) * WHEEL_SLOT_BITS))) level++;
+
+    uint8_t slot = (uint8_t)(((g_wheel.now + delta) >> (level * WHEEL_SLOT_BITS)) & WHEEL_SLOT_MASK);
+    struct timer** head = &g_wheel.slots[level][slot];
+    t->level = level;
+    t->slot = slot;
+    t->next = *head;
+    if (*head) (*head)->pprev = &t->next;
+    t->pprev = head;
+    *head = t;
+    g_wheel.occupied[level] |= 1ull << slot;
+}
+
+static void wheel_unlink(struct timer* t) {
+    *t->pprev = t->next;
+    if (t->next) t->next->pprev = t->pprev;
+    if (g_wheel.slots[t->level][t->slot] == NULL) {
+        g_wheel.occupied[t->level] &= ~(1ull << t->slot);
+    }
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+// Takes a whole slot off the wheel and returns its list
+static struct timer* wheel_take_slot(uint8_t level, uint8_t slot) {
+    struct timer* list = g_wheel.slots[level][slot];
+    g_wheel.slots[level][slot] = NULL;
+    g_wheel.occupied[level] &= ~(1ull << slot);
+    return list;
+}
+
+// Earliest tick at which the wheel has work: a level 0 expiry or a cascade
+static uint64_t wheel_next_event(void) {
+    uint64_t next = TIMER_NO_DEADLINE;
+    for (uint8_t level = 0; level < WHEEL_LEVELS; level++) {
+        uint64_t bits = g_wheel.occupied[level];
+        if (!bits) continue;
+
+        uint8_t shift = level * WHEEL_SLOT_BITS;
+        uint64_t index = g_wheel.now >> shift;
+        // Rotate so bit 0 is the slot after the current one
+        uint8_t r = (uint8_t)((index + 1) & WHEEL_SLOT_MASK);
+        uint64_t rotated = r ? (bits >> r) | (bits << (64 - r)) : bits;
+        uint64_t event = (index + 1 + (uint64_t)__builtin_ctzll(rotated)) << shift;
+        if (event < next) next = event;
+    }
+    return next;
+}
+
+// Re-files a higher-level slot now that its range has come within reach
+static void wheel_cascade(uint8_t level) {
+    uint8_t slot = (uint8_t)((g_wheel.now >> (level * WHEEL_SLOT_BITS)) & WHEEL_SLOT_MASK);
+    if (!(g_wheel.occupied[level] & (1ull << slot))) return;
+
+    struct timer* t = wheel_take_slot(level, slot);
+    while (t) {
+        struct timer* next = t->next;
+        wheel_insert(t);
+        t = next;
+    }
+}
+
+// Called with g_wheel_lock held; drops it around each callback, so a
+// callback may add timers (or its own) again
+static void wheel_advance(uint64_t target) {
+    while (g_wheel.now < target) {
+        // Skip straight over ticks where nothing expires or cascades
+        uint64_t next = wheel_next_event();
+        if (next > target) {
+            g_wheel.now = target;
+            break;
+        }
+        g_wheel.now = next;
+
+        // When a level wraps, pull the next slot of the level above into it
+        for (uint8_t level = 1; level < WHEEL_LEVELS; level++) {
+            if (g_wheel.now & ((1ull << (level * WHEEL_SLOT_BITS)) - 1)) break;
+            wheel_cascade(level);
+        }
+
+        uint8_t slot = (uint8_t)(g_wheel.now & WHEEL_SLOT_MASK);
+        struct timer* t;
+        while ((t = g_wheel.slots[0][slot]) != NULL) {
+            wheel_unlink(t);
+            void (*fn)(void*) = t->fn;
+            void* arg = t->arg;
+            t->running = true;
+            __atomic_store_n(&t->pending, false, __ATOMIC_RELEASE);
+            spin_unlock(&g_wheel_lock);
+            fn(arg);
+            spin_lock(&g_wheel_lock);
+            // Last touch: timer_cancel may hand the timer back to its owner now
+            __atomic_store_n(&t->running, false, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+// --- Tickless event programming ---
+
+// Arms this CPU's LAPIC for its next event. Only CPU 0 waits for the wheel
+// (with g_wheel_lock held); the others only have a slice deadline.
+static void program_next_locked(uint32_t cpu) {
+    uint64_t deadline = g_slice_deadline_us[cpu];
+    if (cpu == 0) {
+        uint64_t next_tick = wheel_next_event();
+        // The periodic callback runs on every 4th tick
+        if (g_callback) {
+            uint64_t callback_tick = (g_wheel.now / 4 + 1) * 4;
+            if (callback_tick < next_tick) next_tick = callback_tick;
+        }
+        g_wheel_armed_tick = next_tick;
+        if (next_tick != TIMER_NO_DEADLINE && next_tick * tick_us() < deadline) {
+            deadline = next_tick * tick_us();
+        }
+    }
+    if (deadline == TIMER_NO_DEADLINE) {
+        // Nothing to wait for: no interrupts until someone adds work
+        lapic_timer_stop();
+        return;
+    }
+
+    uint64_t now = timer_get_us();
+    uint64_t wait_us = deadline > now ? deadline - now : 0;
+    if (wait_us > TIMER_MAX_WAIT_US) wait_us = TIMER_MAX_WAIT_US;
+    uint64_t count = wait_us * g_lapic_per_ms / 1000;
+    if (count == 0) count = 1;
+    if (count > 0xFFFFFFFFull) count = 0xFFFFFFFFull;
+    lapic_timer_oneshot((uint32_t)count);
+}
+
+// Interrupts must be off
+static void timer_program_next(void) {
+    if (!g_tickless) return;
+
+    uint32_t cpu = smp_cpu_id();
+    if (cpu != 0) {
+        program_next_locked(cpu);
+        return;
+    }
+    spin_lock(&g_wheel_lock);
+    program_next_locked(0);
+    spin_unlock(&g_wheel_lock);
+}
+
+void timer_arm_slice(uint64_t deadline_us) {
+    uint64_t flags = irq_save();
+    g_slice_deadline_us[smp_cpu_id()] = deadline_us;
+    timer_program_next();
+    irq_restore(flags);
+}
+
+void pit_oneshot_wait(uint32_t ms) {
+    uint16_t count = (uint16_t)(PIT_FREQUENCY * ms / 1000);
+    uint8_t port61 = inb(0x61);
+    outb(0x61, (uint8_t)(port61 & ~0x03));           // Gate and speaker off while loading
+    outb(0x43, 0xB0);                                // Channel 2, lo/hi byte, mode 0
+    outb(0x42, (uint8_t)(count & 0xFF));
+    outb(0x42, (uint8_t)(count >> 8));
+    outb(0x61, (uint8_t)((port61 & ~0x02) | 0x01)); // Gate on: counting starts here
+
+    // OUT2 goes high when the count reaches zero
+    while (!(inb(0x61) & 0x20)) {}
+    outb(0x61, port61);
+}
+
+// Counts LAPIC timer cycles over PIT_CALIBRATE_MS
+static bool timer_calibrate(void) {
+    lapic_timer_oneshot(0xFFFFFFFF);
+    pit_oneshot_wait(PIT_CALIBRATE_MS);
+    uint32_t lapic_elapsed = 0xFFFFFFFF - lapic_timer_current();
+    lapic_timer_stop();
+
+    g_lapic_per_ms = lapic_elapsed / PIT_CALIBRATE_MS;
+    return g_lapic_per_ms != 0;
+}
+
+void timer_add(struct timer* t, uint64_t expires, void (*fn)(void* arg), void* arg) {
+    uint64_t flags = spin_lock_irqsave(&g_wheel_lock);
+    if (t->pending) wheel_unlink(t);
+    // A deadline that has already passed fires on the next tick
+    if (expires <= g_wheel.now) expires = g_wheel.now + 1;
+    t->expires = expires;
+    t->fn = fn;
+    t->arg = arg;
+    t->pending = true;
+    wheel_insert(t);
+
+    bool kick = false;
+    if (g_tickless) {
+        if (smp_cpu_id() == 0) program_next_locked(0);
+        else kick = expires < g_wheel_armed_tick;
+    }
+    spin_unlock_irqrestore(&g_wheel_lock, flags);
+
+    // CPU 0 is asleep past the new deadline; it re-arms from the kick
+    if (kick) smp_kick(0);
+}
+
+bool timer_cancel(struct timer* t) {
+    uint64_t flags = spin_lock_irqsave(&g_wheel_lock);
+    bool was_pending = t->pending;
+    if (was_pending) {
+        wheel_unlink(t);
+        t->pending = false;
+    }
+    spin_unlock_irqrestore(&g_wheel_lock, flags);
+
+    // The callback runs on CPU 0 with the lock dropped, and never for long
+    while (__atomic_load_n(&t->running, __ATOMIC_ACQUIRE)) {
+        __asm__ volatile("pause");
+    }
+    return was_pending;
 }
 
 void timer_handler(void) {
-    g_ticks++;
-    
-    if (g_callback != NULL && (g_ticks % 4 == 0)) {
-        g_callback();
+    // The wheel and the periodic callback belong to CPU 0
+    if (smp_cpu_id() == 0) {
+        uint64_t now = g_tickless ? timer_get_ticks() : g_ticks + 1;
+        spin_lock(&g_wheel_lock);
+        bool callback_due = g_callback != NULL && now / 4 != g_wheel.now / 4;
+        g_ticks = now;
+        wheel_advance(now);
+        spin_unlock(&g_wheel_lock);
+        vdso_update_time(now);
+
+        if (callback_due) {
+            work_queue(&g_callback_work);
+        }
     }
 
-    if (g_ticks % 2 == 0) {
-        schedule();
+    // Re-arm before the caller's scheduler_tick, which may switch away
+    timer_program_next();
+}
+
+// --- Sleeping ---
+
+static void sleep_expired(void* arg) {
+    scheduler_wake((Task*)arg);
+}
+
+void sleep_until(uint64_t tick) {
+    Task* self = scheduler_current_task();
+
+    uint64_t flags = irq_save();
+    if (tick > timer_get_ticks()) {
+        struct timer t = {0};
+        timer_add(&t, tick, sleep_expired, self);
+        // The timer only fires once, so any other wakeup just sleeps again
+        while (__atomic_load_n(&t.pending, __ATOMIC_ACQUIRE)) {
+            if (self) {
+                // Recheck after publishing the state, or a wakeup from
+                // another CPU could slip in between
+                scheduler_set_state(TASK_SLEEPING);
+                if (__atomic_load_n(&t.pending, __ATOMIC_SEQ_CST)) schedule();
+                else scheduler_set_state(TASK_READY);
+            } else {
+                // Too early in boot for the scheduler; just halt until it fires
+                __asm__ volatile("sti; hlt; cli" ::: "memory");
+            }
+        }
+        // sleep_expired may still be waking us; 't' and 'self' outlive it
+        timer_cancel(&t);
     }
+    irq_restore(flags);
+}
+
+void sleep_ticks(uint64_t ticks) {
+    sleep_until(timer_get_ticks() + ticks);
 }
 
 void timer_wait(int ticks) {
-    uint64_t end = g_ticks + ticks;
-    while (g_ticks < end) {
-        // FIX: Use 'pause' instead of 'hlt'. 
-        // 'hlt' is privileged and will crash User Mode programs (Ring 3).
+    if (ticks <= 0) return;
+
+    uint16_t cs;
+    __asm__ volatile("mov %%cs, %0" : "=r"(cs));
+    if ((cs & 3) == 0) {
+        sleep_ticks((uint64_t)ticks);
+        return;
+    }
+
+    // Ring 3 can neither block nor 'hlt' here; it should use the sleep syscall
+    uint64_t end = timer_get_ticks() + ticks;
+    while (timer_get_ticks() < end) {
         __asm__ volatile("pause");
     }
 }
 
-uint64_t timer_get_ticks(void) { return g_ticks; }
-uint64_t timer_get_uptime(void) { return g_ticks / g_freq_hz; }
+uint64_t timer_get_us(void) {
+    if (!g_tickless) return g_ticks * tick_us();
+    return g_us_base + (clock_monotonic_ns() - g_ns_base) / 1000;
+}
+
+void timer_udelay(uint64_t us) {
+    uint64_t end = timer_get_us() + us;
+    while (timer_get_us() < end) {
+        __asm__ volatile("pause");
+    }
+}
+
+bool timer_is_tickless(void) {
+    return g_tickless;
+}
+
+uint64_t timer_get_ticks(void) { return g_tickless ? timer_get_us() / tick_us() : g_ticks; }
+uint64_t timer_get_uptime(void) { return timer_get_ticks() / g_freq_hz; }
 
 void timer_init(void) {
     timer_phase(100);
     g_callback = NULL;
+    spin_lock_register(&g_wheel_lock);
+    g_wheel = (struct timer_wheel){0};
+    g_wheel.now = g_ticks;
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        g_slice_deadline_us[cpu] = TIMER_NO_DEADLINE;
+    }
+
+    // Without interrupts from the PIT, time has to come from a free-running counter
+    clocksource_init();
+    if (clocksource_is_continuous() && lapic_init() && timer_calibrate()) {
+        g_us_base = g_ticks * tick_us();
+        g_ns_base = clock_monotonic_ns();
+        g_tickless = true;
+        interrupts_disable_irq(0);
+        syslog_write("Timer: Tickless, LAPIC one-shot calibrated against the PIT");
+        return;
+    }
+
     interrupts_enable_irq(0);
     syslog_write("PIT: System timer initialized");
 }
@@ -0,0 +1,38 @@
+#include "vdso.h"
+
+#include "clocksource.h"
+#include "rtc.h"
+
+static union {
+    struct vdso_data data;
+    uint8_t page[4096];
+} g_vdso __attribute__((aligned(4096)));
+
+const struct vdso_data* vdso_page(void) {
+    return &g_vdso.data;
+}
+
+static void write_begin(uint32_t* seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void write_end(uint32_t* seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+void vdso_update_time(uint64_t ticks) {
+    struct vdso_data* v = &g_vdso.data;
+    write_begin(&v->time_seq);
+    v->ticks = ticks;
+    v->monotonic_ns = clock_monotonic_ns();
+    v->unix_time = rtc_unix_time();
+    write_end(&v->time_seq);
+}
+
+void vdso_update_mouse(const MouseState* state) {
+    struct vdso_data* v = &g_vdso.data;
+    write_begin(&v->mouse_seq);
+    v->mouse = *state;
+    write_end(&v->mouse_seq);
+}
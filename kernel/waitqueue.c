@@ -0,0 +1,83 @@
+#include "waitqueue.h"
+
+#include <stddef.h>
+
+void wait_queue_init(struct wait_queue* wq, const char* name) {
+    spin_lock_init(&wq->lock, name);
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+// Called with wq->lock held
+static void wq_append(struct wait_queue* wq, struct wait_entry* entry) {
+    entry->next = NULL;
+    if (wq->tail) wq->tail->next = entry;
+    else wq->head = entry;
+    wq->tail = entry;
+    entry->queued = true;
+}
+
+static void wq_unlink(struct wait_queue* wq, struct wait_entry* entry) {
+    struct wait_entry** link = &wq->head;
+    struct wait_entry* prev = NULL;
+    while (*link && *link != entry) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    if (!*link) return;
+    *link = entry->next;
+    if (wq->tail == entry) wq->tail = prev;
+    entry->next = NULL;
+    entry->queued = false;
+}
+
+void wait_prepare(struct wait_queue* wq, struct wait_entry* entry) {
+    // Interrupts stay off from the first prepare until wait_finish, so the
+    // condition check and the state change cannot be split by a wakeup
+    if (!entry->task) {
+        entry->flags = irq_save();
+        entry->task = scheduler_current_task();
+    }
+    spin_lock(&wq->lock);
+    if (!entry->queued) wq_append(wq, entry);
+    scheduler_set_state(TASK_BLOCKED);
+    spin_unlock(&wq->lock);
+}
+
+void wait_sleep(void) {
+    // Returns at once if a waker already made us READY again
+    schedule();
+}
+
+void wait_finish(struct wait_queue* wq, struct wait_entry* entry) {
+    scheduler_set_state(TASK_READY);
+    spin_lock(&wq->lock);
+    if (entry->queued) wq_unlink(wq, entry);
+    spin_unlock(&wq->lock);
+    irq_restore(entry->flags);
+}
+
+static unsigned wake(struct wait_queue* wq, bool all) {
+    unsigned woken = 0;
+    uint64_t flags = spin_lock_irqsave(&wq->lock);
+    while (wq->head) {
+        struct wait_entry* entry = wq->head;
+        wq->head = entry->next;
+        if (!wq->head) wq->tail = NULL;
+        entry->next = NULL;
+        entry->queued = false;
+        scheduler_wake(entry->task);
+        woken++;
+        if (!all) break;
+    }
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return woken;
+}
+
+unsigned wait_queue_wake_one(struct wait_queue* wq) {
+    return wake(wq, false);
+}
+
+unsigned wait_queue_wake_all(struct wait_queue* wq) {
+    return wake(wq, true);
+}
@@ -0,0 +1,115 @@
+#include "workqueue.h"
+
+#include <stddef.h>
+#include "scheduler.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "syslog.h"
+#include "waitqueue.h"
+
+static spinlock_t g_work_lock = SPINLOCK_INIT("workqueue");
+static struct work* g_work_head = NULL;
+static struct work* g_work_tail = NULL;
+static struct wait_queue g_work_waiters = WAIT_QUEUE_INIT("workqueue.idle");
+static struct wait_queue g_work_done = WAIT_QUEUE_INIT("workqueue.done");
+
+// Called with g_work_lock held
+static void work_link(struct work* w) {
+    w->next = NULL;
+    if (g_work_tail) g_work_tail->next = w;
+    else g_work_head = w;
+    g_work_tail = w;
+}
+
+static void work_unlink(struct work* w) {
+    struct work** link = &g_work_head;
+    struct work* prev = NULL;
+    while (*link && *link != w) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    if (!*link) return;
+    *link = w->next;
+    if (g_work_tail == w) g_work_tail = prev;
+    w->next = NULL;
+}
+
+bool work_queue(struct work* w) {
+    uint64_t flags = spin_lock_irqsave(&g_work_lock);
+    bool queued = !w->pending;
+    if (queued) {
+        w->pending = true;
+        // A running item is re-linked by its worker once fn returns
+        if (!w->running) work_link(w);
+    }
+    spin_unlock_irqrestore(&g_work_lock, flags);
+
+    if (queued) wait_queue_wake_one(&g_work_waiters);
+    return queued;
+}
+
+static bool work_available(void) {
+    return __atomic_load_n(&g_work_head, __ATOMIC_ACQUIRE) != NULL;
+}
+
+static bool work_idle(struct work* w) {
+    return !__atomic_load_n(&w->running, __ATOMIC_ACQUIRE);
+}
+
+bool work_cancel(struct work* w) {
+    uint64_t flags = spin_lock_irqsave(&g_work_lock);
+    bool was_pending = w->pending;
+    if (was_pending) {
+        if (!w->running) work_unlink(w);
+        w->pending = false;
+    }
+    spin_unlock_irqrestore(&g_work_lock, flags);
+
+    wait_event(&g_work_done, work_idle(w));
+    return was_pending;
+}
+
+static void worker_main(void) {
+    while (1) {
+        wait_event(&g_work_waiters, work_available());
+
+        uint64_t flags = spin_lock_irqsave(&g_work_lock);
+        struct work* w = g_work_head;
+        if (w) {
+            g_work_head = w->next;
+            if (!g_work_head) g_work_tail = NULL;
+            w->next = NULL;
+            w->pending = false;
+            w->running = true;
+        }
+        spin_unlock_irqrestore(&g_work_lock, flags);
+        if (!w) continue;
+
+        w->fn(w->arg);
+
+        flags = spin_lock_irqsave(&g_work_lock);
+        bool requeued = w->pending;
+        if (requeued) work_link(w);
+        // Last touch: work_cancel may hand the item back to its owner now
+        __atomic_store_n(&w->running, false, __ATOMIC_RELEASE);
+        spin_unlock_irqrestore(&g_work_lock, flags);
+
+        if (requeued) wait_queue_wake_one(&g_work_waiters);
+        wait_queue_wake_all(&g_work_done);
+    }
+}
+
+void workqueue_init(void) {
+    spin_lock_register(&g_work_lock);
+
+    uint32_t workers = smp_cpu_count();
+    for (uint32_t i = 0; i < workers; i++) {
+        Task* worker = spawn_task(worker_main);
+        if (!worker) {
+            syslog_write("Workqueue: Failed to start a worker");
+            break;
+        }
+        scheduler_set_name(worker, "kworker");
+    }
+    syslog_write("Workqueue: Worker threads started");
+}
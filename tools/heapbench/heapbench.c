@@ -0,0 +1,394 @@
+/*
+ * heapbench - runs the kernel allocator (heap.c, slab.c, arena.c) as a
+ * normal Linux program and replays allocation traces against it.
+ *
+ *   heapbench [-v] [-n rounds] [trace...]
+ *
+ * Without trace files the built-in synthetic workloads run. Trace files are
+ * what a HEAP_TRACE=1 kernel prints on the debug console ("heap a <ptr>
+ * <size>" / "heap f <ptr>"); any other line is ignored, so a raw
+ * -debugcon capture can be passed as is.
+ *
+ * Every workload is replayed twice on a fresh heap: once timed, once with
+ * heap_get_stats sampled for footprint and fragmentation.
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "arena.h"
+#include "heap.h"
+#include "host_shims.h"
+
+#define HEAP_RESERVE (1ull << 32)   // Same as PAGING_HEAP_SIZE
+#define SAMPLE_EVERY 256
+
+enum op_kind {
+    OP_ALLOC,          // kmalloc into slot
+    OP_FREE,           // kfree slot
+    OP_ARENA_ALLOC,    // sys_malloc path: task arena
+    OP_ARENA_FREE,
+    OP_ARENA_RELEASE,  // Task exit
+};
+
+struct op {
+    uint8_t kind;
+    uint32_t slot;
+    uint32_t size;
+};
+
+struct trace {
+    const char* name;
+    struct op* ops;
+    size_t count;
+    size_t capacity;
+    size_t slots;
+};
+
+struct result {
+    double ns_per_op;
+    size_t peak_in_use;
+    size_t peak_mapped;
+    size_t final_mapped;
+    uint32_t frag_max;
+    uint32_t frag_final;
+    uint64_t failures;
+};
+
+static void** g_slots = NULL;
+static size_t g_slot_capacity = 0;
+static uint8_t* g_reserve = NULL;
+static struct task_arena g_arena;
+
+// --- Trace building ---
+
+static uint64_t g_rng = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rng_next(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (uint32_t)(g_rng >> 16);
+}
+
+static uint32_t rng_range(uint32_t lo, uint32_t hi) {
+    return lo + rng_next() % (hi - lo + 1);
+}
+
+static void trace_push(struct trace* t, uint8_t kind, uint32_t slot, uint32_t size) {
+    if (t->count == t->capacity) {
+        t->capacity = t->capacity ? t->capacity * 2 : 4096;
+        t->ops = realloc(t->ops, t->capacity * sizeof(struct op));
+        if (!t->ops) {
+            perror("heapbench");
+            exit(1);
+        }
+    }
+    t->ops[t->count++] = (struct op){ kind, slot, size };
+    if (slot + 1 > t->slots) t->slots = slot + 1;
+}
+
+// Desktop sessions: windows come and go, Paint windows carry a canvas.
+static void build_gui_sessions(struct trace* t, int rounds) {
+    enum { MAX_WINDOWS = 16 };
+    for (int session = 0; session < rounds; session++) {
+        uint32_t window[MAX_WINDOWS] = {0};
+        uint32_t canvas[MAX_WINDOWS] = {0};
+        uint32_t next_slot = 1;
+        for (int step = 0; step < 200; step++) {
+            int i = (int)rng_range(0, MAX_WINDOWS - 1);
+            if (window[i]) {
+                if (canvas[i]) trace_push(t, OP_FREE, canvas[i], 0);
+                trace_push(t, OP_FREE, window[i], 0);
+                window[i] = canvas[i] = 0;
+                continue;
+            }
+            window[i] = next_slot++;
+            trace_push(t, OP_ALLOC, window[i], rng_range(900, 1400));
+            if (rng_range(0, 3) == 0) {
+                canvas[i] = next_slot++;
+                trace_push(t, OP_ALLOC, canvas[i], rng_range(200, 640) * rng_range(150, 480) * 4);
+            }
+        }
+        for (int i = 0; i < MAX_WINDOWS; i++) {
+            if (canvas[i]) trace_push(t, OP_FREE, canvas[i], 0);
+            if (window[i]) trace_push(t, OP_FREE, window[i], 0);
+        }
+    }
+}
+
+// A Paint window being dragged larger and smaller, with small undo records.
+static void build_paint_resize(struct trace* t, int rounds) {
+    uint32_t w = 400, h = 300;
+    uint32_t canvas = 1;
+    uint32_t next_slot = 2;
+    uint32_t undo[64] = {0};
+    trace_push(t, OP_ALLOC, canvas, w * h * 4);
+    for (int step = 0; step < rounds * 100; step++) {
+        w = rng_range(w > 240 ? w - 40 : 200, w < 1240 ? w + 40 : 1280);
+        h = rng_range(h > 190 ? h - 30 : 160, h < 770 ? h + 30 : 800);
+        uint32_t fresh = next_slot++;
+        trace_push(t, OP_ALLOC, fresh, w * h * 4);
+        trace_push(t, OP_FREE, canvas, 0);
+        canvas = fresh;
+
+        uint32_t u = rng_range(0, 63);
+        if (undo[u]) trace_push(t, OP_FREE, undo[u], 0);
+        undo[u] = next_slot++;
+        trace_push(t, OP_ALLOC, undo[u], rng_range(24, 256));
+    }
+    trace_push(t, OP_FREE, canvas, 0);
+    for (int u = 0; u < 64; u++) {
+        if (undo[u]) trace_push(t, OP_FREE, undo[u], 0);
+    }
+}
+
+// Ring 3 tasks hammering sys_malloc, then exiting.
+static void build_syscall_bursts(struct trace* t, int rounds) {
+    for (int task = 0; task < rounds; task++) {
+        uint32_t base = 1;
+        uint32_t count = rng_range(500, 3000);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t size = rng_range(0, 15) == 0 ? rng_range(2048, 65536) : rng_range(8, 256);
+            trace_push(t, OP_ARENA_ALLOC, base + i, size);
+        }
+        for (uint32_t i = 0; i < count / 2; i++) {
+            trace_push(t, OP_ARENA_FREE, base + rng_range(0, count - 1), 0);
+        }
+        for (uint32_t i = 0; i < count / 4; i++) {
+            trace_push(t, OP_ARENA_ALLOC, base + count + i, rng_range(8, 512));
+        }
+        trace_push(t, OP_ARENA_RELEASE, 0, 0);
+    }
+}
+
+// Long-lived random mix, mostly small.
+static void build_random_mix(struct trace* t, int rounds) {
+    enum { LIVE = 4096 };
+    uint32_t live[LIVE] = {0};
+    uint32_t next_slot = 1;
+    for (int step = 0; step < rounds * 2000; step++) {
+        uint32_t i = rng_range(0, LIVE - 1);
+        if (live[i]) {
+            trace_push(t, OP_FREE, live[i], 0);
+            live[i] = 0;
+        } else {
+            live[i] = next_slot++;
+            uint32_t size = rng_range(0, 3) ? rng_range(1, 3000) : rng_range(1, 20000);
+            trace_push(t, OP_ALLOC, live[i], size);
+        }
+    }
+    for (int i = 0; i < LIVE; i++) {
+        if (live[i]) trace_push(t, OP_FREE, live[i], 0);
+    }
+}
+
+// --- Recorded traces ---
+
+struct ptr_map {
+    uint64_t* keys;
+    uint32_t* values;
+    size_t capacity;
+};
+
+static uint32_t* ptr_map_slot(struct ptr_map* map, uint64_t key) {
+    size_t mask = map->capacity - 1;
+    size_t i = (size_t)(key * 0x9E3779B97F4A7C15ull >> 20) & mask;
+    while (map->keys[i] != 0 && map->keys[i] != key) i = (i + 1) & mask;
+    map->keys[i] = key;
+    return &map->values[i];
+}
+
+static int load_trace(struct trace* t, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+
+    struct ptr_map map = { NULL, NULL, 1u << 20 };
+    map.keys = calloc(map.capacity, sizeof(uint64_t));
+    map.values = calloc(map.capacity, sizeof(uint32_t));
+    uint32_t next_slot = 1;
+    size_t skipped = 0;
+    char line[256];
+
+    while (fgets(line, sizeof(line), file)) {
+        char op;
+        unsigned long long ptr;
+        unsigned long size = 0;
+        const char* record = strstr(line, "heap ");
+        if (!record || sscanf(record, "heap %c %llx %lu", &op, &ptr, &size) < 2 || ptr == 0) continue;
+
+        uint32_t* slot = ptr_map_slot(&map, ptr);
+        if (op == 'a') {
+            *slot = next_slot++;
+            trace_push(t, OP_ALLOC, *slot, (uint32_t)size);
+        } else if (op == 'f' && *slot != 0) {
+            trace_push(t, OP_FREE, *slot, 0);
+            *slot = 0;
+        } else {
+            skipped++;
+        }
+    }
+    fclose(file);
+    free(map.keys);
+    free(map.values);
+
+    if (skipped) fprintf(stderr, "%s: %zu frees without a matching allocation\n", path, skipped);
+    return 0;
+}
+
+// --- Replay ---
+
+static void heap_reset(void) {
+    if (g_reserve) munmap(g_reserve, HEAP_RESERVE);
+    g_reserve = mmap(NULL, HEAP_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (g_reserve == MAP_FAILED) {
+        perror("heapbench: mmap");
+        exit(1);
+    }
+    host_reset_footprint();
+    heap_init(g_reserve, HEAP_RESERVE);
+    g_arena = (struct task_arena){0};
+}
+
+static void ensure_slots(size_t slots) {
+    if (slots <= g_slot_capacity) {
+        memset(g_slots, 0, slots * sizeof(void*));
+        return;
+    }
+    free(g_slots);
+    g_slots = calloc(slots, sizeof(void*));
+    g_slot_capacity = slots;
+}
+
+static inline void apply(const struct op* op, uint64_t* failures) {
+    switch (op->kind) {
+        case OP_ALLOC:
+            g_slots[op->slot] = kmalloc(op->size);
+            if (!g_slots[op->slot]) (*failures)++;
+            else memset(g_slots[op->slot], 0xA5, op->size < 64 ? op->size : 64);
+            break;
+        case OP_FREE:
+            kfree(g_slots[op->slot]);
+            g_slots[op->slot] = NULL;
+            break;
+        case OP_ARENA_ALLOC:
+            g_slots[op->slot] = arena_alloc(&g_arena, op->size);
+            if (!g_slots[op->slot]) (*failures)++;
+            break;
+        case OP_ARENA_FREE:
+            arena_free(&g_arena, g_slots[op->slot]);
+            g_slots[op->slot] = NULL;
+            break;
+        case OP_ARENA_RELEASE:
+            arena_release(&g_arena);
+            break;
+    }
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static struct result run_trace(const struct trace* t) {
+    struct result r = {0};
+    uint64_t failures = 0;
+
+    // Pass 1: timed
+    heap_reset();
+    ensure_slots(t->slots);
+    double start = now_ns();
+    for (size_t i = 0; i < t->count; i++) apply(&t->ops[i], &failures);
+    r.ns_per_op = t->count ? (now_ns() - start) / (double)t->count : 0;
+    r.failures = failures;
+
+    // Pass 2: sampled
+    heap_reset();
+    ensure_slots(t->slots);
+    failures = 0;
+    struct heap_stats st;
+    for (size_t i = 0; i < t->count; i++) {
+        apply(&t->ops[i], &failures);
+        if (i % SAMPLE_EVERY == 0) {
+            heap_get_stats(&st);
+            if (st.frag_percent > r.frag_max) r.frag_max = st.frag_percent;
+        }
+    }
+    heap_get_stats(&st);
+    r.peak_in_use = st.peak_bytes;
+    r.peak_mapped = host_committed_peak_bytes();
+    r.final_mapped = host_committed_bytes();
+    r.frag_final = st.frag_percent;
+    return r;
+}
+
+static void report(const struct trace* t, const struct result* r) {
+    printf("%-16s %10zu %9.1f %12zu %12zu %12zu %5u/%-6u %8llu\n",
+           t->name, t->count, r->ns_per_op,
+           r->peak_in_use / 1024, r->peak_mapped / 1024, r->final_mapped / 1024,
+           r->frag_max, r->frag_final, (unsigned long long)r->failures);
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr, "usage: %s [-v] [-n rounds] [trace...]\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    int rounds = 50;
+    int first_trace = argc;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            host_set_verbose(true);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+            if (rounds <= 0) usage(argv[0]);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+        } else {
+            first_trace = i;
+            break;
+        }
+    }
+
+    printf("%-16s %10s %9s %12s %12s %12s %12s %8s\n",
+           "workload", "ops", "ns/op", "peak-use-KB", "peak-map-KB", "end-map-KB", "frag max/end", "failed");
+
+    if (first_trace == argc) {
+        static void (*const builders[])(struct trace*, int) = {
+            build_gui_sessions, build_paint_resize, build_syscall_bursts, build_random_mix,
+        };
+        static const char* const names[] = { "gui-sessions", "paint-resize", "syscall-bursts", "random-mix" };
+        for (size_t i = 0; i < sizeof(builders) / sizeof(builders[0]); i++) {
+            struct trace t = { .name = names[i] };
+            builders[i](&t, rounds);
+            struct result r = run_trace(&t);
+            report(&t, &r);
+            free(t.ops);
+        }
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = first_trace; i < argc; i++) {
+        struct trace t = { .name = argv[i] };
+        if (load_trace(&t, argv[i]) != 0) {
+            status = 1;
+            continue;
+        }
+        struct result r = run_trace(&t);
+        report(&t, &r);
+        free(t.ops);
+    }
+    return status;
+}
@@ -0,0 +1,72 @@
+/*
+ * Host stand-ins for the kernel services heap.c, slab.c and arena.c use.
+ * The heap range is an mmap'd PROT_NONE reservation; paging_commit and
+ * paging_decommit flip page protection, so touching memory the allocator
+ * has not mapped faults just like it would in the kernel.
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "host_shims.h"
+#include "paging.h"
+#include "pmm.h"
+#include "syslog.h"
+
+static size_t g_committed_pages = 0;
+static size_t g_committed_peak = 0;
+static bool g_verbose = false;
+
+void syslog_write(const char* message) {
+    if (g_verbose) fprintf(stderr, "[kernel] %s\n", message);
+}
+
+void syslog_trace(const char* message) {
+    (void)message;
+}
+
+bool paging_commit(uint64_t virt, size_t pages) {
+    if (mprotect((void*)(uintptr_t)virt, pages * HOST_PAGE_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        return false;
+    }
+    g_committed_pages += pages;
+    if (g_committed_pages > g_committed_peak) g_committed_peak = g_committed_pages;
+    return true;
+}
+
+void paging_decommit(uint64_t virt, size_t pages) {
+    // Drop the contents too, so the footprint really shrinks
+    madvise((void*)(uintptr_t)virt, pages * HOST_PAGE_SIZE, MADV_DONTNEED);
+    mprotect((void*)(uintptr_t)virt, pages * HOST_PAGE_SIZE, PROT_NONE);
+    g_committed_pages -= pages;
+}
+
+void* pmm_alloc_pages(size_t count) {
+    return aligned_alloc(HOST_PAGE_SIZE, count * HOST_PAGE_SIZE);
+}
+
+void pmm_free_pages(void* addr, size_t count) {
+    (void)count;
+    free(addr);
+}
+
+void host_set_verbose(bool verbose) {
+    g_verbose = verbose;
+}
+
+void host_reset_footprint(void) {
+    g_committed_pages = 0;
+    g_committed_peak = 0;
+}
+
+size_t host_committed_bytes(void) {
+    return g_committed_pages * HOST_PAGE_SIZE;
+}
+
+size_t host_committed_peak_bytes(void) {
+    return g_committed_peak * HOST_PAGE_SIZE;
+}
@@ -0,0 +1,16 @@
+#ifndef HOST_SHIMS_H
+#define HOST_SHIMS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HOST_PAGE_SIZE 4096
+
+void host_set_verbose(bool verbose);
+
+/* Pages the heap currently has mapped, and the high-water mark since reset. */
+void host_reset_footprint(void);
+size_t host_committed_bytes(void);
+size_t host_committed_peak_bytes(void);
+
+#endif /* HOST_SHIMS_H */
@@ -0,0 +1,25 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * The benchmark is single threaded and runs in user space, where the
+ * kernel's cli/sti based locks would fault. Locks compile to nothing.
+ */
+typedef struct {
+    uint16_t next;
+    uint16_t owner;
+} spinlock_t;
+
+#define SPINLOCK_INIT(name) { 0, 0 }
+
+static inline void spin_lock(spinlock_t* lock) { (void)lock; }
+static inline bool spin_trylock(spinlock_t* lock) { (void)lock; return true; }
+static inline void spin_unlock(spinlock_t* lock) { (void)lock; }
+static inline uint64_t spin_lock_irqsave(spinlock_t* lock) { (void)lock; return 0; }
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint64_t flags) { (void)lock; (void)flags; }
+static inline void spin_lock_register(spinlock_t* lock) { (void)lock; }
+
+#endif /* SPINLOCK_H */